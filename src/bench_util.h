@@ -0,0 +1,145 @@
+#pragma once
+
+// Frame-time benchmark.
+// Samples are collected per phase after a warm-up period and summarized as
+// min/mean/p50/p95/p99/max; the summary is printed and can be written as JSON or CSV
+// so a CI job can compare runs.
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BenchSeries {
+	const char* name;
+	std::vector<double> samplesMs;
+};
+
+struct BenchStats {
+	double minMs = 0.0;
+	double meanMs = 0.0;
+	double p50Ms = 0.0;
+	double p95Ms = 0.0;
+	double p99Ms = 0.0;
+	double maxMs = 0.0;
+};
+
+struct FrameBench {
+	uint32_t warmupFrames = 0;
+	uint32_t frames = 0;
+	uint32_t seen = 0;
+	double elapsedMs = 0.0;      // wall time of the measured frames
+	std::vector<BenchSeries> series;
+	std::vector<std::pair<std::string, std::string>> info;  // run description written with the results
+};
+
+void initFrameBench(FrameBench& bench, uint32_t warmupFrames, uint32_t frames, const std::vector<const char*>& seriesNames) {
+	bench.warmupFrames = warmupFrames;
+	bench.frames = frames;
+	bench.seen = 0;
+	bench.elapsedMs = 0.0;
+	bench.series.clear();
+	for (const char* name : seriesNames) {
+		bench.series.push_back({ name, std::vector<double>() });
+		bench.series.back().samplesMs.reserve(frames);
+	}
+}
+
+// samples are in the order of the series names; returns false while still warming up
+bool addFrameBenchSample(FrameBench& bench, const std::vector<double>& samplesMs) {
+	if (bench.seen++ < bench.warmupFrames) {
+		return false;
+	}
+	for (size_t i = 0; i < bench.series.size() && i < samplesMs.size(); i++) {
+		bench.series[i].samplesMs.push_back(samplesMs[i]);
+	}
+	return true;
+}
+
+bool isFrameBenchDone(const FrameBench& bench) {
+	return bench.seen >= bench.warmupFrames + bench.frames;
+}
+
+// nearest-rank percentiles
+BenchStats computeBenchStats(std::vector<double> samples) {
+	BenchStats stats;
+	if (samples.empty()) {
+		return stats;
+	}
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * double(samples.size())));
+		return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+	};
+	double sum = 0.0;
+	for (double s : samples) {
+		sum += s;
+	}
+	stats.minMs = samples.front();
+	stats.maxMs = samples.back();
+	stats.meanMs = sum / double(samples.size());
+	stats.p50Ms = percentile(50.0);
+	stats.p95Ms = percentile(95.0);
+	stats.p99Ms = percentile(99.0);
+	return stats;
+}
+
+double frameBenchFps(const FrameBench& bench) {
+	size_t frames = bench.series.empty() ? 0 : bench.series[0].samplesMs.size();
+	return bench.elapsedMs > 0.0 ? double(frames) * 1000.0 / bench.elapsedMs : 0.0;
+}
+
+void printFrameBench(const FrameBench& bench) {
+	std::cout << "benchmark: " << (bench.series.empty() ? 0 : bench.series[0].samplesMs.size()) << " frames after "
+		<< bench.warmupFrames << " warm-up frames, " << frameBenchFps(bench) << " fps\n";
+	std::cout << "  metric          min(ms)   mean(ms)  p50(ms)   p95(ms)   p99(ms)   max(ms)\n";
+	for (const auto& series : bench.series) {
+		BenchStats s = computeBenchStats(series.samplesMs);
+		char line[160];
+		snprintf(line, sizeof(line), "  %-15s %-9.4f %-9.4f %-9.4f %-9.4f %-9.4f %.4f\n", series.name,
+			s.minMs, s.meanMs, s.p50Ms, s.p95Ms, s.p99Ms, s.maxMs);
+		std::cout << line;
+	}
+}
+
+// info values are written as JSON strings; callers pass plain names and numbers
+bool writeFrameBenchJson(const FrameBench& bench, const std::string& path) {
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "{\n");
+	for (const auto& entry : bench.info) {
+		fprintf(fp, "  \"%s\": \"%s\",\n", entry.first.c_str(), entry.second.c_str());
+	}
+	fprintf(fp, "  \"warmup_frames\": %u,\n  \"frames\": %u,\n  \"fps\": %.3f,\n  \"metrics\": {",
+		bench.warmupFrames, static_cast<uint32_t>(bench.series.empty() ? 0 : bench.series[0].samplesMs.size()), frameBenchFps(bench));
+	for (size_t i = 0; i < bench.series.size(); i++) {
+		BenchStats s = computeBenchStats(bench.series[i].samplesMs);
+		fprintf(fp, "%s\n    \"%s\": { \"min_ms\": %.6f, \"mean_ms\": %.6f, \"p50_ms\": %.6f, \"p95_ms\": %.6f, \"p99_ms\": %.6f, \"max_ms\": %.6f }",
+			i ? "," : "", bench.series[i].name, s.minMs, s.meanMs, s.p50Ms, s.p95Ms, s.p99Ms, s.maxMs);
+	}
+	fprintf(fp, "\n  }\n}\n");
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
+
+bool writeFrameBenchCsv(const FrameBench& bench, const std::string& path) {
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "metric,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+	for (const auto& series : bench.series) {
+		BenchStats s = computeBenchStats(series.samplesMs);
+		fprintf(fp, "%s,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n", series.name, s.minMs, s.meanMs, s.p50Ms, s.p95Ms, s.p99Ms, s.maxMs);
+	}
+	fprintf(fp, "fps,,%.3f,,,,\n", frameBenchFps(bench)); // in the mean column
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+// Async compute.
+// Compute passes are recorded per frame in flight and submitted to a compute-capable queue
+// family without graphics when the device has one, so they overlap with rasterization of the
+// previous frame. The graphics submit waits on the returned semaphore at the stage that
+// consumes the results. Devices with a single family get the graphics queue; the
+// submission and synchronization path stays the same.
+
+#include "vk_dispatch.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "host_allocator.h"
+#include "pipeline_cache.h"
+#include "spirv_reflect.h"
+
+struct ComputePipeline {
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	uint32_t pushConstantSize = 0;
+	uint32_t localSize[3] = { 1, 1, 1 };
+};
+
+struct ComputeFrame {
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkSemaphore computeDone = VK_NULL_HANDLE;
+	bool recording = false;
+};
+
+struct ComputeQueue {
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t familyIndex = 0;
+	uint32_t graphicsFamilyIndex = 0;
+	std::vector<ComputeFrame> frames;
+	uint64_t dispatches = 0;
+	uint64_t submits = 0;
+};
+
+// prefers a compute family without graphics (async compute), otherwise the graphics family
+uint32_t findComputeQueueIndex(const std::vector<VkQueueFamilyProperties>& queueFamilies, uint32_t graphics_index) {
+	uint32_t queueFamilyCount = static_cast<uint32_t>(queueFamilies.size());
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
+		VkQueueFlags flags = queueFamilies[i].queueFlags;
+		if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+			return i;
+		}
+	}
+	return graphics_index;
+}
+
+// the set and pipeline layouts come from the shader's reflection and are owned by the layout cache
+ComputePipeline createComputePipeline(PipelineCacheStore& pipelineCache, LayoutCache& layoutCache, const ReflectedShader& shader) {
+	const ShaderReflection& reflection = shader.reflection;
+	if (reflection.stage != VK_SHADER_STAGE_COMPUTE_BIT) {
+		throw std::runtime_error("failed to create compute pipeline: not a compute shader!");
+	}
+	ReflectedLayout layout = getReflectedLayout(layoutCache, { &reflection });
+	ComputePipeline cp;
+	cp.setLayout = layout.setLayouts.empty() ? VK_NULL_HANDLE : layout.setLayouts[0];
+	cp.layout = layout.layout;
+	cp.pushConstantSize = layout.pushConstantSize;
+	for (int i = 0; i < 3; i++) {
+		cp.localSize[i] = std::max(reflection.localSize[i], 1u);
+	}
+
+	VkComputePipelineCreateInfo pipeline_ci = {};
+	pipeline_ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_ci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_ci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_ci.stage.module = shader.module;
+	pipeline_ci.stage.pName = reflection.entryPoint.c_str();
+	pipeline_ci.layout = cp.layout;
+	cp.pipeline = createComputePipelineCached(pipelineCache, pipeline_ci);
+	return cp;
+}
+
+void destroyComputePipeline(VkDevice dev, ComputePipeline& cp) {
+	vkDestroyPipeline(dev, cp.pipeline, hostAllocationCallbacks());
+	cp = ComputePipeline();
+}
+
+void initComputeQueue(ComputeQueue& cq, VkDevice dev, VkQueue queue, uint32_t familyIndex,
+	uint32_t graphicsFamilyIndex, uint32_t framesInFlight)
+{
+	cq.device = dev;
+	cq.queue = queue;
+	cq.familyIndex = familyIndex;
+	cq.graphicsFamilyIndex = graphicsFamilyIndex;
+	cq.frames.resize(framesInFlight);
+	for (auto& frame : cq.frames) {
+		VkCommandPoolCreateInfo pool_ci = {};
+		pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		pool_ci.queueFamilyIndex = familyIndex;
+		if (vkCreateCommandPool(dev, &pool_ci, hostAllocationCallbacks(), &frame.commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute command pool!");
+		}
+		VkCommandBufferAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = frame.commandPool;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
+		VkSemaphoreCreateInfo semaphore_ci = {};
+		semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		if (vkAllocateCommandBuffers(dev, &alloc_info, &frame.commandBuffer) != VK_SUCCESS ||
+			vkCreateSemaphore(dev, &semaphore_ci, hostAllocationCallbacks(), &frame.computeDone) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute frame!");
+		}
+	}
+}
+
+bool isAsyncCompute(const ComputeQueue& cq) {
+	return cq.familyIndex != cq.graphicsFamilyIndex;
+}
+
+// call after the graphics fence of this frame slot has signaled: the graphics submit that
+// waited on computeDone last time is then finished, and so is the compute work before it
+VkCommandBuffer beginComputeFrame(ComputeQueue& cq, uint32_t frameIndex) {
+	ComputeFrame& frame = cq.frames[frameIndex];
+	vkResetCommandPool(cq.device, frame.commandPool, 0);
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(frame.commandBuffer, &begin_info);
+	frame.recording = true;
+	return frame.commandBuffer;
+}
+
+void dispatchCompute(ComputeQueue& cq, VkCommandBuffer cmd, const ComputePipeline& cp, VkDescriptorSet set,
+	const void* pushConstants, uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ)
+{
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cp.pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cp.layout, 0, 1, &set, 0, nullptr);
+	if (cp.pushConstantSize) {
+		vkCmdPushConstants(cmd, cp.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, cp.pushConstantSize, pushConstants);
+	}
+	vkCmdDispatch(cmd, groupsX, groupsY, groupsZ);
+	cq.dispatches++;
+}
+
+// compute -> compute dependency between passes of the same queue
+void computeBarrier(VkCommandBuffer cmd) {
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// Submits the frame's compute work and returns the semaphore the graphics submit of the same
+// frame has to wait on. Buffers shared with graphics are created VK_SHARING_MODE_CONCURRENT
+// over both families, so no ownership transfer is needed.
+VkSemaphore submitComputeFrame(ComputeQueue& cq, uint32_t frameIndex) {
+	ComputeFrame& frame = cq.frames[frameIndex];
+	vkEndCommandBuffer(frame.commandBuffer);
+	frame.recording = false;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &frame.commandBuffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &frame.computeDone;
+	if (vkQueueSubmit(cq.queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit compute command buffer!");
+	}
+	cq.submits++;
+	return frame.computeDone;
+}
+
+void dumpComputeStats(const ComputeQueue& cq) {
+	std::cout << "compute:\t" << cq.dispatches << " dispatches in " << cq.submits << " submits on queue family "
+		<< cq.familyIndex << (isAsyncCompute(cq) ? " (async)" : " (graphics)") << "\n";
+}
+
+void destroyComputeQueue(ComputeQueue& cq) {
+	for (auto& frame : cq.frames) {
+		vkDestroySemaphore(cq.device, frame.computeDone, hostAllocationCallbacks());
+		vkDestroyCommandPool(cq.device, frame.commandPool, hostAllocationCallbacks());
+	}
+	cq.frames.clear();
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+// Debug tier.
+// Builds with VKSAMPLE_DEBUG=1 (the clearSampleDebug target) enable the validation layer and a
+// VK_EXT_debug_utils messenger, name Vulkan objects and wrap GPU work in command buffer labels
+// so captures (RenderDoc, Nsight, validation messages) show what each object and range is.
+// VKSAMPLE_DEBUG=0 in the environment switches all of it off at run time.
+// Release builds compile every call here to nothing: no layers, no callbacks, no extra
+// instance extensions.
+
+#include "vk_dispatch.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "host_allocator.h"
+#include "device_caps.h"
+
+#ifndef VKSAMPLE_DEBUG
+	#define VKSAMPLE_DEBUG 0
+#endif
+
+struct DebugProfile {
+	bool enabled = false;
+	std::vector<const char*> layers;
+	std::vector<const char*> extensions;   // added to the instance extensions
+};
+
+#if VKSAMPLE_DEBUG
+
+struct DebugUtils {
+	bool enabled = false;
+	bool hasDebugUtils = false;
+	VkDebugUtilsMessengerEXT messenger = VK_NULL_HANDLE;
+	PFN_vkCreateDebugUtilsMessengerEXT createMessenger = nullptr;
+	PFN_vkDestroyDebugUtilsMessengerEXT destroyMessenger = nullptr;
+	PFN_vkSetDebugUtilsObjectNameEXT setObjectName = nullptr;
+	PFN_vkCmdBeginDebugUtilsLabelEXT beginLabel = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT endLabel = nullptr;
+	std::atomic<uint32_t> errors{ 0 };
+	std::atomic<uint32_t> warnings{ 0 };
+	std::atomic<uint32_t> namedObjects{ 0 };   // named from startup tasks on several threads
+};
+
+DebugUtils _debugUtils;
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+	VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT* data, void*)
+{
+	const char* level = "info";
+	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+		level = "error";
+		_debugUtils.errors++;
+	}
+	else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+		level = "warning";
+		_debugUtils.warnings++;
+	}
+	std::cerr << "validation " << level << ": " << data->pMessage << "\n";
+	return VK_FALSE;
+}
+
+void fillDebugMessengerInfo(VkDebugUtilsMessengerCreateInfoEXT& messenger_ci) {
+	messenger_ci = {};
+	messenger_ci.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	messenger_ci.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	messenger_ci.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+		VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	messenger_ci.pfnUserCallback = debugUtilsCallback;
+}
+
+// call after queryInstanceCaps; picks whatever of validation and debug_utils is installed
+DebugProfile selectDebugProfile(const InstanceCaps& caps) {
+	DebugProfile profile;
+	const char* env = getenv("VKSAMPLE_DEBUG");
+	if (env && strcmp(env, "0") == 0) {
+		return profile;
+	}
+	profile.enabled = true;
+
+	// the Khronos layer replaced the LunarG meta layer; older SDKs only have the latter
+	for (const char* name : { "VK_LAYER_KHRONOS_validation", "VK_LAYER_LUNARG_standard_validation" }) {
+		if (hasInstanceLayer(caps, name)) {
+			profile.layers.push_back(name);
+			break;
+		}
+	}
+	if (profile.layers.empty()) {
+		std::cout << "debug:\t\tno validation layer installed\n";
+	}
+
+	if (hasInstanceExtension(caps, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
+		profile.extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}
+	return profile;
+}
+
+// chains a messenger into instance creation so vkCreateInstance/vkDestroyInstance are covered too
+void chainDebugMessenger(const DebugProfile& profile, VkInstanceCreateInfo& instance_ci, VkDebugUtilsMessengerCreateInfoEXT& messenger_ci) {
+	if (!profile.enabled || profile.extensions.empty()) {
+		return;
+	}
+	fillDebugMessengerInfo(messenger_ci);
+	messenger_ci.pNext = instance_ci.pNext;
+	instance_ci.pNext = &messenger_ci;
+}
+
+void initDebugUtils(VkInstance instance, const DebugProfile& profile) {
+	_debugUtils.enabled = profile.enabled;
+	_debugUtils.hasDebugUtils = profile.enabled && !profile.extensions.empty();
+	if (!_debugUtils.hasDebugUtils) {
+		return;
+	}
+	_debugUtils.createMessenger = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+	_debugUtils.destroyMessenger = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT"));
+	_debugUtils.setObjectName = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT"));
+	_debugUtils.beginLabel = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT"));
+	_debugUtils.endLabel = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT"));
+
+	VkDebugUtilsMessengerCreateInfoEXT messenger_ci;
+	fillDebugMessengerInfo(messenger_ci);
+	if (!_debugUtils.createMessenger ||
+		_debugUtils.createMessenger(instance, &messenger_ci, hostAllocationCallbacks(), &_debugUtils.messenger) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create debug messenger!");
+	}
+}
+
+template <typename T>
+void setObjectName(VkDevice dev, VkObjectType type, T handle, const char* name) {
+	if (!_debugUtils.setObjectName) {
+		return;
+	}
+	VkDebugUtilsObjectNameInfoEXT name_info = {};
+	name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+	name_info.objectType = type;
+	name_info.objectHandle = (uint64_t)handle;
+	name_info.pObjectName = name;
+	_debugUtils.setObjectName(dev, &name_info);
+	_debugUtils.namedObjects++;
+}
+
+void beginDebugLabel(VkCommandBuffer cmd, const char* name) {
+	if (!_debugUtils.beginLabel) {
+		return;
+	}
+	VkDebugUtilsLabelEXT label = {};
+	label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label.pLabelName = name;
+	_debugUtils.beginLabel(cmd, &label);
+}
+
+void endDebugLabel(VkCommandBuffer cmd) {
+	if (_debugUtils.endLabel) {
+		_debugUtils.endLabel(cmd);
+	}
+}
+
+void dumpDebugUtilsStats() {
+	if (!_debugUtils.enabled) {
+		std::cout << "debug:\t\toff (VKSAMPLE_DEBUG=0)\n";
+		return;
+	}
+	std::cout << "debug:\t\t" << _debugUtils.errors << " validation errors, " << _debugUtils.warnings << " warnings, "
+		<< _debugUtils.namedObjects << " objects named" << (_debugUtils.hasDebugUtils ? "" : " (no VK_EXT_debug_utils)") << "\n";
+}
+
+void destroyDebugUtils(VkInstance instance) {
+	if (_debugUtils.messenger != VK_NULL_HANDLE) {
+		_debugUtils.destroyMessenger(instance, _debugUtils.messenger, hostAllocationCallbacks());
+	}
+	_debugUtils.messenger = VK_NULL_HANDLE;
+	_debugUtils.setObjectName = nullptr;
+	_debugUtils.beginLabel = nullptr;
+	_debugUtils.endLabel = nullptr;
+}
+
+#else
+
+// release: nothing is enabled and every call below is an empty inline function
+inline DebugProfile selectDebugProfile(const InstanceCaps&) { return DebugProfile(); }
+inline void chainDebugMessenger(const DebugProfile&, VkInstanceCreateInfo&, VkDebugUtilsMessengerCreateInfoEXT&) {}
+inline void initDebugUtils(VkInstance, const DebugProfile&) {}
+template <typename T>
+inline void setObjectName(VkDevice, VkObjectType, T, const char*) {}
+inline void beginDebugLabel(VkCommandBuffer, const char*) {}
+inline void endDebugLabel(VkCommandBuffer) {}
+inline void dumpDebugUtilsStats() {}
+inline void destroyDebugUtils(VkInstance) {}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+// Deferred destruction of objects that frames in flight may still reference.
+// Objects retired while frame N is being built are destroyed once every frame before N
+// has finished on the GPU, which the frame loop learns from its fences; nothing here
+// waits on the device.
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+
+struct PendingDeletion {
+	uint64_t retireFrame;
+	std::function<void()> destroy;
+};
+
+struct DeletionQueue {
+	std::deque<PendingDeletion> pending;
+	uint64_t deleted = 0;
+};
+
+// retireFrame: number of frames submitted so far; the object is unused by any later frame
+void deferDeletion(DeletionQueue& queue, uint64_t retireFrame, std::function<void()> destroy) {
+	queue.pending.push_back({ retireFrame, std::move(destroy) });
+}
+
+// frames [0, completedFrames) are known to have finished
+void flushDeletionQueue(DeletionQueue& queue, uint64_t completedFrames) {
+	while (!queue.pending.empty() && queue.pending.front().retireFrame <= completedFrames) {
+		queue.pending.front().destroy();
+		queue.pending.pop_front();
+		queue.deleted++;
+	}
+}
+
+// the device has to be idle
+void flushAllDeletions(DeletionQueue& queue) {
+	flushDeletionQueue(queue, UINT64_MAX);
+}
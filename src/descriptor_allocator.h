@@ -0,0 +1,230 @@
+#pragma once
+
+// Descriptor set allocation.
+// Transient sets come from a chain of pools per frame in flight. Nothing is freed one set at a
+// time: once the frame's fence has signaled, every pool of its chain is reset with a single
+// vkResetDescriptorPool and goes back to a shared free list. A chain grows by taking another
+// pool when the current one runs out, and new pools are made larger each time.
+// Sets whose contents never change are cached by a hash of layout and descriptors in a
+// separate, never-reset chain, so callers can ask for them every frame.
+// Not thread-safe; each recording thread needs its own allocator.
+
+#include "vk_dispatch.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "host_allocator.h"
+
+// one descriptor to write; buffer or image info depending on the type
+struct DescriptorBinding {
+	uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	VkDescriptorBufferInfo buffer = {};
+	VkDescriptorImageInfo image = {};
+};
+
+DescriptorBinding bufferDescriptor(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	DescriptorBinding d;
+	d.binding = binding;
+	d.type = type;
+	d.buffer = { buffer, offset, range };
+	return d;
+}
+
+DescriptorBinding imageDescriptor(uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView view, VkImageLayout layout) {
+	DescriptorBinding d;
+	d.binding = binding;
+	d.type = type;
+	d.image = { sampler, view, layout };
+	return d;
+}
+
+struct DescriptorPoolChain {
+	VkDescriptorPool current = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> full;   // ran out of space since the last reset
+};
+
+struct CachedDescriptorSet {
+	std::vector<uint64_t> key;
+	VkDescriptorSet set;
+};
+
+struct DescriptorAllocatorStats {
+	uint32_t poolsCreated = 0;
+	uint32_t chainGrowths = 0;      // a chain needed another pool
+	uint64_t poolResets = 0;
+	uint64_t transientSets = 0;
+	uint32_t immutableSets = 0;
+	uint64_t immutableHits = 0;
+};
+
+struct DescriptorAllocator {
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPoolSize> perSet;  // average descriptors of each type per set
+	uint32_t setsPerPool = 0;                  // size of the next pool created
+	uint32_t maxSetsPerPool = 4096;
+	std::vector<VkDescriptorPool> freePools;   // reset, ready to be reused by any chain
+	std::vector<VkDescriptorPool> allPools;
+	std::vector<DescriptorPoolChain> frames;
+	DescriptorPoolChain immutable;
+	std::unordered_multimap<uint64_t, CachedDescriptorSet> immutableSets;
+	DescriptorAllocatorStats stats;
+};
+
+// perSet describes an average set, e.g. { STORAGE_BUFFER, 2 } for sets of two storage buffers
+void initDescriptorAllocator(DescriptorAllocator& da, VkDevice dev, uint32_t framesInFlight,
+	const std::vector<VkDescriptorPoolSize>& perSet, uint32_t initialSetsPerPool = 64)
+{
+	da.device = dev;
+	da.perSet = perSet;
+	da.setsPerPool = std::max(initialSetsPerPool, 1u);
+	da.frames.resize(framesInFlight);
+}
+
+VkDescriptorPool acquireDescriptorPool(DescriptorAllocator& da) {
+	if (!da.freePools.empty()) {
+		VkDescriptorPool pool = da.freePools.back();
+		da.freePools.pop_back();
+		return pool;
+	}
+	std::vector<VkDescriptorPoolSize> sizes = da.perSet;
+	for (auto& size : sizes) {
+		size.descriptorCount *= da.setsPerPool;
+	}
+	VkDescriptorPoolCreateInfo pool_ci = {};
+	pool_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_ci.maxSets = da.setsPerPool;
+	pool_ci.poolSizeCount = static_cast<uint32_t>(sizes.size());
+	pool_ci.pPoolSizes = sizes.data();
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(da.device, &pool_ci, hostAllocationCallbacks(), &pool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+	da.allPools.push_back(pool);
+	da.stats.poolsCreated++;
+	da.setsPerPool = std::min(da.setsPerPool * 2, da.maxSetsPerPool);
+	return pool;
+}
+
+VkDescriptorSet allocateFromChain(DescriptorAllocator& da, DescriptorPoolChain& chain, VkDescriptorSetLayout layout) {
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &layout;
+	VkDescriptorSet set;
+	for (int attempt = 0; attempt < 2; attempt++) {
+		if (chain.current == VK_NULL_HANDLE) {
+			chain.current = acquireDescriptorPool(da);
+		}
+		alloc_info.descriptorPool = chain.current;
+		VkResult res = vkAllocateDescriptorSets(da.device, &alloc_info, &set);
+		if (res == VK_SUCCESS) {
+			return set;
+		}
+		if (res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL) {
+			break;
+		}
+		chain.full.push_back(chain.current);
+		chain.current = VK_NULL_HANDLE;
+		da.stats.chainGrowths++;
+	}
+	throw std::runtime_error("failed to allocate descriptor set!");
+}
+
+void writeDescriptorSet(VkDevice dev, VkDescriptorSet set, const std::vector<DescriptorBinding>& bindings) {
+	std::vector<VkWriteDescriptorSet> writes(bindings.size());
+	for (size_t i = 0; i < bindings.size(); i++) {
+		const DescriptorBinding& b = bindings[i];
+		bool isImage = b.type == VK_DESCRIPTOR_TYPE_SAMPLER || b.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			b.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || b.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+			b.type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		writes[i] = {};
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = b.binding;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = b.type;
+		writes[i].pBufferInfo = isImage ? nullptr : &b.buffer;
+		writes[i].pImageInfo = isImage ? &b.image : nullptr;
+	}
+	vkUpdateDescriptorSets(dev, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+// call once the fence of frameIndex has signaled; the frame's sets become invalid
+void resetDescriptorFrame(DescriptorAllocator& da, uint32_t frameIndex) {
+	DescriptorPoolChain& chain = da.frames[frameIndex];
+	if (chain.current != VK_NULL_HANDLE) {
+		chain.full.push_back(chain.current);
+		chain.current = VK_NULL_HANDLE;
+	}
+	for (VkDescriptorPool pool : chain.full) {
+		vkResetDescriptorPool(da.device, pool, 0);
+		da.freePools.push_back(pool);
+		da.stats.poolResets++;
+	}
+	chain.full.clear();
+}
+
+// valid until the frame slot is reset
+VkDescriptorSet allocateFrameDescriptorSet(DescriptorAllocator& da, uint32_t frameIndex, VkDescriptorSetLayout layout,
+	const std::vector<DescriptorBinding>& bindings)
+{
+	VkDescriptorSet set = allocateFromChain(da, da.frames[frameIndex], layout);
+	writeDescriptorSet(da.device, set, bindings);
+	da.stats.transientSets++;
+	return set;
+}
+
+// Returns the same set for the same layout and descriptors; written once, valid until the
+// allocator is destroyed. The referenced resources have to outlive the allocator.
+VkDescriptorSet getImmutableDescriptorSet(DescriptorAllocator& da, VkDescriptorSetLayout layout,
+	const std::vector<DescriptorBinding>& bindings)
+{
+	std::vector<uint64_t> key;
+	key.reserve(1 + bindings.size() * 7);
+	key.push_back((uint64_t)layout);
+	for (const auto& b : bindings) {
+		key.push_back((uint64_t(b.binding) << 32) | uint64_t(b.type));
+		key.push_back((uint64_t)b.buffer.buffer);
+		key.push_back(b.buffer.offset);
+		key.push_back(b.buffer.range);
+		key.push_back((uint64_t)b.image.imageView);
+		key.push_back((uint64_t)b.image.sampler);
+		key.push_back(uint64_t(b.image.imageLayout));
+	}
+	uint64_t hash = 14695981039346656037ull; // FNV-1a
+	for (uint64_t word : key) {
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+
+	auto range = da.immutableSets.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second.key == key) {
+			da.stats.immutableHits++;
+			return it->second.set;
+		}
+	}
+	VkDescriptorSet set = allocateFromChain(da, da.immutable, layout);
+	writeDescriptorSet(da.device, set, bindings);
+	da.immutableSets.insert({ hash, { std::move(key), set } });
+	da.stats.immutableSets++;
+	return set;
+}
+
+void dumpDescriptorAllocatorStats(const DescriptorAllocator& da) {
+	const DescriptorAllocatorStats& s = da.stats;
+	std::cout << "descriptors:\t" << s.poolsCreated << " pools created, " << s.chainGrowths << " chain growths, "
+		<< s.poolResets << " pool resets, " << s.transientSets << " frame sets, "
+		<< s.immutableSets << " immutable sets (" << s.immutableHits << " reused)\n";
+}
+
+void destroyDescriptorAllocator(DescriptorAllocator& da) {
+	for (VkDescriptorPool pool : da.allPools) {
+		vkDestroyDescriptorPool(da.device, pool, hostAllocationCallbacks());
+	}
+	da = DescriptorAllocator();
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+// Capability snapshot.
+// Everything device selection and creation need to know about the instance and the physical
+// devices is queried once into DeviceCaps / InstanceCaps and shared from there, instead of
+// every helper enumerating it again. Features, memory properties, queue families and device
+// extensions are kept in a small binary cache keyed by vendor, device, driver version,
+// pipeline cache UUID and the installed layers, so later runs only call
+// vkGetPhysicalDeviceProperties for the key. Surface-dependent data (present support,
+// formats, present modes) is never cached; it is queried once per surface.
+
+#include "vk_dispatch.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "pipeline_cache.h"
+
+struct DeviceCaps {
+	VkPhysicalDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties = {};
+	VkPhysicalDeviceFeatures features = {};
+	VkPhysicalDeviceMemoryProperties memory = {};
+	std::vector<VkQueueFamilyProperties> queueFamilies;
+	std::vector<VkExtensionProperties> extensions;
+	bool fromCache = false;
+
+	// per surface, filled by queryDeviceSurfaceCaps
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	std::vector<VkBool32> presentSupport;       // per queue family
+	std::vector<VkSurfaceFormatKHR> surfaceFormats;
+	std::vector<VkPresentModeKHR> presentModes;
+};
+
+struct InstanceCaps {
+	std::vector<VkExtensionProperties> extensions;
+	std::vector<VkLayerProperties> layers;
+	std::vector<DeviceCaps> devices;
+	uint32_t cachedDevices = 0;
+	bool cacheWritten = false;
+	double queryMs = 0.0;
+};
+
+struct DeviceCapsFileHeader {
+	uint32_t magic;
+	uint32_t fileVersion;
+	uint32_t deviceCount;
+	uint32_t reserved;
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+// one per device in the file, followed by its queue families and extensions
+struct DeviceCapsRecord {
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint32_t apiVersion;
+	uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t layersHash;
+	VkPhysicalDeviceFeatures features;
+	VkPhysicalDeviceMemoryProperties memory;
+	uint32_t queueFamilyCount;
+	uint32_t extensionCount;
+};
+
+static const uint32_t kDeviceCapsMagic = 0x4344564b; // "KVDC"
+static const uint32_t kDeviceCapsFileVersion = 1;
+
+// call once the Vulkan library is loaded, before the instance is created
+void queryInstanceCaps(InstanceCaps& caps) {
+	uint32_t count = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+	caps.extensions.resize(count);
+	vkEnumerateInstanceExtensionProperties(nullptr, &count, caps.extensions.data());
+	caps.extensions.resize(count);
+	count = 0;
+	vkEnumerateInstanceLayerProperties(&count, nullptr);
+	caps.layers.resize(count);
+	vkEnumerateInstanceLayerProperties(&count, caps.layers.data());
+	caps.layers.resize(count);
+}
+
+bool hasInstanceExtension(const InstanceCaps& caps, const char* name) {
+	for (const auto& extension : caps.extensions) {
+		if (strcmp(extension.extensionName, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool hasInstanceLayer(const InstanceCaps& caps, const char* name) {
+	for (const auto& layer : caps.layers) {
+		if (strcmp(layer.layerName, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool hasDeviceExtension(const DeviceCaps& caps, const char* name) {
+	for (const auto& extension : caps.extensions) {
+		if (strcmp(extension.extensionName, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// implicit layers can add device extensions, so the installed layers are part of the key
+uint64_t hashInstanceLayers(const InstanceCaps& caps) {
+	uint64_t hash = 14695981039346656037ull; // FNV-1a
+	for (const auto& layer : caps.layers) {
+		for (const char* c = layer.layerName; *c; c++) {
+			hash = (hash ^ uint8_t(*c)) * 1099511628211ull;
+		}
+		hash = (hash ^ layer.implementationVersion) * 1099511628211ull;
+	}
+	return hash;
+}
+
+bool matchesDeviceCapsRecord(const DeviceCapsRecord& record, const VkPhysicalDeviceProperties& props, uint64_t layersHash) {
+	return record.vendorID == props.vendorID && record.deviceID == props.deviceID &&
+		record.driverVersion == props.driverVersion && record.apiVersion == props.apiVersion &&
+		record.layersHash == layersHash && memcmp(record.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// fills caps from the cache file data; false when no record matches
+bool readCachedDeviceCaps(const std::vector<uint8_t>& file, uint64_t layersHash, DeviceCaps& caps) {
+	if (file.size() < sizeof(DeviceCapsFileHeader)) {
+		return false;
+	}
+	DeviceCapsFileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != kDeviceCapsMagic || header.fileVersion != kDeviceCapsFileVersion ||
+		header.dataSize != file.size() - sizeof(header) ||
+		header.dataHash != hashPipelineCacheData(file.data() + sizeof(header), static_cast<size_t>(header.dataSize))) {
+		return false;
+	}
+	size_t offset = sizeof(header);
+	for (uint32_t i = 0; i < header.deviceCount; i++) {
+		DeviceCapsRecord record;
+		if (offset + sizeof(record) > file.size()) {
+			return false;
+		}
+		memcpy(&record, file.data() + offset, sizeof(record));
+		offset += sizeof(record);
+		size_t queueBytes = size_t(record.queueFamilyCount) * sizeof(VkQueueFamilyProperties);
+		size_t extensionBytes = size_t(record.extensionCount) * sizeof(VkExtensionProperties);
+		if (queueBytes + extensionBytes > file.size() - offset) {
+			return false;
+		}
+		if (matchesDeviceCapsRecord(record, caps.properties, layersHash)) {
+			caps.features = record.features;
+			caps.memory = record.memory;
+			caps.queueFamilies.resize(record.queueFamilyCount);
+			memcpy(caps.queueFamilies.data(), file.data() + offset, queueBytes);
+			caps.extensions.resize(record.extensionCount);
+			memcpy(caps.extensions.data(), file.data() + offset + queueBytes, extensionBytes);
+			caps.fromCache = true;
+			return true;
+		}
+		offset += queueBytes + extensionBytes;
+	}
+	return false;
+}
+
+void appendDeviceCapsRecord(std::vector<uint8_t>& data, const DeviceCaps& caps, uint64_t layersHash) {
+	DeviceCapsRecord record = {};
+	record.vendorID = caps.properties.vendorID;
+	record.deviceID = caps.properties.deviceID;
+	record.driverVersion = caps.properties.driverVersion;
+	record.apiVersion = caps.properties.apiVersion;
+	memcpy(record.pipelineCacheUUID, caps.properties.pipelineCacheUUID, VK_UUID_SIZE);
+	record.layersHash = layersHash;
+	record.features = caps.features;
+	record.memory = caps.memory;
+	record.queueFamilyCount = static_cast<uint32_t>(caps.queueFamilies.size());
+	record.extensionCount = static_cast<uint32_t>(caps.extensions.size());
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+	data.insert(data.end(), bytes, bytes + sizeof(record));
+	bytes = reinterpret_cast<const uint8_t*>(caps.queueFamilies.data());
+	data.insert(data.end(), bytes, bytes + caps.queueFamilies.size() * sizeof(VkQueueFamilyProperties));
+	bytes = reinterpret_cast<const uint8_t*>(caps.extensions.data());
+	data.insert(data.end(), bytes, bytes + caps.extensions.size() * sizeof(VkExtensionProperties));
+}
+
+// Enumerates the physical devices and fills their caps, from cachePath when the key matches.
+// The cache is rewritten when any device had to be queried; an empty path disables it.
+void queryDeviceCaps(InstanceCaps& caps, VkInstance instance, const std::string& cachePath) {
+	auto start = std::chrono::steady_clock::now();
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+	std::vector<VkPhysicalDevice> devices(deviceCount);
+	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+	std::vector<uint8_t> file;
+	if (!cachePath.empty()) {
+		readBinaryFile(cachePath, file);
+	}
+	uint64_t layersHash = hashInstanceLayers(caps);
+	caps.devices.assign(deviceCount, DeviceCaps());
+	caps.cachedDevices = 0;
+	for (uint32_t i = 0; i < deviceCount; i++) {
+		DeviceCaps& dc = caps.devices[i];
+		dc.device = devices[i];
+		vkGetPhysicalDeviceProperties(dc.device, &dc.properties);
+		if (readCachedDeviceCaps(file, layersHash, dc)) {
+			caps.cachedDevices++;
+			continue;
+		}
+		vkGetPhysicalDeviceFeatures(dc.device, &dc.features);
+		vkGetPhysicalDeviceMemoryProperties(dc.device, &dc.memory);
+		uint32_t count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(dc.device, &count, nullptr);
+		dc.queueFamilies.resize(count);
+		vkGetPhysicalDeviceQueueFamilyProperties(dc.device, &count, dc.queueFamilies.data());
+		count = 0;
+		vkEnumerateDeviceExtensionProperties(dc.device, nullptr, &count, nullptr);
+		dc.extensions.resize(count);
+		vkEnumerateDeviceExtensionProperties(dc.device, nullptr, &count, dc.extensions.data());
+		dc.extensions.resize(count);
+	}
+
+	caps.cacheWritten = false;
+	if (!cachePath.empty() && caps.cachedDevices < deviceCount) {
+		std::vector<uint8_t> data;
+		for (const DeviceCaps& dc : caps.devices) {
+			appendDeviceCapsRecord(data, dc, layersHash);
+		}
+		DeviceCapsFileHeader header = {};
+		header.magic = kDeviceCapsMagic;
+		header.fileVersion = kDeviceCapsFileVersion;
+		header.deviceCount = deviceCount;
+		header.dataSize = data.size();
+		header.dataHash = hashPipelineCacheData(data.data(), data.size());
+		caps.cacheWritten = writeFileAtomic(cachePath, &header, sizeof(header), data.data(), data.size());
+	}
+	caps.queryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// present support, formats and present modes of surface; queried again only for a new surface
+void queryDeviceSurfaceCaps(DeviceCaps& caps, VkSurfaceKHR surface) {
+	if (caps.surface == surface && !caps.presentSupport.empty()) {
+		return;
+	}
+	caps.surface = surface;
+	caps.presentSupport.assign(caps.queueFamilies.size(), VK_FALSE);
+	caps.surfaceFormats.clear();
+	caps.presentModes.clear();
+	if (surface == VK_NULL_HANDLE) {
+		return;
+	}
+	for (uint32_t i = 0; i < caps.queueFamilies.size(); i++) {
+		vkGetPhysicalDeviceSurfaceSupportKHR(caps.device, i, surface, &caps.presentSupport[i]);
+	}
+	uint32_t count = 0;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(caps.device, surface, &count, nullptr);
+	caps.surfaceFormats.resize(count);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(caps.device, surface, &count, caps.surfaceFormats.data());
+	count = 0;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(caps.device, surface, &count, nullptr);
+	caps.presentModes.resize(count);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(caps.device, surface, &count, caps.presentModes.data());
+}
+
+const DeviceCaps* findDeviceCaps(const InstanceCaps& caps, VkPhysicalDevice device) {
+	for (const DeviceCaps& dc : caps.devices) {
+		if (dc.device == device) {
+			return &dc;
+		}
+	}
+	return nullptr;
+}
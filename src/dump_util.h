@@ -1,101 +1,152 @@
+#pragma once
 
-void dumpExtensions() {
-	// Extensions
-	uint32_t extensionCount = 0;
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
-	std::cout << extensionCount << " extensions supported" << std::endl;
-	std::vector<VkExtensionProperties> extensions(extensionCount);
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
-	for (const auto& extension : extensions) {
-		std::cout << "\t" << extension.extensionName << std::endl;
-	}
-}
-
-void dumpDeviceStatus(VkPhysicalDevice &gpu)
-{
-	VkPhysicalDeviceProperties gpu_properties;
-	VkPhysicalDeviceFeatures features_properties;
-	VkPhysicalDeviceMemoryProperties memory_properties;
-
-	uint32_t queue_families_count = 0;
-	vkGetPhysicalDeviceProperties(gpu, &gpu_properties);
-	uint32_t apiVer = gpu_properties.apiVersion;
-
-	std::cout << "gpu_Properties" << std::endl;
-	std::cout << std::endl;
-	std::cout << "Name:\t" << gpu_properties.deviceName << std::endl;
-	std::cout << "API Version:\t" << VK_VERSION_MAJOR(apiVer) << "." << VK_VERSION_MINOR(apiVer) << "." << VK_VERSION_PATCH(apiVer) << std::endl;
-	std::cout << "Driver Version:\t" << gpu_properties.driverVersion << std::endl;
-	std::cout << "Vendor ID:\t" << gpu_properties.vendorID << std::endl;
-	std::cout << "Device ID:\t" << gpu_properties.deviceID << std::endl;
-	std::cout << "Device Type:\t" << gpu_properties.deviceType << std::endl;
-
-	std::cout << std::endl;
-
-	vkGetPhysicalDeviceFeatures(gpu, &features_properties);
-	vkGetPhysicalDeviceMemoryProperties(gpu, &memory_properties);
+// Printing of the capability snapshot: a short summary on stdout and the full snapshot as
+// JSON on request (--dump-caps PATH).
 
+#include <stdio.h>
+#include <iostream>
+#include <string>
 
+#include "device_caps.h"
 
-	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_families_count, nullptr);
-	std::vector<VkQueueFamilyProperties> family_property(queue_families_count);
-	std::cout << "QueufamilyCount:\t" << queue_families_count << std::endl;
-	std::cout << std::endl;
-
-	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_families_count, family_property.data());
-	std::cout << "QueueFamilyProperties" << std::endl;
-	std::cout << std::endl;
-	for (uint32_t i = 0; i <queue_families_count; ++i) {
-		std::cout << std::endl;
-		std::cout << "Queue Family #" << i << std::endl;
-		std::cout << "VK_QUEUE_GRAPHICS_BIT      :\t" << ((family_property[i].queueFlags &VK_QUEUE_GRAPHICS_BIT) != 0) << std::endl;
-		std::cout << "VK_QUEUE_COMPUTE_BIT       :\t" << ((family_property[i].queueFlags &VK_QUEUE_COMPUTE_BIT) != 0) << std::endl;
-		std::cout << "VK_QUEUE_TRANSFER_BIT      :\t" << ((family_property[i].queueFlags &VK_QUEUE_TRANSFER_BIT) != 0) << std::endl;
-		std::cout << "VK_QUEUE_SPARSE_BINDING_BIT:\t" << ((family_property[i].queueFlags &VK_QUEUE_SPARSE_BINDING_BIT) != 0) << std::endl;
-		std::cout << "QUEUE COUNT:\t" << family_property[i].queueCount << std::endl;
-		std::cout << "timestampValidBits:\t" << family_property[i].timestampValidBits << std::endl;
-		uint32_t width = family_property[i].minImageTransferGranularity.width;
-		uint32_t height = family_property[i].minImageTransferGranularity.height;
-		uint32_t depth = family_property[i].minImageTransferGranularity.depth;
-		std::cout << "minImageTransferGranularity:\t" << width << ", " << height << ", " << depth << std::endl;
-
+const char* deviceTypeName(VkPhysicalDeviceType type) {
+	switch (type) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+	case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+	default: return "other";
 	}
+}
 
-	uint32_t extensions_count = 0;
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensions_count, nullptr);
-	std::vector<VkExtensionProperties> extensions(extensions_count);
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensions_count, extensions.data());
-
-	std::cout << std::endl;
-	std::cout << "Amount of Extensions " << extensions_count << std::endl;
-	std::cout << std::endl;
-	std::cout << "ExtensionProperties" << std::endl;
-	std::cout << std::endl;
-
-	for (int i = 0; i < extensions_count; i++) {
-		std::cout << std::endl;
-		std::cout << "Name:        " << extensions[i].extensionName << std::endl;
-		std::cout << "specVersion: " << extensions[i].specVersion << std::endl;
+void dumpDeviceCaps(const InstanceCaps& caps, const DeviceCaps& device) {
+	uint32_t api = device.properties.apiVersion;
+	std::cout << "instance:\t" << caps.extensions.size() << " extensions, " << caps.layers.size() << " layers\n";
+	std::cout << "device:\t\t" << device.properties.deviceName << " (" << deviceTypeName(device.properties.deviceType)
+		<< ", Vulkan " << VK_VERSION_MAJOR(api) << "." << VK_VERSION_MINOR(api) << "." << VK_VERSION_PATCH(api)
+		<< ", driver " << device.properties.driverVersion << "), " << device.queueFamilies.size() << " queue families, "
+		<< device.extensions.size() << " extensions\n";
+	std::cout << "caps:\t\t" << caps.devices.size() << " devices in " << caps.queryMs << " ms, " << caps.cachedDevices
+		<< " from cache" << (caps.cacheWritten ? ", cache updated" : "") << "\n";
+}
 
+// ---------------------------------------------------------------------------
+// JSON
+
+void writeJsonString(FILE* fp, const char* s) {
+	fputc('"', fp);
+	for (; *s; s++) {
+		unsigned char c = static_cast<unsigned char>(*s);
+		if (c == '"' || c == '\\') {
+			fprintf(fp, "\\%c", c);
+		}
+		else if (c < 0x20) {
+			fprintf(fp, "\\u%04x", c);
+		}
+		else {
+			fputc(c, fp);
+		}
 	}
-	std::cout << std::endl;
-
-	uint32_t layer_count = 0;
-	vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-
-	std::vector<VkLayerProperties> layers(layer_count);
-
-	vkEnumerateInstanceLayerProperties(&layer_count, layers.data());
+	fputc('"', fp);
+}
 
-	std::cout << "Amount of Layers " << layer_count << std::endl;
-	std::cout << std::endl;
-	for (int i = 0; i < layer_count; i++) {
-		std::cout << std::endl;
-		std::cout << "layerName:            " << layers[i].layerName << std::endl;
-		std::cout << "specVersion:          " << layers[i].specVersion << std::endl;
-		std::cout << "implementationVersion:" << layers[i].implementationVersion << std::endl;
-		std::cout << "description:          " << layers[i].description << std::endl;
+static const char* const kFeatureNames[] = {
+	"robustBufferAccess", "fullDrawIndexUint32", "imageCubeArray", "independentBlend", "geometryShader",
+	"tessellationShader", "sampleRateShading", "dualSrcBlend", "logicOp", "multiDrawIndirect",
+	"drawIndirectFirstInstance", "depthClamp", "depthBiasClamp", "fillModeNonSolid", "depthBounds",
+	"wideLines", "largePoints", "alphaToOne", "multiViewport", "samplerAnisotropy",
+	"textureCompressionETC2", "textureCompressionASTC_LDR", "textureCompressionBC", "occlusionQueryPrecise",
+	"pipelineStatisticsQuery", "vertexPipelineStoresAndAtomics", "fragmentStoresAndAtomics",
+	"shaderTessellationAndGeometryPointSize", "shaderImageGatherExtended", "shaderStorageImageExtendedFormats",
+	"shaderStorageImageMultisample", "shaderStorageImageReadWithoutFormat", "shaderStorageImageWriteWithoutFormat",
+	"shaderUniformBufferArrayDynamicIndexing", "shaderSampledImageArrayDynamicIndexing",
+	"shaderStorageBufferArrayDynamicIndexing", "shaderStorageImageArrayDynamicIndexing", "shaderClipDistance",
+	"shaderCullDistance", "shaderFloat64", "shaderInt64", "shaderInt16", "shaderResourceResidency",
+	"shaderResourceMinLod", "sparseBinding", "sparseResidencyBuffer", "sparseResidencyImage2D",
+	"sparseResidencyImage3D", "sparseResidency2Samples", "sparseResidency4Samples", "sparseResidency8Samples",
+	"sparseResidency16Samples", "sparseResidencyAliased", "variableMultisampleRate", "inheritedQueries",
+};
+static_assert(sizeof(kFeatureNames) / sizeof(kFeatureNames[0]) == sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32),
+	"feature names out of sync with VkPhysicalDeviceFeatures");
+
+void writeDeviceJson(FILE* fp, const DeviceCaps& dc) {
+	const VkPhysicalDeviceProperties& p = dc.properties;
+	const VkPhysicalDeviceLimits& l = p.limits;
+	fprintf(fp, "    {\n      \"name\": ");
+	writeJsonString(fp, p.deviceName);
+	fprintf(fp, ",\n      \"type\": \"%s\",\n      \"api_version\": \"%u.%u.%u\",\n      \"driver_version\": %u,\n"
+		"      \"vendor_id\": %u,\n      \"device_id\": %u,\n      \"from_cache\": %s,\n",
+		deviceTypeName(p.deviceType), VK_VERSION_MAJOR(p.apiVersion), VK_VERSION_MINOR(p.apiVersion), VK_VERSION_PATCH(p.apiVersion),
+		p.driverVersion, p.vendorID, p.deviceID, dc.fromCache ? "true" : "false");
+	fprintf(fp, "      \"limits\": { \"max_image_dimension_2d\": %u, \"max_push_constants_size\": %u, \"max_bound_descriptor_sets\": %u,"
+		" \"max_memory_allocation_count\": %u, \"max_compute_work_group_invocations\": %u, \"min_uniform_buffer_offset_alignment\": %llu,"
+		" \"non_coherent_atom_size\": %llu, \"buffer_image_granularity\": %llu, \"timestamp_period\": %g },\n",
+		l.maxImageDimension2D, l.maxPushConstantsSize, l.maxBoundDescriptorSets, l.maxMemoryAllocationCount,
+		l.maxComputeWorkGroupInvocations, (unsigned long long)l.minUniformBufferOffsetAlignment,
+		(unsigned long long)l.nonCoherentAtomSize, (unsigned long long)l.bufferImageGranularity, l.timestampPeriod);
+
+	fprintf(fp, "      \"features\": [");
+	const VkBool32* features = reinterpret_cast<const VkBool32*>(&dc.features);
+	bool first = true;
+	for (size_t i = 0; i < sizeof(kFeatureNames) / sizeof(kFeatureNames[0]); i++) {
+		if (features[i]) {
+			fprintf(fp, "%s\"%s\"", first ? "" : ", ", kFeatureNames[i]);
+			first = false;
+		}
+	}
+	fprintf(fp, "],\n      \"memory_heaps\": [");
+	for (uint32_t i = 0; i < dc.memory.memoryHeapCount; i++) {
+		fprintf(fp, "%s{ \"size\": %llu, \"flags\": %u }", i ? ", " : "",
+			(unsigned long long)dc.memory.memoryHeaps[i].size, dc.memory.memoryHeaps[i].flags);
+	}
+	fprintf(fp, "],\n      \"memory_types\": [");
+	for (uint32_t i = 0; i < dc.memory.memoryTypeCount; i++) {
+		fprintf(fp, "%s{ \"heap\": %u, \"flags\": %u }", i ? ", " : "",
+			dc.memory.memoryTypes[i].heapIndex, dc.memory.memoryTypes[i].propertyFlags);
+	}
+	fprintf(fp, "],\n      \"queue_families\": [");
+	for (size_t i = 0; i < dc.queueFamilies.size(); i++) {
+		const VkQueueFamilyProperties& q = dc.queueFamilies[i];
+		fprintf(fp, "%s\n        { \"flags\": %u, \"count\": %u, \"timestamp_valid_bits\": %u, \"min_image_transfer_granularity\": [%u, %u, %u] }",
+			i ? "," : "", q.queueFlags, q.queueCount, q.timestampValidBits,
+			q.minImageTransferGranularity.width, q.minImageTransferGranularity.height, q.minImageTransferGranularity.depth);
+	}
+	fprintf(fp, "\n      ],\n      \"extensions\": {");
+	for (size_t i = 0; i < dc.extensions.size(); i++) {
+		fprintf(fp, "%s\n        ", i ? "," : "");
+		writeJsonString(fp, dc.extensions[i].extensionName);
+		fprintf(fp, ": %u", dc.extensions[i].specVersion);
 	}
+	fprintf(fp, "\n      }\n    }");
+}
 
-	std::cout << std::endl;
-}
\ No newline at end of file
+bool writeDeviceCapsJson(const InstanceCaps& caps, const std::string& path) {
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "{\n  \"instance_extensions\": {");
+	for (size_t i = 0; i < caps.extensions.size(); i++) {
+		fprintf(fp, "%s\n    ", i ? "," : "");
+		writeJsonString(fp, caps.extensions[i].extensionName);
+		fprintf(fp, ": %u", caps.extensions[i].specVersion);
+	}
+	fprintf(fp, "\n  },\n  \"layers\": [");
+	for (size_t i = 0; i < caps.layers.size(); i++) {
+		const VkLayerProperties& layer = caps.layers[i];
+		fprintf(fp, "%s\n    { \"name\": ", i ? "," : "");
+		writeJsonString(fp, layer.layerName);
+		fprintf(fp, ", \"spec_version\": %u, \"implementation_version\": %u, \"description\": ", layer.specVersion, layer.implementationVersion);
+		writeJsonString(fp, layer.description);
+		fprintf(fp, " }");
+	}
+	fprintf(fp, "\n  ],\n  \"devices\": [\n");
+	for (size_t i = 0; i < caps.devices.size(); i++) {
+		writeDeviceJson(fp, caps.devices[i]);
+		fprintf(fp, "%s\n", i + 1 < caps.devices.size() ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
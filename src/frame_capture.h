@@ -0,0 +1,402 @@
+#pragma once
+
+// Frame capture.
+// Every presented frame is copied into the readback buffer of its frame slot at the end of
+// the frame's command buffer. The copy is collected when the slot comes around again, right
+// after its fence wait in drawFrame, so capturing never waits on the GPU beyond what the
+// frame ring already does. The pixels go straight from the mapped readback buffer into a
+// memory-mapped output file, either as they are (raw BGRA/RGBA) or converted to Y4M
+// (4:2:0, full range BT.601) for video tools. Conversion can run on a worker thread; the
+// slot is then only reused once the worker is done with its buffer.
+
+#include "vk_dispatch.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "job_system.h"
+#include "memory_allocator.h"
+
+enum class CaptureFormat {
+	Raw,    // the image's bytes, 4 per pixel
+	Y4M,
+};
+
+// ---------------------------------------------------------------------------
+// memory-mapped output file, grown in steps as frames are appended
+
+struct CaptureFile {
+	uint8_t* data = nullptr;
+	size_t capacity = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+void unmapCaptureFile(CaptureFile& file) {
+	if (!file.data) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(file.data);
+	CloseHandle(file.mapping);
+	file.mapping = nullptr;
+#else
+	munmap(file.data, file.capacity);
+#endif
+	file.data = nullptr;
+}
+
+// remaps the file with capacity bytes; nothing may write to the old mapping meanwhile
+bool growCaptureFile(CaptureFile& file, size_t capacity) {
+	unmapCaptureFile(file);
+#ifdef _WIN32
+	file.mapping = CreateFileMappingA(file.file, nullptr, PAGE_READWRITE, static_cast<DWORD>(uint64_t(capacity) >> 32),
+		static_cast<DWORD>(capacity & 0xffffffffu), nullptr);
+	void* view = file.mapping ? MapViewOfFile(file.mapping, FILE_MAP_WRITE, 0, 0, capacity) : nullptr;
+	if (!view) {
+		if (file.mapping) {
+			CloseHandle(file.mapping);
+			file.mapping = nullptr;
+		}
+		return false;
+	}
+#else
+	if (ftruncate(file.fd, static_cast<off_t>(capacity)) != 0) {
+		return false;
+	}
+	void* view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+#endif
+	file.data = static_cast<uint8_t*>(view);
+	file.capacity = capacity;
+	return true;
+}
+
+bool openCaptureFile(CaptureFile& file, const std::string& path, size_t capacity) {
+	file = CaptureFile();
+#ifdef _WIN32
+	file.file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file.file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+#else
+	file.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file.fd < 0) {
+		return false;
+	}
+#endif
+	return growCaptureFile(file, capacity);
+}
+
+// trims the file to size bytes
+void closeCaptureFile(CaptureFile& file, size_t size) {
+	unmapCaptureFile(file);
+#ifdef _WIN32
+	if (file.file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER end;
+		end.QuadPart = static_cast<LONGLONG>(size);
+		SetFilePointerEx(file.file, end, nullptr, FILE_BEGIN);
+		SetEndOfFile(file.file);
+		CloseHandle(file.file);
+	}
+#else
+	if (file.fd >= 0) {
+		if (ftruncate(file.fd, static_cast<off_t>(size)) != 0) {
+			std::cout << "capture:\tfailed to trim the output file\n";
+		}
+		close(file.fd);
+	}
+#endif
+	file = CaptureFile();
+}
+
+// ---------------------------------------------------------------------------
+// capture
+
+struct CaptureSlot {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation allocation;
+	bool pending = false;       // a copy was recorded and has not been collected
+	bool converting = false;    // the worker still reads the buffer
+	uint64_t index = 0;         // position of the frame in the output
+};
+
+struct FrameCapture {
+	DeviceMemoryAllocator* allocator = nullptr;
+	std::string path;
+	CaptureFormat format = CaptureFormat::Raw;
+	VkFormat imageFormat = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent = {};
+	bool bgra = true;
+	VkDeviceSize readbackBytes = 0;   // one frame in a readback buffer
+	size_t frameBytes = 0;            // one frame in the output, Y4M frame header included
+	size_t headerBytes = 0;
+	std::vector<CaptureSlot> slots;   // one per frame in flight
+	CaptureFile file;
+
+	bool useWorker = false;
+	JobSystem worker;
+	std::mutex mutex;
+	std::condition_variable converted;
+
+	// statistics
+	uint64_t captured = 0;            // copies recorded
+	uint64_t written = 0;
+	uint64_t skipped = 0;             // frames with another extent than the capture
+	uint64_t workerStalls = 0;        // a slot was needed while the worker still converted it
+	std::atomic<uint64_t> writeMicros{ 0 };
+};
+
+bool isFrameCaptureActive(const FrameCapture& capture) {
+	return !capture.slots.empty();
+}
+
+bool isCaptureFormatSupported(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// the format follows the extension of path: .y4m converts, anything else is raw
+void initFrameCapture(FrameCapture& capture, DeviceMemoryAllocator& allocator, const std::string& path,
+	VkFormat imageFormat, VkExtent2D extent, uint32_t slotCount, bool useWorker)
+{
+	if (!isCaptureFormatSupported(imageFormat)) {
+		throw std::runtime_error("failed to start capture: unsupported image format!");
+	}
+	capture.allocator = &allocator;
+	capture.path = path;
+	capture.format = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0 ? CaptureFormat::Y4M : CaptureFormat::Raw;
+	capture.imageFormat = imageFormat;
+	capture.extent = extent;
+	capture.bgra = imageFormat == VK_FORMAT_B8G8R8A8_UNORM || imageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+	capture.readbackBytes = VkDeviceSize(extent.width) * extent.height * 4;
+
+	char header[64] = "";
+	if (capture.format == CaptureFormat::Y4M) {
+		size_t chroma = size_t((extent.width + 1) / 2) * ((extent.height + 1) / 2);
+		capture.frameBytes = 6 + size_t(extent.width) * extent.height + 2 * chroma; // "FRAME\n"
+		snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C420jpeg\n", extent.width, extent.height);
+	}
+	else {
+		capture.frameBytes = static_cast<size_t>(capture.readbackBytes);
+	}
+	capture.headerBytes = strlen(header);
+	if (!openCaptureFile(capture.file, path, capture.headerBytes + 16 * capture.frameBytes)) {
+		throw std::runtime_error("failed to open capture file " + path + "!");
+	}
+	memcpy(capture.file.data, header, capture.headerBytes);
+
+	capture.slots.resize(slotCount);
+	for (auto& slot : capture.slots) {
+		slot.buffer = createBuffer(allocator, capture.readbackBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::Readback, slot.allocation);
+	}
+	capture.useWorker = useWorker;
+	if (useWorker) {
+		startJobSystem(capture.worker, 1);
+	}
+}
+
+// Records the copy of image, which is in TRANSFER_SRC_OPTIMAL, into the readback buffer of
+// frame slot slot. Frames of another extent than the capture's are skipped.
+void recordFrameCapture(FrameCapture& capture, VkCommandBuffer cmd, uint32_t slotIndex, VkImage image, VkExtent2D extent) {
+	if (extent.width != capture.extent.width || extent.height != capture.extent.height) {
+		capture.skipped++;
+		return;
+	}
+	CaptureSlot& slot = capture.slots[slotIndex];
+	{
+		std::unique_lock<std::mutex> lock(capture.mutex);
+		if (slot.converting) {
+			capture.workerStalls++;
+			capture.converted.wait(lock, [&slot]() { return !slot.converting; });
+		}
+	}
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { extent.width, extent.height, 1 };
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+	// the fence wait alone does not make the copy visible to the host
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = slot.buffer;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	slot.pending = true;
+	slot.index = capture.captured++;
+}
+
+// 4:2:0 planes from 4-byte pixels; chroma is taken from the average of each 2x2 block
+void convertToY4M(const uint8_t* pixels, uint32_t width, uint32_t height, bool bgra, uint8_t* out) {
+	const int r = bgra ? 2 : 0;
+	const int b = bgra ? 0 : 2;
+	uint8_t* yPlane = out;
+	uint32_t chromaWidth = (width + 1) / 2;
+	uint32_t chromaHeight = (height + 1) / 2;
+	uint8_t* uPlane = yPlane + size_t(width) * height;
+	uint8_t* vPlane = uPlane + size_t(chromaWidth) * chromaHeight;
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t* row = pixels + size_t(y) * width * 4;
+		uint8_t* yRow = yPlane + size_t(y) * width;
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t* p = row + x * 4;
+			yRow[x] = static_cast<uint8_t>((77 * p[r] + 150 * p[1] + 29 * p[b] + 128) >> 8);
+		}
+	}
+	for (uint32_t cy = 0; cy < chromaHeight; cy++) {
+		uint32_t y0 = cy * 2;
+		uint32_t y1 = std::min(y0 + 1, height - 1);
+		for (uint32_t cx = 0; cx < chromaWidth; cx++) {
+			uint32_t x0 = cx * 2;
+			uint32_t x1 = std::min(x0 + 1, width - 1);
+			const uint8_t* q[4] = {
+				pixels + (size_t(y0) * width + x0) * 4, pixels + (size_t(y0) * width + x1) * 4,
+				pixels + (size_t(y1) * width + x0) * 4, pixels + (size_t(y1) * width + x1) * 4 };
+			int sr = 0, sg = 0, sb = 0;
+			for (const uint8_t* p : q) {
+				sr += p[r];
+				sg += p[1];
+				sb += p[b];
+			}
+			sr = (sr + 2) >> 2;
+			sg = (sg + 2) >> 2;
+			sb = (sb + 2) >> 2;
+			// pure blue / red round up to 256
+			uPlane[size_t(cy) * chromaWidth + cx] = static_cast<uint8_t>(std::min(255, (-43 * sr - 85 * sg + 128 * sb + 32768 + 128) >> 8));
+			vPlane[size_t(cy) * chromaWidth + cx] = static_cast<uint8_t>(std::min(255, (128 * sr - 107 * sg - 21 * sb + 32768 + 128) >> 8));
+		}
+	}
+}
+
+void writeCaptureFrame(FrameCapture& capture, const uint8_t* pixels, uint8_t* out) {
+	auto start = std::chrono::steady_clock::now();
+	if (capture.format == CaptureFormat::Y4M) {
+		memcpy(out, "FRAME\n", 6);
+		convertToY4M(pixels, capture.extent.width, capture.extent.height, capture.bgra, out + 6);
+	}
+	else {
+		memcpy(out, pixels, capture.frameBytes);
+	}
+	capture.writeMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Call after the fence of frame slot slotIndex has signaled: writes the frame copied there
+// the last time the slot was used, inline or on the worker.
+void collectFrameCapture(FrameCapture& capture, uint32_t slotIndex) {
+	CaptureSlot& slot = capture.slots[slotIndex];
+	if (!slot.pending) {
+		return;
+	}
+	slot.pending = false;
+	size_t end = capture.headerBytes + size_t(slot.index + 1) * capture.frameBytes;
+	if (end > capture.file.capacity) {
+		// the worker writes through the mapping, so it has to be idle while the file is remapped
+		if (capture.useWorker) {
+			waitJobs(capture.worker);
+		}
+		if (!growCaptureFile(capture.file, std::max(end, capture.file.capacity * 2))) {
+			throw std::runtime_error("failed to grow capture file " + capture.path + "!");
+		}
+	}
+	invalidateAllocation(*capture.allocator, slot.allocation);
+	const uint8_t* pixels = static_cast<const uint8_t*>(slot.allocation.mapped);
+	uint8_t* out = capture.file.data + capture.headerBytes + size_t(slot.index) * capture.frameBytes;
+	capture.written++;
+	if (!capture.useWorker) {
+		writeCaptureFrame(capture, pixels, out);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(capture.mutex);
+		slot.converting = true;
+	}
+	FrameCapture* c = &capture;
+	CaptureSlot* s = &slot;
+	submitJob(capture.worker, [c, s, pixels, out](uint32_t) {
+		writeCaptureFrame(*c, pixels, out);
+		std::lock_guard<std::mutex> lock(c->mutex);
+		s->converting = false;
+		c->converted.notify_all();
+	});
+}
+
+// call once the device is idle; writes the frames still in the readback buffers and trims the file
+void finishFrameCapture(FrameCapture& capture) {
+	if (!isFrameCaptureActive(capture)) {
+		return;
+	}
+	std::vector<uint32_t> pending;
+	for (uint32_t i = 0; i < capture.slots.size(); i++) {
+		if (capture.slots[i].pending) {
+			pending.push_back(i);
+		}
+	}
+	std::sort(pending.begin(), pending.end(), [&capture](uint32_t a, uint32_t b) {
+		return capture.slots[a].index < capture.slots[b].index;
+	});
+	for (uint32_t i : pending) {
+		collectFrameCapture(capture, i);
+	}
+	if (capture.useWorker) {
+		waitJobs(capture.worker);
+	}
+	closeCaptureFile(capture.file, capture.headerBytes + size_t(capture.written) * capture.frameBytes);
+}
+
+void dumpFrameCaptureStats(const FrameCapture& capture) {
+	if (!isFrameCaptureActive(capture)) {
+		return;
+	}
+	const char* pixelFormat = capture.format == CaptureFormat::Y4M ? "y4m 420jpeg" : (capture.bgra ? "raw bgra" : "raw rgba");
+	std::cout << "capture:\t" << capture.written << " frames " << capture.extent.width << "x" << capture.extent.height << " "
+		<< pixelFormat << " to " << capture.path << " (" << (capture.headerBytes + capture.written * capture.frameBytes) / (1024 * 1024)
+		<< " MiB), " << capture.skipped << " skipped, " << capture.writeMicros / 1000.0 << " ms writing"
+		<< (capture.useWorker ? " on the worker, " + std::to_string(capture.workerStalls) + " stalls" : std::string()) << "\n";
+}
+
+void destroyFrameCapture(FrameCapture& capture) {
+	if (capture.useWorker) {
+		stopJobSystem(capture.worker);
+	}
+	for (auto& slot : capture.slots) {
+		destroyBuffer(*capture.allocator, slot.buffer, slot.allocation);
+	}
+	capture.slots.clear();
+}
@@ -0,0 +1,346 @@
+#pragma once
+
+// GPU/CPU frame profiler.
+// Every frame in flight owns a timestamp VkQueryPool split into one range per profiled queue;
+// the first profiled command buffer of a queue resets its range, and named scopes write a
+// timestamp pair around a pass. Results are read back without waiting once the frame's fence
+// has signaled, converted with timestampPeriod and appended to a CPU/GPU timeline that can be
+// written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+
+#include "vk_dispatch.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_allocator.h"
+
+static const uint32_t kProfilerNoScope = UINT32_MAX;
+static const size_t kProfilerMaxEvents = 1 << 20;
+
+struct ProfilerQueue {
+	const char* name = nullptr;
+	uint32_t familyIndex = 0;
+	uint64_t validMask = 0;     // from timestampValidBits; 0 means the family has no timestamps
+};
+
+struct GpuScope {
+	const char* name;
+	uint32_t queue;
+	uint32_t beginQuery;
+	uint32_t endQuery;
+};
+
+struct CpuScope {
+	const char* name;
+	double beginUs;
+	double endUs;
+};
+
+struct ProfilerFrame {
+	VkQueryPool pool = VK_NULL_HANDLE;
+	std::vector<uint32_t> used;       // queries written per queue range
+	std::vector<GpuScope> gpuScopes;
+	std::vector<CpuScope> cpuScopes;
+	uint64_t frameNumber = 0;
+	bool submitted = false;
+};
+
+struct TraceEvent {
+	const char* name;
+	uint32_t track;             // 0: CPU, 1 + queue: GPU queue
+	double beginUs;
+	double durationUs;
+	uint64_t frameNumber;
+};
+
+struct ScopeTotals {
+	double totalUs = 0.0;
+	double maxUs = 0.0;
+	uint64_t count = 0;
+};
+
+struct GpuProfiler {
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<VkQueueFamilyProperties> queueFamilies;
+	double timestampPeriod = 1.0;       // nanoseconds per tick
+	uint32_t queriesPerQueue = 0;
+	std::vector<ProfilerQueue> queues;
+	std::vector<ProfilerFrame> frames;
+	uint32_t current = 0;
+	std::chrono::steady_clock::time_point origin;
+	double gpuToCpuUs = 0.0;            // added to GPU microseconds to land on the CPU timeline
+	std::vector<TraceEvent> events;
+	std::map<std::string, ScopeTotals> totals;
+	std::set<std::string> names;        // scope names owned by the profiler, see profilerScopeName
+	uint64_t droppedFrames = 0;         // results that were not available yet
+};
+
+inline double profilerNowUs(const GpuProfiler& profiler) {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - profiler.origin).count();
+}
+
+// properties and queueFamilies come from the device capability snapshot
+void initGpuProfiler(GpuProfiler& profiler, const VkPhysicalDeviceProperties& properties,
+	const std::vector<VkQueueFamilyProperties>& queueFamilies, VkDevice dev)
+{
+	profiler.device = dev;
+	profiler.queueFamilies = queueFamilies;
+	profiler.origin = std::chrono::steady_clock::now();
+	profiler.timestampPeriod = properties.limits.timestampPeriod;
+}
+
+// queues are registered before createGpuProfilerFrames; returns the queue id used by scopes
+uint32_t addProfilerQueue(GpuProfiler& profiler, const char* name, uint32_t familyIndex) {
+	ProfilerQueue queue;
+	queue.name = name;
+	queue.familyIndex = familyIndex;
+	uint32_t bits = profiler.queueFamilies[familyIndex].timestampValidBits;
+	queue.validMask = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+	profiler.queues.push_back(queue);
+	return static_cast<uint32_t>(profiler.queues.size() - 1);
+}
+
+void createGpuProfilerFrames(GpuProfiler& profiler, uint32_t framesInFlight, uint32_t queriesPerQueue) {
+	profiler.queriesPerQueue = queriesPerQueue;
+	profiler.frames.resize(framesInFlight);
+	for (auto& frame : profiler.frames) {
+		VkQueryPoolCreateInfo pool_ci = {};
+		pool_ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		pool_ci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		pool_ci.queryCount = queriesPerQueue * static_cast<uint32_t>(profiler.queues.size());
+		if (vkCreateQueryPool(profiler.device, &pool_ci, hostAllocationCallbacks(), &frame.pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+		frame.used.assign(profiler.queues.size(), 0);
+	}
+	profiler.current = 0;
+}
+
+// Estimates the offset between the GPU and CPU clocks by writing one timestamp on queue and
+// taking the CPU time when its fence signals. Runs once at startup, not per frame.
+void calibrateGpuProfiler(GpuProfiler& profiler, uint32_t queueId, VkQueue queue) {
+	if (profiler.queues[queueId].validMask == 0) {
+		return;
+	}
+	VkDevice dev = profiler.device;
+	VkCommandPoolCreateInfo pool_ci = {};
+	pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	pool_ci.queueFamilyIndex = profiler.queues[queueId].familyIndex;
+	VkCommandPool commandPool;
+	VkQueryPoolCreateInfo query_ci = {};
+	query_ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_ci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_ci.queryCount = 1;
+	VkQueryPool queryPool;
+	VkFenceCreateInfo fence_ci = {};
+	fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	if (vkCreateCommandPool(dev, &pool_ci, hostAllocationCallbacks(), &commandPool) != VK_SUCCESS ||
+		vkCreateQueryPool(dev, &query_ci, hostAllocationCallbacks(), &queryPool) != VK_SUCCESS ||
+		vkCreateFence(dev, &fence_ci, hostAllocationCallbacks(), &fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create profiler calibration objects!");
+	}
+	VkCommandBufferAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = commandPool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	vkAllocateCommandBuffers(dev, &alloc_info, &cmd);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &begin_info);
+	vkCmdResetQueryPool(cmd, queryPool, 0, 1);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+	vkEndCommandBuffer(cmd);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+	vkQueueSubmit(queue, 1, &submit_info, fence);
+	vkWaitForFences(dev, 1, &fence, VK_TRUE, UINT64_MAX);
+	double cpuUs = profilerNowUs(profiler);
+
+	uint64_t ticks = 0;
+	if (vkGetQueryPoolResults(dev, queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+		double gpuUs = double(ticks & profiler.queues[queueId].validMask) * profiler.timestampPeriod / 1000.0;
+		profiler.gpuToCpuUs = cpuUs - gpuUs;
+	}
+	vkDestroyFence(dev, fence, hostAllocationCallbacks());
+	vkDestroyQueryPool(dev, queryPool, hostAllocationCallbacks());
+	vkDestroyCommandPool(dev, commandPool, hostAllocationCallbacks());
+}
+
+void addProfilerEvent(GpuProfiler& profiler, const char* name, uint32_t track, double beginUs, double durationUs, uint64_t frameNumber) {
+	ScopeTotals& totals = profiler.totals[std::string(track ? profiler.queues[track - 1].name : "cpu") + "/" + name];
+	totals.totalUs += durationUs;
+	totals.maxUs = std::max(totals.maxUs, durationUs);
+	totals.count++;
+	if (profiler.events.size() < kProfilerMaxEvents) {
+		profiler.events.push_back({ name, track, beginUs, durationUs, frameNumber });
+	}
+}
+
+// reads back the previous use of the slot; its fence must have signaled
+void resolveProfilerFrame(GpuProfiler& profiler, ProfilerFrame& frame) {
+	if (!frame.submitted) {
+		return;
+	}
+	frame.submitted = false;
+	for (const auto& scope : frame.cpuScopes) {
+		addProfilerEvent(profiler, scope.name, 0, scope.beginUs, scope.endUs - scope.beginUs, frame.frameNumber);
+	}
+
+	std::vector<uint64_t> ticks(profiler.queriesPerQueue * profiler.queues.size(), 0);
+	for (uint32_t q = 0; q < profiler.queues.size(); q++) {
+		uint32_t first = q * profiler.queriesPerQueue;
+		if (frame.used[q] == 0) {
+			continue;
+		}
+		VkResult result = vkGetQueryPoolResults(profiler.device, frame.pool, first, frame.used[q], frame.used[q] * sizeof(uint64_t),
+			&ticks[first], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			profiler.droppedFrames++;
+			return;
+		}
+	}
+	for (const auto& scope : frame.gpuScopes) {
+		uint64_t mask = profiler.queues[scope.queue].validMask;
+		uint64_t begin = ticks[scope.beginQuery] & mask;
+		uint64_t end = ticks[scope.endQuery] & mask;
+		double beginUs = double(begin) * profiler.timestampPeriod / 1000.0 + profiler.gpuToCpuUs;
+		double durationUs = double((end - begin) & mask) * profiler.timestampPeriod / 1000.0;
+		addProfilerEvent(profiler, scope.name, 1 + scope.queue, beginUs, durationUs, frame.frameNumber);
+	}
+}
+
+// call after the fence of frameIndex has signaled
+void beginProfilerFrame(GpuProfiler& profiler, uint32_t frameIndex, uint64_t frameNumber) {
+	profiler.current = frameIndex;
+	ProfilerFrame& frame = profiler.frames[frameIndex];
+	resolveProfilerFrame(profiler, frame);
+	std::fill(frame.used.begin(), frame.used.end(), 0);
+	frame.gpuScopes.clear();
+	frame.cpuScopes.clear();
+	frame.frameNumber = frameNumber;
+}
+
+// once per queue and frame, in the first command buffer that queue executes for the frame,
+// outside of a render pass
+void beginProfilerCommandBuffer(GpuProfiler& profiler, VkCommandBuffer cmd, uint32_t queueId) {
+	if (profiler.queues[queueId].validMask == 0) {
+		return;
+	}
+	ProfilerFrame& frame = profiler.frames[profiler.current];
+	vkCmdResetQueryPool(cmd, frame.pool, queueId * profiler.queriesPerQueue, profiler.queriesPerQueue);
+}
+
+// Scope names are kept by pointer until the trace is written; names that do not outlive the
+// profiler (e.g. render graph passes, rebuilt on resize) are copied here once.
+const char* profilerScopeName(GpuProfiler& profiler, const std::string& name) {
+	return profiler.names.insert(name).first->c_str();
+}
+
+uint32_t beginGpuScope(GpuProfiler& profiler, VkCommandBuffer cmd, uint32_t queueId, const char* name) {
+	ProfilerFrame& frame = profiler.frames[profiler.current];
+	if (profiler.queues[queueId].validMask == 0 || frame.used[queueId] + 2 > profiler.queriesPerQueue) {
+		return kProfilerNoScope;
+	}
+	uint32_t query = queueId * profiler.queriesPerQueue + frame.used[queueId];
+	frame.used[queueId] += 2;
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.pool, query);
+	frame.gpuScopes.push_back({ name, queueId, query, query + 1 });
+	return static_cast<uint32_t>(frame.gpuScopes.size() - 1);
+}
+
+void endGpuScope(GpuProfiler& profiler, VkCommandBuffer cmd, uint32_t scope) {
+	if (scope == kProfilerNoScope) {
+		return;
+	}
+	ProfilerFrame& frame = profiler.frames[profiler.current];
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.pool, frame.gpuScopes[scope].endQuery);
+}
+
+uint32_t beginCpuScope(GpuProfiler& profiler, const char* name) {
+	ProfilerFrame& frame = profiler.frames[profiler.current];
+	double now = profilerNowUs(profiler);
+	frame.cpuScopes.push_back({ name, now, now });
+	return static_cast<uint32_t>(frame.cpuScopes.size() - 1);
+}
+
+void endCpuScope(GpuProfiler& profiler, uint32_t scope) {
+	profiler.frames[profiler.current].cpuScopes[scope].endUs = profilerNowUs(profiler);
+}
+
+// for work measured before beginProfilerFrame, such as the wait for the frame's own fence
+void addCpuScope(GpuProfiler& profiler, const char* name, double beginUs, double endUs) {
+	profiler.frames[profiler.current].cpuScopes.push_back({ name, beginUs, endUs });
+}
+
+// after the frame's last submit
+void endProfilerFrame(GpuProfiler& profiler) {
+	profiler.frames[profiler.current].submitted = true;
+}
+
+// resolves what is still pending; the device has to be idle
+void flushGpuProfiler(GpuProfiler& profiler) {
+	for (auto& frame : profiler.frames) {
+		resolveProfilerFrame(profiler, frame);
+	}
+}
+
+void dumpGpuProfilerStats(const GpuProfiler& profiler) {
+	if (profiler.totals.empty()) {
+		return;
+	}
+	std::cout << "profile:\n  scope\t\t\tavg(ms)\t\tmax(ms)\t\tcount\n";
+	for (const auto& entry : profiler.totals) {
+		char line[160];
+		snprintf(line, sizeof(line), "  %-22s %-15.4f %-15.4f %llu\n", entry.first.c_str(),
+			entry.second.totalUs / 1000.0 / double(entry.second.count), entry.second.maxUs / 1000.0,
+			(unsigned long long)entry.second.count);
+		std::cout << line;
+	}
+	if (profiler.droppedFrames) {
+		std::cout << "  " << profiler.droppedFrames << " frames without GPU results\n";
+	}
+}
+
+// Chrome trace event format: complete ("X") events in microseconds, one track per queue
+bool writeChromeTrace(const GpuProfiler& profiler, const std::string& path) {
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"CPU\"}}");
+	for (uint32_t q = 0; q < profiler.queues.size(); q++) {
+		fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU %s\"}}",
+			q + 1, profiler.queues[q].name);
+	}
+	for (const auto& event : profiler.events) {
+		fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+			event.name, event.track ? "gpu" : "cpu", event.track, event.beginUs, event.durationUs, (unsigned long long)event.frameNumber);
+	}
+	fprintf(fp, "\n]}\n");
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
+
+void destroyGpuProfiler(GpuProfiler& profiler) {
+	for (auto& frame : profiler.frames) {
+		vkDestroyQueryPool(profiler.device, frame.pool, hostAllocationCallbacks());
+	}
+	profiler.frames.clear();
+}
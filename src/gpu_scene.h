@@ -0,0 +1,438 @@
+#pragma once
+
+// GPU-driven scene.
+// The objects live in a device-local storage buffer and are culled on the GPU every frame:
+// cull.comp drops the objects outside the view and those smaller than a pixel, and writes one
+// VkDrawIndexedIndirectCommand per chunk of kObjectChunkSize objects that share a mesh,
+// instanced over the chunk's visible objects. The scene pass then draws every chunk with
+// one call, so recording a frame costs the same for a thousand objects as for a million:
+//  - IndirectCount: vkCmdDrawIndexedIndirectCountKHR over the compacted non-empty commands,
+//    when maxDrawIndirectCount covers every chunk
+//  - MultiDrawIndirect: one vkCmdDrawIndexedIndirect over all chunks, empty ones draw nothing
+//  - Indirect: one vkCmdDrawIndexedIndirect per chunk, without the multiDrawIndirect feature
+// The CPU path culls on the CPU and records one vkCmdDrawIndexed per visible object instead;
+// it is the baseline of --objects-bench.
+// The first cull dispatch seeds the objects, the same way particles.comp seeds the particles.
+
+#include "vk_dispatch.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "compute_queue.h"
+#include "debug_utils.h"
+#include "descriptor_allocator.h"
+#include "memory_allocator.h"
+#include "spirv_reflect.h"
+#include "upload_queue.h"
+
+static const uint32_t kObjectChunkSize = 64;  // local size of cull.comp
+
+enum class ObjectDrawPath {
+	IndirectCount,
+	MultiDrawIndirect,
+	Indirect,
+	CpuDraws,
+};
+
+struct SceneObject {    // cull.comp, objects.vert
+	float position[2];  // in grid cells
+	float scale;
+	float angle;
+};
+
+struct ObjectMesh {     // cull.comp
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	float radius;       // bounding circle before scaling
+};
+
+struct ObjectVertex {
+	float position[2];
+	float color[3];
+};
+
+struct ObjectCull {     // cull.comp push constants
+	float center[2];
+	float zoom;
+	float aspect;
+	uint32_t count;
+	uint32_t side;
+	uint32_t meshCount;
+	float minRadius;
+	uint32_t flags;
+};
+
+struct ObjectView {     // objects.vert push constants
+	float center[2];
+	float zoom;
+	float aspect;
+	uint32_t direct;
+};
+
+static const uint32_t kCullSeed = 1;
+static const uint32_t kCullCompact = 2;
+
+struct GpuSceneReadback {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation allocation;
+	bool pending = false;
+};
+
+struct GpuScene {
+	DeviceMemoryAllocator* allocator = nullptr;
+	uint32_t count = 0;
+	uint32_t chunkCount = 0;
+	uint32_t side = 0;                      // objects per grid row
+	ObjectDrawPath path = ObjectDrawPath::Indirect;
+	ObjectDrawPath gpuPath = ObjectDrawPath::Indirect;  // best indirect path of the device
+	uint32_t maxDrawIndirectCount = 1;
+
+	std::vector<ObjectMesh> meshes;
+	std::vector<SceneObject> cpuObjects;    // what the seed dispatch writes, for the CPU path
+	VkBuffer objects = VK_NULL_HANDLE;
+	VkBuffer meshBuffer = VK_NULL_HANDLE;
+	VkBuffer vertices = VK_NULL_HANDLE;
+	VkBuffer indices = VK_NULL_HANDLE;
+	VkBuffer commands = VK_NULL_HANDLE;     // one per chunk
+	VkBuffer visible = VK_NULL_HANDLE;      // kObjectChunkSize object indices per chunk
+	VkBuffer counts = VK_NULL_HANDLE;       // draw count, visible objects
+	MemoryAllocation allocations[7];
+	std::vector<GpuSceneReadback> readback; // counts of each frame slot
+	bool seeded = false;
+	bool culled = false;                    // a cull was recorded since the last stats copy
+	uint64_t frame = 0;                     // drives the camera
+	ObjectCull view = {};                   // of the frame being recorded
+
+	// pipelines, created by the caller against the scene pass
+	ComputePipeline cull;
+	ReflectedLayout layout;                 // objects.vert + triangle.frag, owned by the layout cache
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	// statistics
+	uint64_t frames = 0;
+	uint64_t visibleObjects = 0;
+	uint64_t draws = 0;                     // non-empty chunks, or vkCmdDrawIndexed calls on the CPU path
+	uint64_t drawCalls = 0;                 // calls recorded by the CPU
+	uint32_t lastVisible = 0;
+	uint32_t lastDraws = 0;
+};
+
+bool isGpuSceneActive(const GpuScene& scene) {
+	return scene.count > 0;
+}
+
+const char* objectDrawPathName(ObjectDrawPath path) {
+	switch (path) {
+	case ObjectDrawPath::IndirectCount: return "indirect count";
+	case ObjectDrawPath::MultiDrawIndirect: return "multi-draw indirect";
+	case ObjectDrawPath::Indirect: return "indirect";
+	case ObjectDrawPath::CpuDraws: return "cpu draws";
+	}
+	return "?";
+}
+
+float objectHash(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return static_cast<float>(x) / 4294967295.0f;
+}
+
+// one object per grid cell, jittered; seedObject in cull.comp does the same
+SceneObject seedSceneObject(uint32_t i, uint32_t side) {
+	SceneObject o;
+	o.position[0] = static_cast<float>(i % side) + 0.5f + (objectHash(i * 4) - 0.5f) * 0.2f;
+	o.position[1] = static_cast<float>(i / side) + 0.5f + (objectHash(i * 4 + 1) - 0.5f) * 0.2f;
+	o.scale = 0.15f + 0.2f * objectHash(i * 4 + 2);
+	o.angle = objectHash(i * 4 + 3) * 6.2831853f;
+	return o;
+}
+
+// a triangle, a quad and a hexagon as fans around their center, in one vertex and index buffer
+void buildObjectMeshes(std::vector<ObjectVertex>& vertices, std::vector<uint16_t>& indices, std::vector<ObjectMesh>& meshes) {
+	const uint32_t sides[] = { 3, 4, 6 };
+	const float colors[][3] = { { 1.0f, 0.4f, 0.2f }, { 0.2f, 0.8f, 0.4f }, { 0.3f, 0.5f, 1.0f } };
+	for (uint32_t m = 0; m < 3; m++) {
+		ObjectMesh mesh;
+		mesh.indexCount = sides[m] * 3;
+		mesh.firstIndex = static_cast<uint32_t>(indices.size());
+		mesh.vertexOffset = static_cast<int32_t>(vertices.size());
+		mesh.radius = 1.0f;
+		vertices.push_back({ { 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } });
+		for (uint32_t i = 0; i < sides[m]; i++) {
+			float a = 6.2831853f * i / sides[m];
+			vertices.push_back({ { std::cos(a), std::sin(a) }, { colors[m][0], colors[m][1], colors[m][2] } });
+			indices.push_back(0);
+			indices.push_back(static_cast<uint16_t>(1 + i));
+			indices.push_back(static_cast<uint16_t>(1 + (i + 1) % sides[m]));
+		}
+		meshes.push_back(mesh);
+	}
+}
+
+// Creates the buffers of count objects and queues the mesh upload; the objects themselves are
+// written by the first cull dispatch. The pipelines are left to the caller.
+void initGpuScene(GpuScene& scene, DeviceMemoryAllocator& allocator, UploadQueue& uploads, const VkPhysicalDeviceLimits& limits,
+	uint32_t count, uint32_t framesInFlight, ObjectDrawPath gpuPath, bool cpuDraws)
+{
+	uint32_t chunkCount = (count + kObjectChunkSize - 1) / kObjectChunkSize;
+	if (count == 0 || chunkCount > limits.maxComputeWorkGroupCount[0]) {
+		throw std::runtime_error("failed to create scene: unsupported object count!");
+	}
+	scene.allocator = &allocator;
+	scene.count = count;
+	scene.chunkCount = chunkCount;
+	scene.side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+	scene.maxDrawIndirectCount = std::max(1u, limits.maxDrawIndirectCount);
+	// the compacted commands cannot be split into several count draws, one has to cover them all
+	if (gpuPath == ObjectDrawPath::IndirectCount && chunkCount > scene.maxDrawIndirectCount) {
+		gpuPath = ObjectDrawPath::MultiDrawIndirect;
+	}
+	scene.gpuPath = gpuPath;
+	scene.path = cpuDraws ? ObjectDrawPath::CpuDraws : gpuPath;
+	scene.seeded = false;
+	scene.culled = false;
+	scene.frame = 0;
+
+	std::vector<ObjectVertex> vertices;
+	std::vector<uint16_t> indices;
+	scene.meshes.clear();
+	buildObjectMeshes(vertices, indices, scene.meshes);
+	scene.cpuObjects.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		scene.cpuObjects[i] = seedSceneObject(i, scene.side);
+	}
+
+	VkDeviceSize meshBytes = scene.meshes.size() * sizeof(ObjectMesh);
+	VkDeviceSize vertexBytes = vertices.size() * sizeof(ObjectVertex);
+	VkDeviceSize indexBytes = indices.size() * sizeof(uint16_t);
+	scene.objects = createBuffer(allocator, VkDeviceSize(count) * sizeof(SceneObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		MemoryUsage::GpuOnly, scene.allocations[0]);
+	scene.meshBuffer = createBuffer(allocator, meshBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		MemoryUsage::GpuOnly, scene.allocations[1]);
+	scene.vertices = createBuffer(allocator, vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		MemoryUsage::GpuOnly, scene.allocations[2]);
+	scene.indices = createBuffer(allocator, indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		MemoryUsage::GpuOnly, scene.allocations[3]);
+	scene.commands = createBuffer(allocator, VkDeviceSize(chunkCount) * sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly, scene.allocations[4]);
+	scene.visible = createBuffer(allocator, VkDeviceSize(chunkCount) * kObjectChunkSize * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, scene.allocations[5]);
+	scene.counts = createBuffer(allocator, 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, scene.allocations[6]);
+	setObjectName(allocator.device, VK_OBJECT_TYPE_BUFFER, scene.objects, "objects");
+	setObjectName(allocator.device, VK_OBJECT_TYPE_BUFFER, scene.commands, "draw commands");
+	setObjectName(allocator.device, VK_OBJECT_TYPE_BUFFER, scene.visible, "visible objects");
+	setObjectName(allocator.device, VK_OBJECT_TYPE_BUFFER, scene.counts, "draw counts");
+	scene.readback.resize(framesInFlight);
+	for (auto& slot : scene.readback) {
+		slot.buffer = createBuffer(allocator, 2 * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::Readback, slot.allocation);
+		slot.pending = false;
+	}
+
+	uploadBuffer(uploads, scene.meshBuffer, 0, scene.meshes.data(), meshBytes, VK_ACCESS_SHADER_READ_BIT);
+	uploadBuffer(uploads, scene.vertices, 0, vertices.data(), vertexBytes, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	uploadBuffer(uploads, scene.indices, 0, indices.data(), indexBytes, VK_ACCESS_INDEX_READ_BIT);
+	flushUploads(uploads);
+}
+
+// GPU paths only; the CPU path of the same scene is kept as the baseline
+void setGpuSceneCpuDraws(GpuScene& scene, bool cpuDraws) {
+	scene.path = cpuDraws ? ObjectDrawPath::CpuDraws : scene.gpuPath;
+	scene.frame = 0;
+}
+
+// Camera of the next frame: circles around the grid while zooming between a few cells and
+// the whole grid, so both culling tests have work to do.
+void updateGpuSceneView(GpuScene& scene, VkExtent2D extent) {
+	float t = static_cast<float>(scene.frame++) / 60.0f;
+	float side = static_cast<float>(scene.side);
+	float nearHalf = std::min(4.0f, side * 0.5f);
+	float halfHeight = nearHalf + (side * 0.6f - nearHalf) * (0.5f + 0.5f * std::sin(t * 0.5f));
+	ObjectCull& v = scene.view;
+	v.center[0] = side * (0.5f + 0.25f * std::cos(t * 0.2f));
+	v.center[1] = side * (0.5f + 0.25f * std::sin(t * 0.2f));
+	v.zoom = 1.0f / halfHeight;
+	v.aspect = static_cast<float>(extent.height) / static_cast<float>(std::max(extent.width, 1u));
+	v.count = scene.count;
+	v.side = scene.side;
+	v.meshCount = static_cast<uint32_t>(scene.meshes.size());
+	v.minRadius = 1.0f / static_cast<float>(std::max(extent.height, 1u));
+	v.flags = (scene.seeded ? 0 : kCullSeed) | (scene.path == ObjectDrawPath::IndirectCount ? kCullCompact : 0);
+}
+
+// the cull pass starts from zero counts
+void recordGpuSceneReset(GpuScene& scene, VkCommandBuffer cmd) {
+	vkCmdFillBuffer(cmd, scene.counts, 0, VK_WHOLE_SIZE, 0);
+}
+
+void recordGpuSceneCull(GpuScene& scene, DescriptorAllocator& descriptors, VkCommandBuffer cmd, uint32_t frameIndex) {
+	if (scene.path == ObjectDrawPath::CpuDraws && scene.seeded) {
+		return; // culled on the CPU
+	}
+	VkDescriptorSet set = allocateFrameDescriptorSet(descriptors, frameIndex, scene.cull.setLayout, {
+		bufferDescriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, scene.objects, 0, VK_WHOLE_SIZE),
+		bufferDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, scene.meshBuffer, 0, VK_WHOLE_SIZE),
+		bufferDescriptor(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, scene.commands, 0, VK_WHOLE_SIZE),
+		bufferDescriptor(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, scene.visible, 0, VK_WHOLE_SIZE),
+		bufferDescriptor(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, scene.counts, 0, VK_WHOLE_SIZE) });
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, scene.cull.pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, scene.cull.layout, 0, 1, &set, 0, nullptr);
+	vkCmdPushConstants(cmd, scene.cull.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ObjectCull), &scene.view);
+	vkCmdDispatch(cmd, scene.chunkCount, 1, 1);
+	scene.seeded = true;
+	scene.culled = true;
+}
+
+// the culling of cull.comp, one draw per visible object
+void recordGpuSceneCpuDraws(GpuScene& scene, VkCommandBuffer cmd) {
+	const ObjectCull& v = scene.view;
+	uint32_t visible = 0;
+	for (uint32_t i = 0; i < scene.count; i++) {
+		const SceneObject& o = scene.cpuObjects[i];
+		const ObjectMesh& mesh = scene.meshes[(i / kObjectChunkSize) % scene.meshes.size()];
+		float x = (o.position[0] - v.center[0]) * v.zoom * v.aspect;
+		float y = (o.position[1] - v.center[1]) * v.zoom;
+		float radius = mesh.radius * o.scale * v.zoom;
+		if (std::fabs(x) - radius * v.aspect <= 1.0f && std::fabs(y) - radius <= 1.0f && radius >= v.minRadius) {
+			vkCmdDrawIndexed(cmd, mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, i);
+			visible++;
+		}
+	}
+	scene.frames++;
+	scene.visibleObjects += visible;
+	scene.draws += visible;
+	scene.drawCalls += visible;
+	scene.lastVisible = visible;
+	scene.lastDraws = visible;
+}
+
+// inside the scene pass; viewport and scissor are set by the caller
+void recordGpuSceneDraws(GpuScene& scene, DescriptorAllocator& descriptors, VkCommandBuffer cmd, uint32_t frameIndex) {
+	VkDescriptorSet set = allocateFrameDescriptorSet(descriptors, frameIndex, scene.layout.setLayouts[0], {
+		bufferDescriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, scene.objects, 0, VK_WHOLE_SIZE),
+		bufferDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, scene.visible, 0, VK_WHOLE_SIZE) });
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.layout.layout, 0, 1, &set, 0, nullptr);
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &scene.vertices, &offset);
+	vkCmdBindIndexBuffer(cmd, scene.indices, 0, VK_INDEX_TYPE_UINT16);
+	ObjectView view = { { scene.view.center[0], scene.view.center[1] }, scene.view.zoom, scene.view.aspect,
+		scene.path == ObjectDrawPath::CpuDraws ? 1u : 0u };
+	vkCmdPushConstants(cmd, scene.layout.layout, scene.layout.pushConstantStages, 0, sizeof(view), &view);
+
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	switch (scene.path) {
+	case ObjectDrawPath::IndirectCount:
+		vkCmdDrawIndexedIndirectCountKHR(cmd, scene.commands, 0, scene.counts, 0,
+			std::min(scene.chunkCount, scene.maxDrawIndirectCount), stride);
+		scene.drawCalls++;
+		break;
+	case ObjectDrawPath::MultiDrawIndirect:
+		for (uint32_t first = 0; first < scene.chunkCount; first += scene.maxDrawIndirectCount) {
+			uint32_t drawCount = std::min(scene.maxDrawIndirectCount, scene.chunkCount - first);
+			vkCmdDrawIndexedIndirect(cmd, scene.commands, VkDeviceSize(first) * stride, drawCount, stride);
+			scene.drawCalls++;
+		}
+		break;
+	case ObjectDrawPath::Indirect:
+		for (uint32_t chunk = 0; chunk < scene.chunkCount; chunk++) {
+			vkCmdDrawIndexedIndirect(cmd, scene.commands, VkDeviceSize(chunk) * stride, 1, stride);
+		}
+		scene.drawCalls += scene.chunkCount;
+		break;
+	case ObjectDrawPath::CpuDraws:
+		recordGpuSceneCpuDraws(scene, cmd);
+		break;
+	}
+}
+
+// copies the counts of the frame into slot frameIndex's readback buffer; frames that recorded
+// no cull (pipelines still compiling) are left out of the statistics
+void recordGpuSceneStats(GpuScene& scene, VkCommandBuffer cmd, uint32_t frameIndex) {
+	if (scene.path == ObjectDrawPath::CpuDraws || !scene.culled) {
+		return;
+	}
+	scene.culled = false;
+	GpuSceneReadback& slot = scene.readback[frameIndex];
+	VkBufferCopy region = {};
+	region.size = 2 * sizeof(uint32_t);
+	vkCmdCopyBuffer(cmd, scene.counts, slot.buffer, 1, &region);
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = slot.buffer;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	slot.pending = true;
+}
+
+// call after the fence of frame slot frameIndex has signaled
+void collectGpuSceneStats(GpuScene& scene, uint32_t frameIndex) {
+	GpuSceneReadback& slot = scene.readback[frameIndex];
+	if (!slot.pending) {
+		return;
+	}
+	slot.pending = false;
+	invalidateAllocation(*scene.allocator, slot.allocation);
+	const uint32_t* counts = static_cast<const uint32_t*>(slot.allocation.mapped);
+	scene.lastDraws = counts[0];
+	scene.lastVisible = counts[1];
+	scene.frames++;
+	scene.draws += counts[0];
+	scene.visibleObjects += counts[1];
+}
+
+void resetGpuSceneStats(GpuScene& scene) {
+	for (auto& slot : scene.readback) {
+		slot.pending = false;
+	}
+	scene.frames = 0;
+	scene.visibleObjects = 0;
+	scene.draws = 0;
+	scene.drawCalls = 0;
+}
+
+void dumpGpuSceneStats(const GpuScene& scene) {
+	if (!isGpuSceneActive(scene) || scene.frames == 0) {
+		return;
+	}
+	std::cout << "objects:\t" << scene.count << " in " << scene.chunkCount << " chunks, " << objectDrawPathName(scene.path) << ", "
+		<< scene.visibleObjects / scene.frames << " visible and " << scene.draws / scene.frames << " draws per frame from "
+		<< static_cast<double>(scene.drawCalls) / scene.frames << " draw calls\n";
+}
+
+// the buffers; the pipelines stay for a scene of another size
+void destroyGpuSceneObjects(GpuScene& scene) {
+	if (!isGpuSceneActive(scene)) {
+		return;
+	}
+	DeviceMemoryAllocator& allocator = *scene.allocator;
+	VkBuffer buffers[7] = { scene.objects, scene.meshBuffer, scene.vertices, scene.indices, scene.commands, scene.visible, scene.counts };
+	for (int i = 0; i < 7; i++) {
+		destroyBuffer(allocator, buffers[i], scene.allocations[i]);
+	}
+	for (auto& slot : scene.readback) {
+		destroyBuffer(allocator, slot.buffer, slot.allocation);
+	}
+	scene.readback.clear();
+	scene.cpuObjects.clear();
+	scene.count = 0;
+}
+
+void destroyGpuScene(GpuScene& scene, VkDevice dev) {
+	destroyGpuSceneObjects(scene);
+	vkDestroyPipeline(dev, scene.pipeline, hostAllocationCallbacks());
+	destroyComputePipeline(dev, scene.cull);
+	scene = GpuScene();
+}
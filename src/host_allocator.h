@@ -0,0 +1,226 @@
+#pragma once
+
+// Instrumented VkAllocationCallbacks.
+// Counts driver host allocations per VkSystemAllocationScope and serves COMMAND scope
+// allocations (only valid for the duration of one Vulkan call) from a bump arena that is
+// reset at the start of every frame. Nothing is installed until enableHostAllocator()
+// is called; hostAllocationCallbacks() then returns nullptr and the driver uses its own.
+
+#include "vk_dispatch.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+static const uint32_t kHostScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+struct HostScopeStats {
+	std::atomic<uint64_t> allocations{ 0 };
+	std::atomic<uint64_t> reallocations{ 0 };
+	std::atomic<uint64_t> frees{ 0 };
+	std::atomic<uint64_t> totalBytes{ 0 };
+	std::atomic<int64_t> liveBytes{ 0 };
+	std::atomic<int64_t> peakBytes{ 0 };
+	std::atomic<int64_t> internalBytes{ 0 };  // pfnInternalAllocation (e.g. executable memory)
+};
+
+// placed in front of every pointer handed to the driver
+struct HostAllocationHeader {
+	size_t size;
+	size_t baseOffset;   // user pointer - malloc'd pointer; 0 for arena memory
+	uint32_t scope;
+	uint32_t fromArena;
+	uint64_t reserved;
+};
+
+struct HostAllocator {
+	VkAllocationCallbacks callbacks = {};
+	HostScopeStats scopes[kHostScopeCount];
+
+	// COMMAND scope arena
+	std::vector<uint8_t> arena;
+	std::atomic<size_t> arenaHead{ 0 };
+	size_t arenaHighWater = 0;
+	std::atomic<uint64_t> arenaAllocations{ 0 };
+	std::atomic<uint64_t> arenaOverflows{ 0 };
+
+	// allocations that went to malloc during the frame loop
+	std::atomic<uint64_t> mallocCalls{ 0 };
+	uint64_t frameStartMallocCalls = 0;
+	uint64_t frames = 0;
+	uint64_t frameMallocCalls = 0;
+	uint64_t maxFrameMallocCalls = 0;
+};
+
+// set on threads whose Vulkan calls may still be running when the frame loop resets the arena
+thread_local bool _hostArenaBypass = false;
+
+// keeps the COMMAND scope allocations of the current thread out of the arena while in scope
+struct HostArenaBypass {
+	bool previous;
+	HostArenaBypass() : previous(_hostArenaBypass) { _hostArenaBypass = true; }
+	~HostArenaBypass() { _hostArenaBypass = previous; }
+};
+
+inline HostAllocator*& hostAllocatorInstance() {
+	static HostAllocator* instance = nullptr;
+	return instance;
+}
+
+// pass this to every vkCreate*/vkDestroy*/vkAllocate*/vkFree*
+inline const VkAllocationCallbacks* hostAllocationCallbacks() {
+	HostAllocator* allocator = hostAllocatorInstance();
+	return allocator ? &allocator->callbacks : nullptr;
+}
+
+inline void hostTrackAllocation(HostAllocator& allocator, uint32_t scope, size_t size) {
+	HostScopeStats& s = allocator.scopes[scope];
+	s.allocations++;
+	s.totalBytes += size;
+	int64_t live = (s.liveBytes += static_cast<int64_t>(size));
+	int64_t peak = s.peakBytes.load();
+	while (live > peak && !s.peakBytes.compare_exchange_weak(peak, live)) {
+	}
+}
+
+void* VKAPI_CALL hostAllocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+	alignment = std::max(alignment, alignof(HostAllocationHeader));
+	hostTrackAllocation(allocator, scope, size);
+
+	if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && !allocator.arena.empty() && !_hostArenaBypass) {
+		size_t need = size + alignment + sizeof(HostAllocationHeader);
+		size_t begin = allocator.arenaHead.fetch_add(need);
+		if (begin + need <= allocator.arena.size()) {
+			uintptr_t base = reinterpret_cast<uintptr_t>(allocator.arena.data() + begin);
+			uintptr_t user = (base + sizeof(HostAllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			HostAllocationHeader* header = reinterpret_cast<HostAllocationHeader*>(user) - 1;
+			header->size = size;
+			header->baseOffset = 0;
+			header->scope = scope;
+			header->fromArena = 1;
+			allocator.arenaAllocations++;
+			return reinterpret_cast<void*>(user);
+		}
+		allocator.arenaOverflows++;
+	}
+
+	allocator.mallocCalls++;
+	uint8_t* base = static_cast<uint8_t*>(malloc(size + alignment + sizeof(HostAllocationHeader)));
+	if (!base) {
+		allocator.scopes[scope].liveBytes -= static_cast<int64_t>(size);
+		return nullptr;
+	}
+	uintptr_t user = (reinterpret_cast<uintptr_t>(base) + sizeof(HostAllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	HostAllocationHeader* header = reinterpret_cast<HostAllocationHeader*>(user) - 1;
+	header->size = size;
+	header->baseOffset = user - reinterpret_cast<uintptr_t>(base);
+	header->scope = scope;
+	header->fromArena = 0;
+	return reinterpret_cast<void*>(user);
+}
+
+void VKAPI_CALL hostFree(void* userData, void* memory) {
+	if (!memory) {
+		return;
+	}
+	HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+	HostAllocationHeader* header = static_cast<HostAllocationHeader*>(memory) - 1;
+	HostScopeStats& s = allocator.scopes[header->scope];
+	s.frees++;
+	s.liveBytes -= static_cast<int64_t>(header->size);
+	if (!header->fromArena) {
+		free(static_cast<uint8_t*>(memory) - header->baseOffset);
+	}
+}
+
+void* VKAPI_CALL hostReallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	if (!original) {
+		return hostAllocate(userData, size, alignment, scope);
+	}
+	if (size == 0) {
+		hostFree(userData, original);
+		return nullptr;
+	}
+	HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+	allocator.scopes[scope].reallocations++;
+	void* memory = hostAllocate(userData, size, alignment, scope);
+	if (memory) {
+		const HostAllocationHeader* header = static_cast<HostAllocationHeader*>(original) - 1;
+		memcpy(memory, original, std::min(size, header->size));
+		hostFree(userData, original);
+	}
+	return memory;
+}
+
+void VKAPI_CALL hostInternalAllocation(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+	static_cast<HostAllocator*>(userData)->scopes[scope].internalBytes += static_cast<int64_t>(size);
+}
+
+void VKAPI_CALL hostInternalFree(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+	static_cast<HostAllocator*>(userData)->scopes[scope].internalBytes -= static_cast<int64_t>(size);
+}
+
+// must be called before the instance is created; the same callbacks have to be used until it is destroyed
+void enableHostAllocator(size_t commandArenaSize) {
+	static HostAllocator allocator;
+	allocator.arena.resize(commandArenaSize);
+	allocator.callbacks.pUserData = &allocator;
+	allocator.callbacks.pfnAllocation = hostAllocate;
+	allocator.callbacks.pfnReallocation = hostReallocate;
+	allocator.callbacks.pfnFree = hostFree;
+	allocator.callbacks.pfnInternalAllocation = hostInternalAllocation;
+	allocator.callbacks.pfnInternalFree = hostInternalFree;
+	hostAllocatorInstance() = &allocator;
+}
+
+// Called once per frame by the thread that drives the frame loop, while no other thread
+// is inside a Vulkan call that uses the arena; COMMAND scope memory never outlives the call
+// that requested it. Threads that keep calling Vulkan across frames hold a HostArenaBypass.
+void beginHostAllocatorFrame() {
+	HostAllocator* allocator = hostAllocatorInstance();
+	if (!allocator) {
+		return;
+	}
+	allocator->arenaHighWater = std::max(allocator->arenaHighWater, std::min(allocator->arenaHead.load(), allocator->arena.size()));
+	allocator->arenaHead = 0;
+
+	uint64_t calls = allocator->mallocCalls.load();
+	if (allocator->frames > 0) {
+		uint64_t frameCalls = calls - allocator->frameStartMallocCalls;
+		allocator->frameMallocCalls += frameCalls;
+		allocator->maxFrameMallocCalls = std::max(allocator->maxFrameMallocCalls, frameCalls);
+	}
+	allocator->frameStartMallocCalls = calls;
+	allocator->frames++;
+}
+
+void dumpHostAllocatorStats() {
+	HostAllocator* allocator = hostAllocatorInstance();
+	if (!allocator) {
+		return;
+	}
+	static const char* scopeNames[kHostScopeCount] = { "command", "object", "cache", "device", "instance" };
+	std::cout << "host allocations:\n";
+	std::cout << "  scope     allocs    reallocs  frees     live(B)   peak(B)   total(B)  internal(B)\n";
+	for (uint32_t i = 0; i < kHostScopeCount; i++) {
+		const HostScopeStats& s = allocator->scopes[i];
+		char line[160];
+		snprintf(line, sizeof(line), "  %-9s %-9llu %-9llu %-9llu %-9lld %-9lld %-9llu %lld\n", scopeNames[i],
+			(unsigned long long)s.allocations.load(), (unsigned long long)s.reallocations.load(), (unsigned long long)s.frees.load(),
+			(long long)s.liveBytes.load(), (long long)s.peakBytes.load(), (unsigned long long)s.totalBytes.load(),
+			(long long)s.internalBytes.load());
+		std::cout << line;
+	}
+	std::cout << "  command arena:\t" << allocator->arenaAllocations << " allocations, high water "
+		<< std::max(allocator->arenaHighWater, std::min(allocator->arenaHead.load(), allocator->arena.size())) << " / " << allocator->arena.size()
+		<< " bytes, " << allocator->arenaOverflows << " overflows\n";
+	if (allocator->frames > 1) {
+		std::cout << "  malloc per frame:\t" << double(allocator->frameMallocCalls) / double(allocator->frames - 1)
+			<< " avg, " << allocator->maxFrameMallocCalls << " max\n";
+	}
+}
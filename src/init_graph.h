@@ -0,0 +1,260 @@
+#pragma once
+
+// Startup task graph.
+// vulkanInit declares its steps as tasks together with the tasks they depend on, and every
+// task starts as soon as its dependencies are done: worker tasks on a JobSystem, main thread
+// tasks (window system calls GLFW only allows there) on the thread inside runInitGraph.
+// runInitGraph returns once the foreground tasks are done. Background tasks (pipeline
+// compilation) keep running while the first frames are presented; poll them with
+// isInitTaskDone or block with waitInitTask. Without workers every task runs in order on
+// the main thread, background ones included.
+// Each task records when it ran so dumpInitGraphStats can report the critical path.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "job_system.h"
+
+enum class InitTaskKind {
+	Worker,       // any thread
+	MainThread,   // the thread that called runInitGraph
+	Background,   // any thread; runInitGraph does not wait for it
+};
+
+static const uint32_t kNoInitTask = ~0u;
+
+struct InitTask {
+	const char* name = "";
+	InitTaskKind kind = InitTaskKind::Worker;
+	std::function<void()> run;
+	std::vector<uint32_t> dependents;
+	uint32_t dependencyCount = 0;
+	uint32_t waiting = 0;                       // dependencies not done yet
+	uint32_t criticalDependency = kNoInitTask;  // the dependency that finished last
+	uint32_t thread = 0;                        // 0: main thread, otherwise worker + 1
+	bool done = false;
+	double startMs = 0.0;
+	double endMs = 0.0;
+};
+
+struct InitGraph {
+	std::vector<InitTask> tasks;
+	JobSystem* jobs = nullptr;
+	uint32_t workers = 0;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<uint32_t> mainQueue;     // ready tasks for the main thread
+	uint32_t foregroundLeft = 0;
+	uint32_t tasksLeft = 0;
+	std::exception_ptr error;           // first exception a task threw; later tasks are skipped
+	std::chrono::steady_clock::time_point origin;
+	double foregroundMs = 0.0;          // when runInitGraph returned
+	double firstFrameMs = 0.0;
+};
+
+double initGraphNowMs(const InitGraph& g) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g.origin).count();
+}
+
+// dependencies are added before the tasks that use them; a foreground task cannot wait for a
+// background one
+uint32_t addInitTask(InitGraph& g, const char* name, InitTaskKind kind, const std::vector<uint32_t>& dependencies,
+	std::function<void()> run)
+{
+	uint32_t id = static_cast<uint32_t>(g.tasks.size());
+	for (uint32_t dependency : dependencies) {
+		if (dependency >= id) {
+			throw std::runtime_error(std::string("init task ") + name + " depends on an unknown task!");
+		}
+		if (g.tasks[dependency].kind == InitTaskKind::Background && kind != InitTaskKind::Background) {
+			throw std::runtime_error(std::string("init task ") + name + " waits for a background task!");
+		}
+		g.tasks[dependency].dependents.push_back(id);
+	}
+	InitTask task;
+	task.name = name;
+	task.kind = kind;
+	task.run = std::move(run);
+	task.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	g.tasks.push_back(std::move(task));
+	return id;
+}
+
+bool isSerialInitGraph(const InitGraph& g) {
+	return g.workers == 0;
+}
+
+void runInitTask(InitGraph& g, uint32_t id, uint32_t thread);
+
+// call with g.mutex held
+void scheduleInitTask(InitGraph& g, uint32_t id) {
+	if (g.tasks[id].kind == InitTaskKind::MainThread || isSerialInitGraph(g)) {
+		g.mainQueue.push_back(id);
+		g.changed.notify_all();
+		return;
+	}
+	InitGraph* graph = &g;
+	submitJob(*g.jobs, [graph, id](uint32_t worker) { runInitTask(*graph, id, worker + 1); });
+}
+
+void runInitTask(InitGraph& g, uint32_t id, uint32_t thread) {
+	InitTask& task = g.tasks[id];
+	bool skip;
+	{
+		std::lock_guard<std::mutex> lock(g.mutex);
+		skip = g.error != nullptr;
+	}
+	task.thread = thread;
+	task.startMs = initGraphNowMs(g);
+	if (!skip) {
+		try {
+			task.run();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(g.mutex);
+			if (!g.error) {
+				g.error = std::current_exception();
+			}
+		}
+	}
+	task.endMs = initGraphNowMs(g);
+
+	std::lock_guard<std::mutex> lock(g.mutex);
+	task.done = true;
+	g.tasksLeft--;
+	if (task.kind != InitTaskKind::Background) {
+		g.foregroundLeft--;
+	}
+	for (uint32_t next : task.dependents) {
+		InitTask& dependent = g.tasks[next];
+		if (--dependent.waiting == 0) {
+			dependent.criticalDependency = id;
+			scheduleInitTask(g, next);
+		}
+	}
+	g.changed.notify_all();
+}
+
+// Runs the graph on jobs (null or no threads: on this thread only) and returns when the
+// foreground tasks are done. Rethrows the first exception a task threw.
+void runInitGraph(InitGraph& g, JobSystem* jobs) {
+	g.jobs = jobs;
+	g.workers = jobs ? jobSystemThreadCount(*jobs) : 0;
+	g.origin = std::chrono::steady_clock::now();
+	bool serial = isSerialInitGraph(g);
+	std::unique_lock<std::mutex> lock(g.mutex);
+	g.tasksLeft = static_cast<uint32_t>(g.tasks.size());
+	g.foregroundLeft = 0;
+	for (auto& task : g.tasks) {
+		g.foregroundLeft += task.kind != InitTaskKind::Background ? 1 : 0;
+	}
+	for (uint32_t id = 0; id < g.tasks.size(); id++) {
+		g.tasks[id].waiting = g.tasks[id].dependencyCount;
+		if (g.tasks[id].waiting == 0) {
+			scheduleInitTask(g, id);
+		}
+	}
+	while (g.foregroundLeft > 0 || (serial && g.tasksLeft > 0)) {
+		if (!g.mainQueue.empty()) {
+			uint32_t id = g.mainQueue.front();
+			g.mainQueue.pop_front();
+			lock.unlock();
+			runInitTask(g, id, 0);
+			lock.lock();
+			continue;
+		}
+		g.changed.wait(lock);
+	}
+	g.foregroundMs = initGraphNowMs(g);
+	if (g.error) {
+		std::rethrow_exception(g.error);
+	}
+}
+
+// cheap enough to poll once per frame; rethrows when a task failed
+bool isInitTaskDone(InitGraph& g, uint32_t id) {
+	std::lock_guard<std::mutex> lock(g.mutex);
+	if (g.error) {
+		std::rethrow_exception(g.error);
+	}
+	return id < g.tasks.size() && g.tasks[id].done;
+}
+
+void waitInitTask(InitGraph& g, uint32_t id) {
+	std::unique_lock<std::mutex> lock(g.mutex);
+	if (id < g.tasks.size()) {
+		g.changed.wait(lock, [&g, id]() { return g.tasks[id].done; });
+	}
+	if (g.error) {
+		std::rethrow_exception(g.error);
+	}
+}
+
+// joins the background tasks; call before anything they create is destroyed
+void waitInitGraph(InitGraph& g) {
+	std::unique_lock<std::mutex> lock(g.mutex);
+	g.changed.wait(lock, [&g]() { return g.tasksLeft == 0; });
+}
+
+void noteInitFirstFrame(InitGraph& g) {
+	if (g.firstFrameMs == 0.0) {
+		g.firstFrameMs = initGraphNowMs(g);
+	}
+}
+
+// id and, going back, the dependency each task waited for last
+std::string initGraphPath(const InitGraph& g, uint32_t id) {
+	std::vector<uint32_t> path;
+	for (; id != kNoInitTask; id = g.tasks[id].criticalDependency) {
+		path.push_back(id);
+	}
+	std::reverse(path.begin(), path.end());
+	std::string text;
+	double busyMs = 0.0;
+	char step[128];
+	for (size_t i = 0; i < path.size(); i++) {
+		const InitTask& task = g.tasks[path[i]];
+		snprintf(step, sizeof(step), "%s%s %.1f", i ? " > " : "", task.name, task.endMs - task.startMs);
+		text += step;
+		busyMs += task.endMs - task.startMs;
+	}
+	snprintf(step, sizeof(step), " (%.1f ms busy, done at %.1f ms)", busyMs, path.empty() ? 0.0 : g.tasks[path.back()].endMs);
+	return text + step;
+}
+
+void dumpInitGraphStats(const InitGraph& g) {
+	if (g.tasks.empty()) {
+		return;
+	}
+	double workMs = 0.0;
+	uint32_t lastForeground = kNoInitTask;
+	uint32_t lastBackground = kNoInitTask;
+	for (uint32_t id = 0; id < g.tasks.size(); id++) {
+		const InitTask& task = g.tasks[id];
+		workMs += task.endMs - task.startMs;
+		uint32_t& last = task.kind == InitTaskKind::Background ? lastBackground : lastForeground;
+		if (last == kNoInitTask || g.tasks[last].endMs < task.endMs) {
+			last = id;
+		}
+	}
+	std::cout << "init:\t\t" << g.tasks.size() << " tasks on " << g.workers << " workers, "
+		<< workMs << " ms of work, ready in " << g.foregroundMs << " ms";
+	if (g.firstFrameMs > 0.0) {
+		std::cout << ", first frame at " << g.firstFrameMs << " ms";
+	}
+	std::cout << "\n  critical path:\t" << initGraphPath(g, lastForeground) << "\n";
+	if (lastBackground != kNoInitTask) {
+		std::cout << "  background:\t" << initGraphPath(g, lastBackground) << "\n";
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+// Minimal fixed-size worker pool. Jobs receive the index of the worker that runs them,
+// so per-thread resources (command pools, arenas) can be looked up without locking.
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobSystem {
+	std::vector<std::thread> threads;
+	std::deque<std::function<void(uint32_t)>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	uint32_t pending = 0;
+	bool quit = false;
+};
+
+void startJobSystem(JobSystem& js, uint32_t threadCount) {
+	js.quit = false;
+	for (uint32_t worker = 0; worker < threadCount; worker++) {
+		js.threads.emplace_back([&js, worker]() {
+			for (;;) {
+				std::function<void(uint32_t)> job;
+				{
+					std::unique_lock<std::mutex> lock(js.mutex);
+					js.wake.wait(lock, [&js]() { return js.quit || !js.jobs.empty(); });
+					if (js.jobs.empty()) {
+						return;
+					}
+					job = std::move(js.jobs.front());
+					js.jobs.pop_front();
+				}
+				job(worker);
+				std::lock_guard<std::mutex> lock(js.mutex);
+				if (--js.pending == 0) {
+					js.idle.notify_all();
+				}
+			}
+		});
+	}
+}
+
+uint32_t jobSystemThreadCount(const JobSystem& js) {
+	return static_cast<uint32_t>(js.threads.size());
+}
+
+void submitJob(JobSystem& js, std::function<void(uint32_t)> job) {
+	{
+		std::lock_guard<std::mutex> lock(js.mutex);
+		js.jobs.push_back(std::move(job));
+		js.pending++;
+	}
+	js.wake.notify_one();
+}
+
+void waitJobs(JobSystem& js) {
+	std::unique_lock<std::mutex> lock(js.mutex);
+	js.idle.wait(lock, [&js]() { return js.pending == 0; });
+}
+
+void stopJobSystem(JobSystem& js) {
+	{
+		std::lock_guard<std::mutex> lock(js.mutex);
+		js.quit = true;
+	}
+	js.wake.notify_all();
+	for (auto& thread : js.threads) {
+		thread.join();
+	}
+	js.threads.clear();
+}
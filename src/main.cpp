@@ -4,7 +4,7 @@
 	#define VK_USE_PLATFORM_WIN32_KHR
 #endif
 
-#include <vulkan/vulkan.h>
+#include "vk_dispatch.h"
 #include <GLFW/glfw3.h>
 
 GLFWwindow *window;
@@ -12,23 +12,177 @@ VkSurfaceKHR _surface = VK_NULL_HANDLE;
 VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
 
 #include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
 #include <vector>
 #include <iostream>
 #include <algorithm>
-
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "host_allocator.h"
+#include "device_caps.h"
 #include "dump_util.h"
+#include "debug_utils.h"
+#include "memory_allocator.h"
+#include "offscreen_util.h"
+#include "pipeline_cache.h"
+#include "spirv_reflect.h"
+#include "descriptor_allocator.h"
+#include "render_graph.h"
+#include "parallel_record.h"
+#include "upload_queue.h"
+#include "compute_queue.h"
+#include "gpu_profiler.h"
+#include "bench_util.h"
+#include "deletion_queue.h"
+#include "present_policy.h"
+#include "init_graph.h"
+#include "frame_capture.h"
+#include "gpu_scene.h"
+
+#ifndef SHADER_DIR
+	#define SHADER_DIR "shaders/"
+#endif
+
+struct SampleOptions {
+	bool headless = false;          // --headless : no GLFW, no window
+	bool forceOffscreen = false;    // --offscreen : skip VK_EXT_headless_surface even if present
+	uint32_t frameCount = 0;        // --frames N : 0 runs until the window is closed
+	uint32_t framesInFlight = 0;    // --frames-in-flight N : CPU may record this many frames ahead of the GPU; 0 = profile default
+	PresentProfile presentProfile = PresentProfile::Throughput; // --present-profile latency|throughput|power
+	double fpsLimit = 0.0;          // --fps-limit N : frame limiter, overrides the profile's target
+	PresentPolicy presentPolicy;    // resolved from the two above
+	VkExtent2D extent = { 512, 512 };
+	std::string pipelineCachePath = "pipeline_cache.bin"; // --pipeline-cache PATH, --no-pipeline-cache
+	std::string capsCachePath = "device_caps.bin";        // --caps-cache PATH, --no-caps-cache
+	std::string dumpCapsPath;       // --dump-caps PATH : write the capability snapshot as JSON
+	bool hostAllocator = false;     // --host-allocator : route driver host allocations through host_allocator.h
+	uint32_t drawCount = 1;         // --draws N : triangles per frame, one vkCmdDraw each
+	uint32_t recordThreads = 0;     // --record-threads N : 0 records inline on the main thread
+	bool recordBench = false;       // --record-bench : measure recording time for 1..N threads and exit
+	uint32_t uploadStress = 0;      // --upload-stress N : stream N small copies per frame through the transfer queue
+	std::string tracePath;          // --trace PATH : write the CPU/GPU timeline as Chrome trace JSON at exit
+	uint32_t benchFrames = 0;       // --bench N : measure N frames after --bench-warmup frames and report percentiles
+	uint32_t benchWarmup = 100;
+	std::string benchJsonPath;      // --bench-json PATH
+	std::string benchCsvPath;       // --bench-csv PATH
+	bool serialInit = false;        // --serial-init : run the startup tasks one after another on the main thread
+	std::string capturePath;        // --capture PATH : write every frame to PATH, raw or .y4m
+	bool captureWorker = false;     // --capture-worker : convert and write captured frames on a worker thread
+	uint32_t objectCount = 0;       // --objects N : GPU-culled scene of N objects instead of the triangles
+	bool cpuCulling = false;        // --cpu-culling : cull the objects on the CPU, one vkCmdDrawIndexed each
+	uint32_t objectsBench = 0;      // --objects-bench [N] : compare GPU and CPU culling for 1024..N objects and exit
+};
+
+VkInstance _instance = VK_NULL_HANDLE;
+VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+InstanceCaps _caps;
+DeviceCaps* _deviceCaps = nullptr;          // entry of _physicalDevice in _caps
+VkDevice _device = VK_NULL_HANDLE;
+VkQueue _graphicsQueue = VK_NULL_HANDLE;
+VkQueue _presentQueue = VK_NULL_HANDLE;
+uint32_t _graphicsQueueIndex = 0;
+uint32_t _presentQueueIndex = 0;
+VkQueue _transferQueue = VK_NULL_HANDLE;
+uint32_t _transferQueueIndex = 0;
+VkQueue _computeQueue = VK_NULL_HANDLE;
+uint32_t _computeQueueIndex = 0;
+VkFormat _swapchainFormat = VK_FORMAT_UNDEFINED;
+VkExtent2D _swapchainExtent = {};
+std::vector<VkImage> _swapchainImages;
+std::vector<VkImageView> _swapchainImageViews;
+VkImageUsageFlags _swapchainExtraUsage = 0;  // requested on top of COLOR_ATTACHMENT, if the surface allows it
+VkImageUsageFlags _swapchainUsage = 0;
+OffscreenTarget _offscreen; // used instead of _swapchain when there is no surface at all
+std::vector<std::string> _enabledDeviceExtensions;
+LayoutCache _layoutCache;
+DescriptorAllocator _descriptors;
+ReflectedShader _triangleVert;              // kept for pipeline re-creation
+ReflectedShader _triangleFrag;
+ReflectedLayout _pipelineLayout;            // owned by _layoutCache
+RenderGraph _frameGraph;
+uint32_t _backbuffer = 0;                   // graph resource of the swapchain or offscreen image
+uint32_t _scenePass = 0;
+VkPipeline _graphicsPipeline = VK_NULL_HANDLE;
+PresentPolicy _presentPolicy;
+VkPresentModeKHR _presentMode = VK_PRESENT_MODE_FIFO_KHR;
+FramePacer _pacer;
+VkExtent2D _requestedExtent = { 512, 512 };  // swapchain size when the surface leaves it to us
+bool _swapchainDirty = false;                // resize, VK_SUBOPTIMAL_KHR or VK_ERROR_OUT_OF_DATE_KHR seen
+uint32_t _swapchainRecreations = 0;
+DeletionQueue _deletions;
+PipelineCacheStore _pipelineCache;
+ParallelRecorder _recorder;
+uint32_t _drawCount = 1;
+DeviceMemoryAllocator _allocator;
+UploadQueue _uploads;
+VkBuffer _vertexBuffer = VK_NULL_HANDLE;
+MemoryAllocation _vertexAllocation;
+VkBuffer _streamBuffer = VK_NULL_HANDLE;   // write-only target of --upload-stress
+MemoryAllocation _streamAllocation;
+uint32_t _uploadStress = 0;
+
+// particle simulation on the compute queue; one buffer per frame in flight, each frame
+// integrates the previous frame's particles and the vertex shader offsets every draw by one
+ComputeQueue _compute;
+ComputePipeline _particlePipeline;
+std::vector<VkBuffer> _particleBuffers;
+std::vector<MemoryAllocation> _particleAllocations;
+VkBuffer _particleBuffer = VK_NULL_HANDLE;  // bound as instance data by recordDraws
+ReflectedShader _particleShader;            // until the particle pipeline is built
+uint64_t _particleSteps = 0;                // simulation steps so far; the first one seeds the particles
+
+GpuProfiler _profiler;
+uint32_t _profileGraphics = 0;  // profiler queue ids
+uint32_t _profileCompute = 0;
+std::string _tracePath;
+
+// startup; the pipelines finish compiling on _initJobs after vulkanInit has returned
+InitGraph _initGraph;
+JobSystem _initJobs;
+uint32_t _scenePipelineTask = kNoInitTask;
+uint32_t _particlePipelineTask = kNoInitTask;
+uint32_t _objectPipelineTask = kNoInitTask;
+bool _sceneReady = false;                   // all pipelines are built; until then frames only clear
+
+FrameCapture _capture;
+
+// GPU-driven scene (gpu_scene.h); replaces the triangles when --objects is given
+GpuScene _scene;
+ReflectedShader _objectVert;                // kept for pipeline re-creation
+ReflectedShader _cullShader;                // until the cull pipeline is built
+uint32_t _sceneObjects = 0;                 // graph resources
+uint32_t _sceneCommands = 0;
+uint32_t _sceneVisible = 0;
+uint32_t _sceneCounts = 0;
+
+struct Particle {
+	float position[2];
+	float velocity[2];
+};
+
+struct ParticleSimulation {  // particles.comp push constants
+	uint32_t count;
+	float dt;
+	uint32_t reset;
+};
 
-VkInstance createInstance(const char* appName)
+struct Vertex {
+	float position[2];
+	float color[3];
+};
+
+// layers and debug extensions come from the debug profile; a release build enables none
+VkInstance createInstance(const char* appName, std::vector<const char*> instance_extensions, const DebugProfile& debugProfile)
 {
 	VkInstance instance = nullptr;
 
-	std::vector<const char*> instance_layers;
-	std::vector<const char*> instance_extensions;
-	instance_layers.push_back("VK_LAYER_LUNARG_standard_validation"); // for Debug
-	instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-#ifdef _WIN32
-	instance_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME); // need for Windows
-#endif
+	instance_extensions.insert(instance_extensions.end(), debugProfile.extensions.begin(), debugProfile.extensions.end());
 
 	VkApplicationInfo application_info{};
 	application_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -41,12 +195,14 @@ VkInstance createInstance(const char* appName)
 	instance_create_info.pNext = nullptr;
 	instance_create_info.flags = 0;
 	instance_create_info.pApplicationInfo = &application_info;
-	instance_create_info.enabledExtensionCount = instance_layers.size();
-	instance_create_info.ppEnabledLayerNames = instance_layers.data();
-	instance_create_info.enabledExtensionCount = instance_extensions.size();
+	instance_create_info.enabledLayerCount = static_cast<uint32_t>(debugProfile.layers.size());
+	instance_create_info.ppEnabledLayerNames = debugProfile.layers.data();
+	instance_create_info.enabledExtensionCount = static_cast<uint32_t>(instance_extensions.size());
 	instance_create_info.ppEnabledExtensionNames = instance_extensions.data();
+	VkDebugUtilsMessengerCreateInfoEXT messenger_ci;
+	chainDebugMessenger(debugProfile, instance_create_info, messenger_ci);
 
-	auto err = vkCreateInstance(&instance_create_info, nullptr, &instance);
+	auto err = vkCreateInstance(&instance_create_info, hostAllocationCallbacks(), &instance);
 	if (VK_SUCCESS != err) {
 		assert(0 && "Vulkan ERROR: Create instance failed!!");
 		std::exit(-1);
@@ -55,95 +211,150 @@ VkInstance createInstance(const char* appName)
 	return instance;
 }
 
-bool isGPUCheck(VkPhysicalDevice device) {
-	VkPhysicalDeviceProperties deviceProperties;
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceProperties(device, &deviceProperties);
-	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-	return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-		deviceFeatures.geometryShader;
+void findGraphicsQueueIndex(const DeviceCaps& device, uint32_t& graphic_index, uint32_t& present_index);
+
+// Any device with a graphics queue (and present support when there is a surface) is usable,
+// so headless boxes can run on integrated or software (lavapipe, swiftshader) implementations.
+int rateGPU(const DeviceCaps& device) {
+	uint32_t graphics_index, present_index;
+	findGraphicsQueueIndex(device, graphics_index, present_index);
+	if (graphics_index == static_cast<uint32_t>(-1) || present_index == static_cast<uint32_t>(-1)) {
+		return 0;
+	}
+
+	switch (device.properties.deviceType) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return 4;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return 2;
+	default:                                     return 1; // CPU / other
+	}
 }
 
-VkPhysicalDevice pickPhysicalDevice(VkInstance instance)
+DeviceCaps* pickPhysicalDevice(InstanceCaps& caps, VkSurfaceKHR surface)
 {
-	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	DeviceCaps* physicalDevice = nullptr;
 
-	uint32_t deviceCount = 0;
-	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-	if (deviceCount == 0) {
+	if (caps.devices.empty()) {
 		assert(0 && "failed to find GPUs with Vulkan support!");
 		std::exit(-1);
 		return nullptr;
 	}
-	std::vector<VkPhysicalDevice> devices(deviceCount);
-	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-	for (const auto& device : devices) {
-		if (isGPUCheck(device)) {
-			physicalDevice = device;
-			break;
+	int bestScore = 0;
+	for (auto& device : caps.devices) {
+		queryDeviceSurfaceCaps(device, surface);
+		int score = rateGPU(device);
+		if (score > bestScore) {
+			bestScore = score;
+			physicalDevice = &device;
 		}
 	}
-	if (physicalDevice == VK_NULL_HANDLE) {
+	if (physicalDevice == nullptr) {
 		assert(0 && "failed to find a suitable GPU!");
+		std::exit(-1);
 	}
 
 	return physicalDevice;
 }
 
 
-void findGraphicsQueueIndex(VkPhysicalDevice device, VkSurfaceKHR surface, uint32_t& graphic_index, uint32_t& present_index) {
+// present support comes from queryDeviceSurfaceCaps
+void findGraphicsQueueIndex(const DeviceCaps& device, uint32_t& graphic_index, uint32_t& present_index) {
 	graphic_index = static_cast<uint32_t>(-1);
 	present_index = static_cast<uint32_t>(-1);
 
-	uint32_t queueFamilyCount = 0;
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-
 	int i = 0;
-	for (const auto& queueFamily : queueFamilies) {
+	for (const auto& queueFamily : device.queueFamilies) {
 		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
 			graphic_index = i;
 		}
 
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-		if (queueFamily.queueCount > 0 && presentSupport) {
+		if (device.surface != VK_NULL_HANDLE && queueFamily.queueCount > 0 && device.presentSupport[i]) {
 			present_index = i;
 		}
 
 		i++;
 	}
+
+	// offscreen: nothing is presented, keep everything on the graphics queue
+	if (device.surface == VK_NULL_HANDLE) {
+		present_index = graphic_index;
+	}
+}
+
+bool isDeviceExtensionEnabled(const char* name) {
+	return std::find(_enabledDeviceExtensions.begin(), _enabledDeviceExtensions.end(), name) != _enabledDeviceExtensions.end();
 }
 
-VkDevice createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface,
-	uint32_t& graphics_queue_index, uint32_t& present_queue_index)
+// best indirect path of the device; without multiDrawIndirect maxDrawIndirectCount is 1,
+// so the count path is of no use either
+ObjectDrawPath deviceObjectDrawPath() {
+	if (!_deviceCaps->features.multiDrawIndirect) {
+		return ObjectDrawPath::Indirect;
+	}
+	return isDeviceExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) ? ObjectDrawPath::IndirectCount
+		: ObjectDrawPath::MultiDrawIndirect;
+}
+
+VkDevice createLogicalDevice(const DeviceCaps& physicalDevice,
+	uint32_t& graphics_queue_index, uint32_t& present_queue_index, uint32_t& transfer_queue_index,
+	uint32_t& compute_queue_index)
 {
 	VkDevice device = nullptr;
-	findGraphicsQueueIndex(physicalDevice, surface, graphics_queue_index, present_queue_index);
+	VkSurfaceKHR surface = physicalDevice.surface;
+	findGraphicsQueueIndex(physicalDevice, graphics_queue_index, present_queue_index);
+	transfer_queue_index = findTransferQueueIndex(physicalDevice.queueFamilies, graphics_queue_index);
+	compute_queue_index = findComputeQueueIndex(physicalDevice.queueFamilies, graphics_queue_index);
 
+	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	VkDeviceQueueCreateInfo queueCreateInfo = {};
 	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 	queueCreateInfo.queueFamilyIndex = graphics_queue_index;
 	queueCreateInfo.queueCount = 1;
 	float queuePriority = 1.0f;
 	queueCreateInfo.pQueuePriorities = &queuePriority;
+	queueCreateInfos.push_back(queueCreateInfo);
+	// one queue per distinct family; families that coincide share it
+	for (uint32_t index : { present_queue_index, transfer_queue_index, compute_queue_index }) {
+		bool requested = false;
+		for (const auto& info : queueCreateInfos) {
+			requested |= info.queueFamilyIndex == index;
+		}
+		if (!requested) {
+			queueCreateInfo.queueFamilyIndex = index;
+			queueCreateInfos.push_back(queueCreateInfo);
+		}
+	}
 
+	// GPU-driven scene: one indirect call for all chunks, chunk offsets in firstInstance
 	VkPhysicalDeviceFeatures deviceFeatures = {};
+	deviceFeatures.multiDrawIndirect = physicalDevice.features.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = physicalDevice.features.drawIndirectFirstInstance;
 	VkDeviceCreateInfo createInfo = {};
 	std::vector<const char*> deviceExt;
-	deviceExt.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	if (surface != VK_NULL_HANDLE) {
+		deviceExt.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
+	// optional: enabled only when the device has them
+	const char* optionalExt[] = {
+		VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME, // pipeline cache hit/miss statistics
+		VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,        // draw count of the GPU-driven scene read from a buffer
+	};
+	for (const char* name : optionalExt) {
+		if (hasDeviceExtension(physicalDevice, name)) {
+			deviceExt.push_back(name);
+		}
+	}
+	_enabledDeviceExtensions.assign(deviceExt.begin(), deviceExt.end());
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	createInfo.pQueueCreateInfos = &queueCreateInfo;
-	createInfo.queueCreateInfoCount = 1;
+	createInfo.pQueueCreateInfos = queueCreateInfos.data();
+	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pEnabledFeatures = &deviceFeatures;
 	createInfo.enabledExtensionCount = deviceExt.size();
 	createInfo.ppEnabledExtensionNames = deviceExt.data();
 	createInfo.enabledLayerCount = 0;
 
-	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+	if (vkCreateDevice(physicalDevice.device, &createInfo, hostAllocationCallbacks(), &device) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create logical device!");
 	}
 
@@ -156,26 +367,15 @@ struct SwapChainSupportDetails {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
-SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice phyDevice, VkSurfaceKHR surface) {
+// formats and present modes come from the snapshot; the capabilities carry the current size
+SwapChainSupportDetails querySwapChainSupport(DeviceCaps& phyDevice, VkSurfaceKHR surface) {
 	
 	SwapChainSupportDetails details;
 
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(phyDevice, surface, &details.capabilities);
-
-	uint32_t formatCount;
-	vkGetPhysicalDeviceSurfaceFormatsKHR(phyDevice, surface, &formatCount, nullptr);
-	if (formatCount != 0) {
-		details.formats.resize(formatCount);
-		vkGetPhysicalDeviceSurfaceFormatsKHR(phyDevice, surface, &formatCount, details.formats.data());
-	}
-
-	uint32_t presentModeCount;
-	vkGetPhysicalDeviceSurfacePresentModesKHR(phyDevice, surface, &presentModeCount, nullptr);
-
-	if (presentModeCount != 0) {
-		details.presentModes.resize(presentModeCount);
-		vkGetPhysicalDeviceSurfacePresentModesKHR(phyDevice, surface, &presentModeCount, details.presentModes.data());
-	}
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(phyDevice.device, surface, &details.capabilities);
+	queryDeviceSurfaceCaps(phyDevice, surface);
+	details.formats = phyDevice.surfaceFormats;
+	details.presentModes = phyDevice.presentModes;
 
 	return details;
 }
@@ -189,22 +389,14 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>
 	return availableFormats[0];
 }
 
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-	for (const auto& availablePresentMode : availablePresentModes) {
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) { // the performace is better than FIFO
-			return availablePresentMode;
-		}
-	}
-	return VK_PRESENT_MODE_FIFO_KHR;
-}
 
-
-VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
+// fallback is used when the surface lets the swapchain pick its size (window framebuffer size, --width/--height)
+VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D fallback) {
 	if (capabilities.currentExtent.width != UINT32_MAX) {
 		return capabilities.currentExtent;
 	}
 	else {
-		VkExtent2D actualExtent = { 512, 512 };
+		VkExtent2D actualExtent = fallback;
 
 		actualExtent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actualExtent.width));
 		actualExtent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actualExtent.height));
@@ -213,22 +405,25 @@ VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
 	}
 }
 
-VkSwapchainKHR createSwapChainAndImages(VkPhysicalDevice phyDevice, VkDevice dev, VkSurfaceKHR surface,
-	uint32_t graphics_queue_index, uint32_t present_queue_index,
-	std::vector<VkImage> swapChainImages, std::vector<VkImageView> swapChainImageViews
+// oldSwapchain is retired, not destroyed: images it already handed out can still be presented
+VkSwapchainKHR createSwapChainAndImages(DeviceCaps& phyDevice, VkDevice dev, VkSurfaceKHR surface,
+	uint32_t graphics_queue_index, uint32_t present_queue_index, VkSwapchainKHR oldSwapchain, VkExtent2D fallbackExtent,
+	const PresentPolicy& policy, VkImageUsageFlags extraUsage, std::vector<VkImage>& swapChainImages,
+	std::vector<VkImageView>& swapChainImageViews, VkFormat& swapChainImageFormat, VkExtent2D& swapChainExtent,
+	VkPresentModeKHR& swapChainPresentMode, VkImageUsageFlags& swapChainUsage
 ) {
 	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(phyDevice, surface);
 
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+	VkPresentModeKHR presentMode = choosePresentMode(policy, swapChainSupport.presentModes);
+	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities, fallbackExtent);
 
 
 	VkSwapchainCreateInfoKHR swapchain_ci = {};
 	swapchain_ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swapchain_ci.pNext = NULL;
 	swapchain_ci.surface = surface;
-	swapchain_ci.minImageCount = swapChainSupport.capabilities.minImageCount;
+	swapchain_ci.minImageCount = chooseImageCount(policy, swapChainSupport.capabilities, presentMode);
 	swapchain_ci.imageFormat = surfaceFormat.format;
 	swapchain_ci.imageExtent.width = extent.width;
 	swapchain_ci.imageExtent.height = extent.height;
@@ -236,10 +431,10 @@ VkSwapchainKHR createSwapChainAndImages(VkPhysicalDevice phyDevice, VkDevice dev
 	swapchain_ci.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapchain_ci.imageArrayLayers = 1;
 	swapchain_ci.presentMode = presentMode;
-	swapchain_ci.oldSwapchain = VK_NULL_HANDLE;
+	swapchain_ci.oldSwapchain = oldSwapchain;
 	swapchain_ci.clipped = VK_TRUE;
 	swapchain_ci.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
-	swapchain_ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	swapchain_ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (extraUsage & swapChainSupport.capabilities.supportedUsageFlags);
 	swapchain_ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	swapchain_ci.queueFamilyIndexCount = 0;
 	swapchain_ci.pQueueFamilyIndices = nullptr;
@@ -255,7 +450,7 @@ VkSwapchainKHR createSwapChainAndImages(VkPhysicalDevice phyDevice, VkDevice dev
 	}
 
 	VkSwapchainKHR swapChain;
-	if (vkCreateSwapchainKHR(dev, &swapchain_ci, nullptr, &swapChain) != VK_SUCCESS) {
+	if (vkCreateSwapchainKHR(dev, &swapchain_ci, hostAllocationCallbacks(), &swapChain) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create swap chain!");
 	}
 
@@ -286,110 +481,903 @@ VkSwapchainKHR createSwapChainAndImages(VkPhysicalDevice phyDevice, VkDevice dev
 		color_image_view.subresourceRange.baseArrayLayer = 0;
 		color_image_view.subresourceRange.layerCount = 1;
 
-		VkResult res = vkCreateImageView(dev, &color_image_view, NULL, &swapChainImageViews[i]);
+		VkResult res = vkCreateImageView(dev, &color_image_view, hostAllocationCallbacks(), &swapChainImageViews[i]);
 		assert(res == VK_SUCCESS);
 	}
 
+	swapChainImageFormat = surfaceFormat.format;
+	swapChainExtent = extent;
+	swapChainPresentMode = presentMode;
+	swapChainUsage = swapchain_ci.imageUsage;
 	return swapChain;
 }
 
-VkPipelineLayout createPipelineLayout(VkDevice dev) {
-	VkPipelineLayout pipelineLayout;
-	
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0; // Optional
-	pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+VkPipeline createGraphicsPipeline(VkRenderPass renderPass, uint32_t subpass, VkPipelineLayout pipelineLayout,
+	PipelineCacheStore& pipelineCache, const ReflectedShader& vert, const ReflectedShader& frag,
+	const VkVertexInputBindingDescription* bindings, uint32_t bindingCount,
+	const VkVertexInputAttributeDescription* attributes, uint32_t attributeCount)
+{
+	VkPipelineShaderStageCreateInfo stages[2] = {};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = vert.reflection.stage;
+	stages[0].module = vert.module;
+	stages[0].pName = vert.reflection.entryPoint.c_str();
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = frag.reflection.stage;
+	stages[1].module = frag.module;
+	stages[1].pName = frag.reflection.entryPoint.c_str();
+
+	validateVertexInputs(vert.reflection, attributes, attributeCount);
+
+	VkPipelineVertexInputStateCreateInfo vertexInput = {};
+	vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInput.vertexBindingDescriptionCount = bindingCount;
+	vertexInput.pVertexBindingDescriptions = bindings;
+	vertexInput.vertexAttributeDescriptionCount = attributeCount;
+	vertexInput.pVertexAttributeDescriptions = attributes;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// viewport and scissor are dynamic so the pipeline survives swapchain size changes
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizer.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = stages;
+	pipelineInfo.pVertexInputState = &vertexInput;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.subpass = subpass;
+
+	return createGraphicsPipelineCached(pipelineCache, pipelineInfo);
+}
 
-	if (vkCreatePipelineLayout(dev, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
+VkExtent2D swapchainFallbackExtent() {
+	if (window) {
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(window, &width, &height);
+		return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 	}
-
-	return pipelineLayout;
+	return _requestedExtent;
 }
 
-VkPipeline createGraphicsPipeline() {
-	VkPipeline graphicsPipeline;
+bool isWindowMinimized() {
+	VkExtent2D extent = swapchainFallbackExtent();
+	return window && (extent.width == 0 || extent.height == 0);
+}
 
+void recordDraws(VkCommandBuffer cmd, uint32_t first, uint32_t count);
+
+void recordObjectScene(const RenderGraphContext& ctx) {
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(_swapchainExtent.width);
+	viewport.height = static_cast<float>(_swapchainExtent.height);
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor = {};
+	scissor.extent = _swapchainExtent;
+	vkCmdSetViewport(ctx.cmd, 0, 1, &viewport);
+	vkCmdSetScissor(ctx.cmd, 0, 1, &scissor);
+	recordGpuSceneDraws(_scene, _descriptors, ctx.cmd, ctx.frameIndex);
+}
 
-	return graphicsPipeline;
+// The frame as a render graph: the scene pass clears the backbuffer and draws into it. The
+// particle buffer is not part of the graph; it is handed over from the compute queue by a
+// semaphore before the frame's command buffer runs. With --objects, the cull passes run
+// before the scene pass on the graphics queue and the graph places their barriers.
+void buildFrameGraph() {
+	_backbuffer = importGraphImage(_frameGraph, "backbuffer", _swapchainFormat, _swapchainExtent,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,  // the stage the acquire semaphore is waited on
+		_swapchain != VK_NULL_HANDLE ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	bool objects = isGpuSceneActive(_scene);
+	if (objects) {
+		// the initial stages cover the previous frame's last use
+		_sceneCounts = importGraphBuffer(_frameGraph, "draw counts", VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, false);
+		_sceneCommands = importGraphBuffer(_frameGraph, "draw commands", VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, false);
+		_sceneVisible = importGraphBuffer(_frameGraph, "visible objects", VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, false);
+		_sceneObjects = importGraphBuffer(_frameGraph, "objects", VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_SHADER_WRITE_BIT, false);
+		uint32_t resetPass = addGraphPass(_frameGraph, "cull reset", false, [](const RenderGraphContext& ctx) {
+			recordGpuSceneReset(_scene, ctx.cmd);
+		});
+		useGraphResource(_frameGraph, resetPass, _sceneCounts, RenderGraphUsage::TransferDst);
+		uint32_t cullPass = addGraphPass(_frameGraph, "cull", false, [](const RenderGraphContext& ctx) {
+			if (_sceneReady) {
+				recordGpuSceneCull(_scene, _descriptors, ctx.cmd, ctx.frameIndex);
+			}
+		});
+		for (uint32_t res : { _sceneCounts, _sceneCommands, _sceneVisible, _sceneObjects }) {
+			useGraphResource(_frameGraph, cullPass, res, RenderGraphUsage::StorageWrite);
+		}
+	}
+	_scenePass = addGraphPass(_frameGraph, "scene", true, [](const RenderGraphContext& ctx) {
+		if (!_sceneReady) {
+			return; // pipelines still compiling: the pass only clears
+		}
+		if (isGpuSceneActive(_scene)) {
+			recordObjectScene(ctx);
+			return;
+		}
+		if (!ctx.secondary) {
+			recordDraws(ctx.cmd, 0, _drawCount);
+			return;
+		}
+		VkCommandBufferInheritanceInfo inheritance = {};
+		inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.renderPass = ctx.renderPass;
+		inheritance.subpass = ctx.subpass;
+		inheritance.framebuffer = ctx.framebuffer;
+		std::vector<VkCommandBuffer> secondaries = recordSecondaryParallel(_recorder, ctx.frameIndex, inheritance, _drawCount, recordDraws);
+		vkCmdExecuteCommands(ctx.cmd, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	});
+	writeGraphAttachment(_frameGraph, _scenePass, _backbuffer, VK_ATTACHMENT_LOAD_OP_CLEAR);
+	if (objects) {
+		useGraphResource(_frameGraph, _scenePass, _sceneCommands, RenderGraphUsage::IndirectBuffer);
+		useGraphResource(_frameGraph, _scenePass, _sceneCounts, RenderGraphUsage::IndirectBuffer);
+		useGraphResource(_frameGraph, _scenePass, _sceneVisible, RenderGraphUsage::StorageRead, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+		useGraphResource(_frameGraph, _scenePass, _sceneObjects, RenderGraphUsage::StorageRead, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+		// visible objects and draws of this frame slot, read once its fence has signaled
+		uint32_t statsPass = addGraphPass(_frameGraph, "cull stats", false, [](const RenderGraphContext& ctx) {
+			recordGpuSceneStats(_scene, ctx.cmd, ctx.frameIndex);
+		});
+		useGraphResource(_frameGraph, statsPass, _sceneCounts, RenderGraphUsage::TransferSrc);
+		markGraphPassSideEffects(_frameGraph, statsPass);
+	}
+	if (isFrameCaptureActive(_capture)) {
+		// read back into this frame slot's buffer; written out when the slot's fence has signaled
+		uint32_t capturePass = addGraphPass(_frameGraph, "capture", false, [](const RenderGraphContext& ctx) {
+			recordFrameCapture(_capture, ctx.cmd, ctx.frameIndex, graphImage(_frameGraph, _backbuffer), _swapchainExtent);
+		});
+		useGraphResource(_frameGraph, capturePass, _backbuffer, RenderGraphUsage::TransferSrc);
+		markGraphPassSideEffects(_frameGraph, capturePass);
+	}
+	compileRenderGraph(_frameGraph);
 }
 
-VkRenderPass createRenderPass() {
-	VkRenderPass renderPass;
+VkPipeline createSceneGraphicsPipeline() {
+	// binding 0: triangle vertices, binding 1: one particle per instance
+	VkVertexInputBindingDescription bindings[2] = {};
+	bindings[0].binding = 0;
+	bindings[0].stride = sizeof(Vertex);
+	bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	bindings[1].binding = 1;
+	bindings[1].stride = sizeof(Particle);
+	bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	VkVertexInputAttributeDescription attributes[3] = {};
+	attributes[0].location = 0;
+	attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[0].offset = offsetof(Vertex, position);
+	attributes[1].location = 1;
+	attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributes[1].offset = offsetof(Vertex, color);
+	attributes[2].location = 2;
+	attributes[2].binding = 1;
+	attributes[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	attributes[2].offset = 0;
+
+	uint32_t subpass;
+	VkRenderPass renderPass = graphPassRenderPass(_frameGraph, _scenePass, subpass);
+	VkPipeline pipeline = createGraphicsPipeline(renderPass, subpass, _pipelineLayout.layout, _pipelineCache, _triangleVert, _triangleFrag,
+		bindings, 2, attributes, 3);
+	setObjectName(_device, VK_OBJECT_TYPE_PIPELINE, pipeline, "triangle");
+	return pipeline;
+}
 
-	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = swapChainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+// objects.vert + triangle.frag; the instance data comes from storage buffers
+VkPipeline createObjectGraphicsPipeline() {
+	VkVertexInputBindingDescription binding = {};
+	binding.binding = 0;
+	binding.stride = sizeof(ObjectVertex);
+	binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	VkVertexInputAttributeDescription attributes[2] = {};
+	attributes[0].location = 0;
+	attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[0].offset = offsetof(ObjectVertex, position);
+	attributes[1].location = 1;
+	attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributes[1].offset = offsetof(ObjectVertex, color);
+
+	uint32_t subpass;
+	VkRenderPass renderPass = graphPassRenderPass(_frameGraph, _scenePass, subpass);
+	VkPipeline pipeline = createGraphicsPipeline(renderPass, subpass, _scene.layout.layout, _pipelineCache, _objectVert, _triangleFrag,
+		&binding, 1, attributes, 2);
+	setObjectName(_device, VK_OBJECT_TYPE_PIPELINE, pipeline, "objects");
+	return pipeline;
+}
 
-	VkRenderPassCreateInfo renderPassInfo = {};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
+// compiles cull.comp from _cullShader, releases it, and builds the object pipeline
+void createObjectPipelines() {
+	_scene.cull = createComputePipeline(_pipelineCache, _layoutCache, _cullShader);
+	setObjectName(_device, VK_OBJECT_TYPE_PIPELINE, _scene.cull.pipeline, "cull.comp");
+	destroyReflectedShader(_device, _cullShader);
+	if (_scene.cull.pushConstantSize != sizeof(ObjectCull)) {
+		throw std::runtime_error("cull.comp push constants do not match ObjectCull!");
+	}
+	if (_scene.cull.localSize[0] != kObjectChunkSize) {
+		throw std::runtime_error("cull.comp local size does not match kObjectChunkSize!");
+	}
+	_scene.layout = getReflectedLayout(_layoutCache, { &_objectVert.reflection, &_triangleFrag.reflection });
+	if (_scene.layout.pushConstantSize != sizeof(ObjectView)) {
+		throw std::runtime_error("objects.vert push constants do not match ObjectView!");
+	}
+	_scene.pipeline = createObjectGraphicsPipeline();
+}
 
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
+void createParticleSystem(uint32_t particleCount, uint32_t framesInFlight) {
+	initComputeQueue(_compute, _device, _computeQueue, _computeQueueIndex, _graphicsQueueIndex, framesInFlight);
+
+	// written on the compute queue, read as vertex input on the graphics queue
+	VkDeviceSize size = VkDeviceSize(particleCount) * sizeof(Particle);
+	_particleBuffers.resize(framesInFlight);
+	_particleAllocations.resize(framesInFlight);
+	for (uint32_t i = 0; i < framesInFlight; i++) {
+		_particleBuffers[i] = createBuffer(_allocator, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			MemoryUsage::GpuOnly, _particleAllocations[i], nullptr, { _graphicsQueueIndex, _computeQueueIndex });
+		setObjectName(_device, VK_OBJECT_TYPE_BUFFER, _particleBuffers[i], "particles");
+	}
+	_particleBuffer = _particleBuffers[0];
+}
 
-	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create render pass!");
+// compiles particles.comp from _particleShader and releases the shader
+void createParticlePipeline() {
+	_particlePipeline = createComputePipeline(_pipelineCache, _layoutCache, _particleShader);
+	setObjectName(_device, VK_OBJECT_TYPE_PIPELINE, _particlePipeline.pipeline, "particles.comp");
+	destroyReflectedShader(_device, _particleShader);
+	if (_particlePipeline.pushConstantSize != sizeof(ParticleSimulation)) {
+		throw std::runtime_error("particles.comp push constants do not match ParticleSimulation!");
 	}
+}
 
-	return renderPass;
+// Integrates the particles of frame slot frameIndex from the previous slot's buffer and
+// returns the semaphore that the graphics submit of this frame waits on.
+VkSemaphore simulateParticles(uint32_t frameIndex, uint32_t particleCount) {
+	VkCommandBuffer cmd = beginComputeFrame(_compute, frameIndex);
+	beginProfilerCommandBuffer(_profiler, cmd, _profileCompute);
+	uint32_t scope = beginGpuScope(_profiler, cmd, _profileCompute, "particles");
+	beginDebugLabel(cmd, "particles");
+	computeBarrier(cmd); // previous slot was written by the last compute submit
+	ParticleSimulation sim = {};
+	sim.count = particleCount;
+	sim.dt = 1.0f / 60.0f;
+	sim.reset = _particleSteps++ == 0 ? 1 : 0;
+	// reads the previous slot's buffer, writes this slot's; the set is built on first use
+	uint32_t slots = static_cast<uint32_t>(_particleBuffers.size());
+	VkDeviceSize size = VkDeviceSize(particleCount) * sizeof(Particle);
+	VkDescriptorSet set = getImmutableDescriptorSet(_descriptors, _particlePipeline.setLayout, {
+		bufferDescriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _particleBuffers[(frameIndex + slots - 1) % slots], 0, size),
+		bufferDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _particleBuffers[frameIndex], 0, size) });
+	dispatchCompute(_compute, cmd, _particlePipeline, set, &sim, (particleCount + _particlePipeline.localSize[0] - 1) / _particlePipeline.localSize[0], 1, 1);
+	endDebugLabel(cmd);
+	endGpuScope(_profiler, cmd, scope);
+	_particleBuffer = _particleBuffers[frameIndex];
+	return submitComputeFrame(_compute, frameIndex);
 }
 
-void vulkanInit(GLFWwindow* window) {
-	
-	dumpExtensions();
+void destroyParticleSystem() {
+	dumpComputeStats(_compute);
+	for (size_t i = 0; i < _particleBuffers.size(); i++) {
+		destroyBuffer(_allocator, _particleBuffers[i], _particleAllocations[i]);
+	}
+	_particleBuffers.clear();
+	_particleAllocations.clear();
+	destroyComputePipeline(_device, _particlePipeline);
+	destroyComputeQueue(_compute);
+}
+
+VkSurfaceKHR createHeadlessSurface(VkInstance instance) {
+	auto pfnCreateHeadlessSurface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+		vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+	if (!pfnCreateHeadlessSurface) {
+		throw std::runtime_error("failed to load vkCreateHeadlessSurfaceEXT!");
+	}
+
+	VkHeadlessSurfaceCreateInfoEXT surface_ci = {};
+	surface_ci.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
 
-	// create Instance
-	VkInstance	vkInst = createInstance("MyApp");
 	VkSurfaceKHR surface;
+	if (pfnCreateHeadlessSurface(instance, &surface_ci, hostAllocationCallbacks(), &surface) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create headless surface!");
+	}
+	return surface;
+}
 
-	// create Surface
-	VkResult err = glfwCreateWindowSurface(vkInst, window, NULL, &surface);
-	if (err) {
-		assert(0 && "Vulkan ERROR: Create WindowSurface failed!!");
-		std::exit(-1);
-		return;
+// Startup as a task graph (init_graph.h). Steps only wait for what they use: device caps are
+// read while the window surface is created, the swapchain, shaders, pipeline cache, vertex
+// upload and particle buffers are set up concurrently once the device exists, and the two
+// pipelines compile in the background while the first frames are presented.
+void vulkanInit(GLFWwindow* window, const SampleOptions& options) {
+	bool useHeadlessSurface = false;
+	_requestedExtent = options.extent;
+	_presentPolicy = options.presentPolicy;
+	InitGraph& g = _initGraph;
+	_swapchainExtraUsage = options.capturePath.empty() || options.recordBench ? 0 : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+	uint32_t instance = addInitTask(g, "instance", InitTaskKind::MainThread, {}, [window, &options, &useHeadlessSurface]() {
+		if (!loadVulkanLibrary()) {
+			throw std::runtime_error("failed to load the Vulkan library!");
+		}
+		queryInstanceCaps(_caps);
+
+		std::vector<const char*> instance_extensions;
+		if (window) {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			instance_extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
+		else if (!options.forceOffscreen && hasInstanceExtension(_caps, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME)) {
+			instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+			instance_extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+			useHeadlessSurface = true;
+		}
+		DebugProfile debugProfile = selectDebugProfile(_caps);
+		_instance = createInstance("MyApp", instance_extensions, debugProfile);
+		loadVulkanInstance(_instance);
+		initDebugUtils(_instance, debugProfile);
+	});
+
+	uint32_t surface = addInitTask(g, "surface", InitTaskKind::MainThread, { instance }, [window, &useHeadlessSurface]() {
+		if (window) {
+			VkResult err = glfwCreateWindowSurface(_instance, window, hostAllocationCallbacks(), &_surface);
+			if (err) {
+				assert(0 && "Vulkan ERROR: Create WindowSurface failed!!");
+				std::exit(-1);
+				return;
+			}
+		}
+		else if (useHeadlessSurface) {
+			_surface = createHeadlessSurface(_instance);
+		}
+	});
+
+	uint32_t deviceCaps = addInitTask(g, "device caps", InitTaskKind::Worker, { instance }, [&options]() {
+		queryDeviceCaps(_caps, _instance, options.capsCachePath);
+	});
+
+	uint32_t physicalDevice = addInitTask(g, "pick device", InitTaskKind::Worker, { surface, deviceCaps }, []() {
+		_deviceCaps = pickPhysicalDevice(_caps, _surface);
+		_physicalDevice = _deviceCaps->device;
+	});
+
+	addInitTask(g, "dump caps", InitTaskKind::Worker, { physicalDevice }, [&options]() {
+		dumpDeviceCaps(_caps, *_deviceCaps);
+		if (!options.dumpCapsPath.empty() && !writeDeviceCapsJson(_caps, options.dumpCapsPath)) {
+			std::cout << "caps:\t\tfailed to write " << options.dumpCapsPath << "\n";
+		}
+	});
+
+	uint32_t device = addInitTask(g, "device", InitTaskKind::Worker, { physicalDevice }, [window]() {
+		_device = createLogicalDevice(*_deviceCaps, _graphicsQueueIndex, _presentQueueIndex, _transferQueueIndex,
+			_computeQueueIndex);
+		loadVulkanDevice(_device);  // device calls skip the loader from here on
+
+		vkGetDeviceQueue(_device, _graphicsQueueIndex, 0, &_graphicsQueue);
+		vkGetDeviceQueue(_device, _presentQueueIndex, 0, &_presentQueue);
+		vkGetDeviceQueue(_device, _transferQueueIndex, 0, &_transferQueue);
+		vkGetDeviceQueue(_device, _computeQueueIndex, 0, &_computeQueue);
+		initDeviceMemoryAllocator(_allocator, _deviceCaps->properties, _deviceCaps->memory, _device);
+		if (window && !glfwGetPhysicalDevicePresentationSupport(_instance, _physicalDevice, _presentQueueIndex)) // vkGetPhysicalDeviceSurfaceSupportKHR
+		{
+			assert(0 && "Vulkan ERROR: Can't get device presentation support!!");
+			std::exit(-1);
+			return;
+		}
+	});
+
+	// the fallback extent reads the framebuffer size, which GLFW only allows on the main thread
+	uint32_t swapchain = addInitTask(g, "swapchain", window ? InitTaskKind::MainThread : InitTaskKind::Worker, { device }, [&options]() {
+		if (_surface != VK_NULL_HANDLE) {
+			_swapchain = createSwapChainAndImages(*_deviceCaps, _device, _surface,
+				_graphicsQueueIndex, _presentQueueIndex, VK_NULL_HANDLE, swapchainFallbackExtent(), _presentPolicy, _swapchainExtraUsage,
+				_swapchainImages, _swapchainImageViews, _swapchainFormat, _swapchainExtent, _presentMode, _swapchainUsage);
+		}
+		else {
+			// no surface at all: render into a ring of images we own
+			_offscreen = createOffscreenImages(_allocator, _device, VK_FORMAT_B8G8R8A8_UNORM, options.extent,
+				std::max(3u, options.framesInFlight));
+			_swapchainImages = _offscreen.images;
+			_swapchainImageViews = _offscreen.imageViews;
+			_swapchainFormat = _offscreen.format;
+			_swapchainExtent = _offscreen.extent;
+			_swapchainUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+	});
+
+	// readback ring and output file; the frame graph adds the copy pass when this succeeded
+	uint32_t capture = addInitTask(g, "capture", InitTaskKind::Worker, { swapchain }, [&options]() {
+		if (options.capturePath.empty() || options.recordBench) {
+			return; // the record benchmark never submits what it records
+		}
+		if (!(_swapchainUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) || !isCaptureFormatSupported(_swapchainFormat)) {
+			std::cout << "capture:\tdisabled, the swapchain images cannot be copied\n";
+			return;
+		}
+		initFrameCapture(_capture, _allocator, options.capturePath, _swapchainFormat, _swapchainExtent,
+			options.framesInFlight, options.captureWorker);
+	});
+
+	uint32_t pipelineCache = addInitTask(g, "pipeline cache", InitTaskKind::Worker, { device }, [&options]() {
+		loadPipelineCache(_pipelineCache, _deviceCaps->properties, _device, options.pipelineCachePath,
+			isDeviceExtensionEnabled(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME));
+		initLayoutCache(_layoutCache, _device);
+	});
+
+	uint32_t triangleShaders = addInitTask(g, "triangle shaders", InitTaskKind::Worker, { device, pipelineCache }, []() {
+		_triangleVert = loadReflectedShader(_device, SHADER_DIR "triangle.vert.spv");
+		_triangleFrag = loadReflectedShader(_device, SHADER_DIR "triangle.frag.spv");
+		_pipelineLayout = getReflectedLayout(_layoutCache, { &_triangleVert.reflection, &_triangleFrag.reflection });
+	});
+
+	uint32_t particleShader = addInitTask(g, "particle shader", InitTaskKind::Worker, { device }, []() {
+		_particleShader = loadReflectedShader(_device, SHADER_DIR "particles.comp.spv");
+	});
+
+	// vertex data goes through the transfer queue; the first frame acquires it
+	uint32_t uploads = addInitTask(g, "vertex upload", InitTaskKind::Worker, { device }, [&options]() {
+		initUploadQueue(_uploads, _allocator, _deviceCaps->properties.limits, _transferQueue, _transferQueueIndex,
+			_graphicsQueueIndex, 4 * 1024 * 1024);
+		const Vertex vertices[3] = {
+			{ { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+			{ { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+			{ { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } },
+		};
+		_vertexBuffer = createBuffer(_allocator, sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			MemoryUsage::GpuOnly, _vertexAllocation);
+		setObjectName(_device, VK_OBJECT_TYPE_BUFFER, _vertexBuffer, "triangle vertices");
+		uploadBuffer(_uploads, _vertexBuffer, 0, vertices, sizeof(vertices), VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		flushUploads(_uploads);
+
+		_uploadStress = options.uploadStress;
+		if (_uploadStress > 0) {
+			_streamBuffer = createBuffer(_allocator, VkDeviceSize(_uploadStress) * 256, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				MemoryUsage::GpuOnly, _streamAllocation);
+		}
+	});
+
+	// buffers of the GPU-driven scene; the frame graph adds the cull passes when this succeeded
+	uint32_t objects = addInitTask(g, "objects", InitTaskKind::Worker, { uploads }, [&options]() {
+		if (options.objectCount == 0) {
+			return;
+		}
+		if (!_deviceCaps->features.drawIndirectFirstInstance) {
+			std::cout << "objects:	disabled, drawIndirectFirstInstance is not supported\n";
+			return;
+		}
+		initGpuScene(_scene, _allocator, _uploads, _deviceCaps->properties.limits, options.objectCount, options.framesInFlight,
+			deviceObjectDrawPath(), options.cpuCulling);
+	});
+
+	uint32_t objectShaders = addInitTask(g, "object shaders", InitTaskKind::Worker, { objects, pipelineCache }, []() {
+		if (isGpuSceneActive(_scene)) {
+			_objectVert = loadReflectedShader(_device, SHADER_DIR "objects.vert.spv");
+			_cullShader = loadReflectedShader(_device, SHADER_DIR "cull.comp.spv");
+		}
+	});
+
+	// render passes and framebuffers come from the frame graph
+	uint32_t frameGraph = addInitTask(g, "frame graph", InitTaskKind::Worker, { swapchain, capture, objects }, []() {
+		initRenderGraph(_frameGraph, _device, _allocator);
+		buildFrameGraph();
+	});
+
+	addInitTask(g, "particles", InitTaskKind::Worker, { device }, [&options]() {
+		initDescriptorAllocator(_descriptors, _device, options.framesInFlight, {
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } });
+		createParticleSystem(options.drawCount, options.framesInFlight);
+	});
+
+	// calibration submits on the graphics queue, which the uploads may share; the frame graph
+	// times its passes on the graphics queue
+	addInitTask(g, "profiler", InitTaskKind::Worker, { uploads, objects, frameGraph }, [&options]() {
+		initGpuProfiler(_profiler, _deviceCaps->properties, _deviceCaps->queueFamilies, _device);
+		_profileGraphics = addProfilerQueue(_profiler, "graphics", _graphicsQueueIndex);
+		_profileCompute = addProfilerQueue(_profiler, "compute", _computeQueueIndex);
+		createGpuProfilerFrames(_profiler, options.framesInFlight, 64);
+		calibrateGpuProfiler(_profiler, _profileGraphics, _graphicsQueue);
+		setRenderGraphProfiler(_frameGraph, &_profiler, _profileGraphics);
+		_tracePath = options.tracePath;
+	});
+
+	// until these are done frames only clear the backbuffer; they compile while frames are drawn,
+	// so their driver calls stay out of the per-frame host allocation arena
+	_scenePipelineTask = addInitTask(g, "scene pipeline", InitTaskKind::Background, { frameGraph, triangleShaders }, []() {
+		HostArenaBypass bypass;
+		_graphicsPipeline = createSceneGraphicsPipeline();
+	});
+	_particlePipelineTask = addInitTask(g, "particle pipeline", InitTaskKind::Background, { pipelineCache, particleShader }, []() {
+		HostArenaBypass bypass;
+		createParticlePipeline();
+	});
+	_objectPipelineTask = addInitTask(g, "object pipelines", InitTaskKind::Background, { frameGraph, objectShaders, triangleShaders }, []() {
+		HostArenaBypass bypass;
+		if (isGpuSceneActive(_scene)) {
+			createObjectPipelines();
+		}
+	});
+
+	uint32_t workers = options.serialInit ? 0 : std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+	startJobSystem(_initJobs, workers);
+	runInitGraph(g, &_initJobs);
+
+	std::cout << "present target:\t" << (window ? "window" : (useHeadlessSurface ? "VK_EXT_headless_surface" : "offscreen images"))
+		<< " " << _swapchainExtent.width << "x" << _swapchainExtent.height << " x" << _swapchainImages.size() << "\n";
+	std::cout << "queues:\t\tgraphics " << _graphicsQueueIndex << ", present " << _presentQueueIndex << ", transfer "
+		<< _transferQueueIndex << ", compute " << _computeQueueIndex << (isAsyncCompute(_compute) ? " (async)" : "") << "\n";
+}
+
+struct FrameResources {
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkFence inFlightFence = VK_NULL_HANDLE;
+	VkSemaphore imageAvailable = VK_NULL_HANDLE;
+	VkSemaphore renderFinished = VK_NULL_HANDLE;
+};
+
+// one slot per frame in flight; slot N is reused only after its fence signals
+std::vector<FrameResources> _frames;
+uint32_t _currentFrame = 0;
+uint64_t _frameNumber = 0;
+uint64_t _frameRingStalls = 0;          // times the CPU had to wait for a slot
+std::vector<VkFence> _imagesInFlight;   // fence of the frame last rendering into each image
+
+// CPU time spent in the phases of the last drawFrame()
+struct FrameTimings {
+	double acquireMs = 0.0;   // waiting for the slot's fence, the image and the image's fence
+	double recordMs = 0.0;
+	double submitMs = 0.0;
+	double presentMs = 0.0;
+};
+FrameTimings _frameTimings;
+
+FrameResources createFrameResources(VkDevice dev, uint32_t queue_index) {
+	FrameResources frame;
+
+	VkCommandPoolCreateInfo pool_ci = {};
+	pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	pool_ci.queueFamilyIndex = queue_index;
+	if (vkCreateCommandPool(dev, &pool_ci, hostAllocationCallbacks(), &frame.commandPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create command pool!");
+	}
+
+	VkCommandBufferAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = frame.commandPool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+	if (vkAllocateCommandBuffers(dev, &alloc_info, &frame.commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate command buffer!");
 	}
 
-	// create Physical Device
-	VkPhysicalDevice physicalDevice = pickPhysicalDevice(vkInst);
-	dumpDeviceStatus(physicalDevice);
+	VkFenceCreateInfo fence_ci = {};
+	fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_ci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	VkSemaphoreCreateInfo semaphore_ci = {};
+	semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	if (vkCreateFence(dev, &fence_ci, hostAllocationCallbacks(), &frame.inFlightFence) != VK_SUCCESS ||
+		vkCreateSemaphore(dev, &semaphore_ci, hostAllocationCallbacks(), &frame.imageAvailable) != VK_SUCCESS ||
+		vkCreateSemaphore(dev, &semaphore_ci, hostAllocationCallbacks(), &frame.renderFinished) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create frame sync objects!");
+	}
+	return frame;
+}
 
-	// create LogicalDevice
-	uint32_t gfxq_index;
-	uint32_t present_index;
-	VkDevice dev = createLogicalDevice(physicalDevice, surface, gfxq_index, present_index);
+void destroyFrameResources(VkDevice dev, FrameResources& frame) {
+	vkDestroySemaphore(dev, frame.renderFinished, hostAllocationCallbacks());
+	vkDestroySemaphore(dev, frame.imageAvailable, hostAllocationCallbacks());
+	vkDestroyFence(dev, frame.inFlightFence, hostAllocationCallbacks());
+	vkDestroyCommandPool(dev, frame.commandPool, hostAllocationCallbacks());
+	frame = FrameResources();
+}
 
-	// get DeviceQueue
-	VkQueue graphicsQueue;
-	vkGetDeviceQueue(dev, gfxq_index, 0, &graphicsQueue);
-	if (!glfwGetPhysicalDevicePresentationSupport(vkInst, physicalDevice, gfxq_index)) // vkGetPhysicalDeviceSurfaceSupportKHR
-	{
-		assert(0 && "Vulkan ERROR: Can't get device presentation support!!");
-		std::exit(-1);
-		return;
+// records draw items [first, first + count) of the draw list
+void recordDraws(VkCommandBuffer cmd, uint32_t first, uint32_t count) {
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(_swapchainExtent.width);
+	viewport.height = static_cast<float>(_swapchainExtent.height);
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor = {};
+	scissor.extent = _swapchainExtent;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+	VkBuffer vertexBuffers[2] = { _vertexBuffer, _particleBuffer };
+	VkDeviceSize vertexOffsets[2] = { 0, 0 };
+	vkCmdBindVertexBuffers(cmd, 0, 2, vertexBuffers, vertexOffsets);
+	uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(_drawCount))));
+	vkCmdPushConstants(cmd, _pipelineLayout.layout, _pipelineLayout.pushConstantStages, 0, sizeof(columns), &columns);
+	for (uint32_t i = first; i < first + count; i++) {
+		vkCmdDraw(cmd, 3, 1, 0, i);
 	}
+}
 
-	// create swapchain and Images, ImageViews
-	std::vector<VkImage> swapChainImages;
-	std::vector<VkImageView> swapChainImageViews;
-	VkSwapchainKHR swapchain = createSwapChainAndImages(physicalDevice, dev, surface,
-		gfxq_index, present_index,
-		swapChainImages, swapChainImageViews);
+void recordFrame(VkCommandBuffer cmd, uint32_t frameIndex, uint32_t imageIndex, const VkClearColorValue& color) {
+	VkClearValue clearValue = {};
+	clearValue.color = color;
+	setGraphClearValue(_frameGraph, _backbuffer, clearValue);
+	setGraphImage(_frameGraph, _backbuffer, _swapchainImages[imageIndex], _swapchainImageViews[imageIndex]);
+	if (isGpuSceneActive(_scene)) {
+		setGraphBuffer(_frameGraph, _sceneObjects, _scene.objects);
+		setGraphBuffer(_frameGraph, _sceneCommands, _scene.commands);
+		setGraphBuffer(_frameGraph, _sceneVisible, _scene.visible);
+		setGraphBuffer(_frameGraph, _sceneCounts, _scene.counts);
+	}
+	// the object draws are a handful of calls; they stay in the primary command buffer
+	setGraphPassSecondary(_frameGraph, _scenePass, parallelRecorderWorkerCount(_recorder) > 0 && !isGpuSceneActive(_scene));
+	executeRenderGraph(_frameGraph, cmd, frameIndex);
+}
 
-	// create Pipeline
-	VkPipelineLayout pipeline = createPipelineLayout(dev);
+void createFrameRing(uint32_t framesInFlight) {
+	_frames.resize(framesInFlight);
+	for (auto& frame : _frames) {
+		frame = createFrameResources(_device, _graphicsQueueIndex);
+		setObjectName(_device, VK_OBJECT_TYPE_COMMAND_BUFFER, frame.commandBuffer, "frame");
+	}
+	_imagesInFlight.assign(_swapchainImages.size(), VK_NULL_HANDLE);
+	_currentFrame = 0;
+}
 
-	// create RenderPass
+void destroyFrameRing() {
+	for (auto& frame : _frames) {
+		destroyFrameResources(_device, frame);
+	}
+	_frames.clear();
+	_imagesInFlight.clear();
+}
 
+void waitForFence(VkFence fence) {
+	if (vkGetFenceStatus(_device, fence) == VK_NOT_READY) {
+		_frameRingStalls++;
+		vkWaitForFences(_device, 1, &fence, VK_TRUE, UINT64_MAX);
+	}
+}
+
+// Builds a new swapchain from the current one without waiting for the device. Views,
+// framebuffers and the retired swapchain may still be used by frames in flight, so they go
+// to the deletion queue and are destroyed once those frames' fences have signaled.
+bool recreateSwapchain() {
+	if (isWindowMinimized()) {
+		return false;
+	}
+	waitInitTask(_initGraph, _scenePipelineTask); // they compile against the render pass released below
+	waitInitTask(_initGraph, _objectPipelineTask);
+	VkSwapchainKHR oldSwapchain = _swapchain;
+	std::vector<VkImageView> oldViews = _swapchainImageViews;
+	VkFormat oldFormat = _swapchainFormat;
+
+	_swapchain = createSwapChainAndImages(*_deviceCaps, _device, _surface,
+		_graphicsQueueIndex, _presentQueueIndex, oldSwapchain, swapchainFallbackExtent(), _presentPolicy, _swapchainExtraUsage,
+		_swapchainImages, _swapchainImageViews, _swapchainFormat, _swapchainExtent, _presentMode, _swapchainUsage);
+
+	VkDevice dev = _device;
+	deferDeletion(_deletions, _frameNumber, [dev, oldSwapchain, oldViews]() {
+		for (auto view : oldViews) {
+			vkDestroyImageView(dev, view, hostAllocationCallbacks());
+		}
+		vkDestroySwapchainKHR(dev, oldSwapchain, hostAllocationCallbacks());
+	});
+
+	// the graph's framebuffers and transient images depend on the extent
+	DeviceMemoryAllocator* allocator = &_allocator;
+	std::shared_ptr<RenderGraphObjects> oldGraph = std::make_shared<RenderGraphObjects>(releaseRenderGraph(_frameGraph));
+	deferDeletion(_deletions, _frameNumber, [dev, allocator, oldGraph]() {
+		destroyRenderGraphObjects(dev, *allocator, *oldGraph);
+	});
+	buildFrameGraph();
+
+	// render pass compatibility depends on the format, which a surface change can alter
+	if (_swapchainFormat != oldFormat) {
+		VkPipeline oldPipeline = _graphicsPipeline;
+		_graphicsPipeline = createSceneGraphicsPipeline();
+		deferDeletion(_deletions, _frameNumber, [dev, oldPipeline]() {
+			vkDestroyPipeline(dev, oldPipeline, hostAllocationCallbacks());
+		});
+		if (_scene.pipeline != VK_NULL_HANDLE) {
+			VkPipeline oldObjectPipeline = _scene.pipeline;
+			_scene.pipeline = createObjectGraphicsPipeline();
+			deferDeletion(_deletions, _frameNumber, [dev, oldObjectPipeline]() {
+				vkDestroyPipeline(dev, oldObjectPipeline, hostAllocationCallbacks());
+			});
+		}
+	}
+
+	_imagesInFlight.assign(_swapchainImages.size(), VK_NULL_HANDLE);
+	_swapchainDirty = false;
+	_swapchainRecreations++;
+	return true;
+}
+
+void drawFrame() {
+	beginHostAllocatorFrame();
+	if (_swapchainDirty && !recreateSwapchain()) {
+		return; // minimized; nothing to present to
+	}
+
+	// the CPU only blocks here when every slot of the ring is still queued on the GPU
+	FrameResources& frame = _frames[_currentFrame];
+	double frameStart = profilerNowUs(_profiler);
+	waitForFence(frame.inFlightFence);
+	beginProfilerFrame(_profiler, _currentFrame, _frameNumber);  // also resolves this slot's previous timestamps
+	uint64_t slots = _frames.size();
+	uint64_t completedFrames = _frameNumber >= slots ? _frameNumber - slots + 1 : 0;
+	flushDeletionQueue(_deletions, completedFrames);
+	resetDescriptorFrame(_descriptors, _currentFrame);
+	if (isFrameCaptureActive(_capture)) {
+		collectFrameCapture(_capture, _currentFrame);
+	}
+	if (isGpuSceneActive(_scene)) {
+		collectGpuSceneStats(_scene, _currentFrame);
+	}
+	addCpuScope(_profiler, "wait frame", frameStart, profilerNowUs(_profiler));
+
+	// acquire
+	uint32_t cpuScope = beginCpuScope(_profiler, "acquire");
+	uint32_t imageIndex;
+	if (_swapchain != VK_NULL_HANDLE) {
+		VkResult result = vkAcquireNextImageKHR(_device, _swapchain, UINT64_MAX, frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			// the semaphore was not signaled and the fence is untouched; retry with a new swapchain
+			_swapchainDirty = true;
+			endCpuScope(_profiler, cpuScope);
+			return;
+		}
+		if (result == VK_SUBOPTIMAL_KHR) {
+			_swapchainDirty = true; // still presentable, recreate after this frame
+		}
+		else if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to acquire swap chain image!");
+		}
+	}
+	else {
+		imageIndex = acquireOffscreenImage(_offscreen);
+	}
+
+	// the image may still be written by an older slot when images are acquired out of order
+	if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE && _imagesInFlight[imageIndex] != frame.inFlightFence) {
+		waitForFence(_imagesInFlight[imageIndex]);
+	}
+	_imagesInFlight[imageIndex] = frame.inFlightFence;
+	vkResetFences(_device, 1, &frame.inFlightFence);
+	endCpuScope(_profiler, cpuScope);
+	double phaseStart = profilerNowUs(_profiler);
+	_frameTimings.acquireMs = (phaseStart - frameStart) / 1000.0;
+
+	// stream uploads; frames before this slot's previous use are known to be done
+	cpuScope = beginCpuScope(_profiler, "uploads");
+	collectUploads(_uploads, completedFrames);
+	if (_uploadStress > 0) {
+		uint8_t payload[256];
+		memset(payload, static_cast<int>(_frameNumber & 0xff), sizeof(payload));
+		for (uint32_t i = 0; i < _uploadStress; i++) {
+			uploadBuffer(_uploads, _streamBuffer, VkDeviceSize(i) * sizeof(payload), payload, sizeof(payload), VK_ACCESS_TRANSFER_WRITE_BIT);
+		}
+	}
+	flushUploads(_uploads);
+	endCpuScope(_profiler, cpuScope);
+
+	// record
+	cpuScope = beginCpuScope(_profiler, "record");
+	vkResetCommandPool(_device, frame.commandPool, 0);
+	resetParallelRecorderFrame(_recorder, _currentFrame);
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(frame.commandBuffer, &begin_info);
+	beginProfilerCommandBuffer(_profiler, frame.commandBuffer, _profileGraphics);
+
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<VkPipelineStageFlags> waitStages;
+	if (_swapchain != VK_NULL_HANDLE) {
+		waitSemaphores.push_back(frame.imageAvailable);
+		waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	}
+	acquireUploads(_uploads, frame.commandBuffer, _frameNumber, frame.inFlightFence, waitSemaphores, waitStages);
+
+	// the simulation overlaps with the previous frame's rasterization; only vertex input waits for it
+	if (!_sceneReady) {
+		_sceneReady = isInitTaskDone(_initGraph, _scenePipelineTask) && isInitTaskDone(_initGraph, _particlePipelineTask)
+			&& isInitTaskDone(_initGraph, _objectPipelineTask);
+	}
+	if (_sceneReady && !isGpuSceneActive(_scene)) {
+		waitSemaphores.push_back(simulateParticles(_currentFrame, _drawCount));
+		waitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	}
+
+	float t = static_cast<float>(_frameNumber % 120) / 120.0f;
+	VkClearColorValue color = { { t, 0.2f, 1.0f - t, 1.0f } };
+	if (isGpuSceneActive(_scene)) {
+		updateGpuSceneView(_scene, _swapchainExtent);
+	}
+	recordFrame(frame.commandBuffer, _currentFrame, imageIndex, color);
+
+	vkEndCommandBuffer(frame.commandBuffer);
+	endCpuScope(_profiler, cpuScope);
+	double now = profilerNowUs(_profiler);
+	_frameTimings.recordMs = (now - phaseStart) / 1000.0;
+	phaseStart = now;
+
+	// submit
+	cpuScope = beginCpuScope(_profiler, "submit");
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submit_info.pWaitSemaphores = waitSemaphores.data();
+	submit_info.pWaitDstStageMask = waitStages.data();
+	if (_swapchain != VK_NULL_HANDLE) {
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores = &frame.renderFinished;
+	}
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &frame.commandBuffer;
+	if (vkQueueSubmit(_graphicsQueue, 1, &submit_info, frame.inFlightFence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit draw command buffer!");
+	}
+	endProfilerFrame(_profiler);
+	endCpuScope(_profiler, cpuScope);
+	now = profilerNowUs(_profiler);
+	_frameTimings.submitMs = (now - phaseStart) / 1000.0;
+	phaseStart = now;
+
+	// present
+	if (_swapchain != VK_NULL_HANDLE) {
+		cpuScope = beginCpuScope(_profiler, "present");
+		VkPresentInfoKHR present_info = {};
+		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		present_info.waitSemaphoreCount = 1;
+		present_info.pWaitSemaphores = &frame.renderFinished;
+		present_info.swapchainCount = 1;
+		present_info.pSwapchains = &_swapchain;
+		present_info.pImageIndices = &imageIndex;
+		VkResult result = vkQueuePresentKHR(_presentQueue, &present_info);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+			_swapchainDirty = true;
+		}
+		else if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to present swap chain image!");
+		}
+		endCpuScope(_profiler, cpuScope);
+	}
+	_frameTimings.presentMs = (profilerNowUs(_profiler) - phaseStart) / 1000.0;
+	_frameNumber++;
+	_currentFrame = (_currentFrame + 1) % static_cast<uint32_t>(_frames.size());
 }
 
 /*
@@ -412,24 +1400,412 @@ void cleanupSwapChain(VkDevice device) {
 }*/
 
 void vulkanCleanup(VkInstance instance, VkSurfaceKHR surface, VkDevice device, VkSwapchainKHR swapchain) {
-	// cleanupSwapChain();
-	vkDestroySurfaceKHR(instance, surface, nullptr);
-	vkDestroyInstance(instance, nullptr);
+	waitInitGraph(_initGraph);
+	stopJobSystem(_initJobs);
+	dumpInitGraphStats(_initGraph);
+	vkDeviceWaitIdle(device);
+	finishFrameCapture(_capture);
+	dumpFrameCaptureStats(_capture);
+	destroyFrameCapture(_capture);
+	flushAllDeletions(_deletions);
+	if (_swapchainRecreations) {
+		std::cout << "swapchain:	" << _swapchainRecreations << " recreations, " << _deletions.deleted << " deferred deletions\n";
+	}
+	destroyParallelRecorder(_recorder);
+	destroyFrameRing();
+	flushGpuProfiler(_profiler);
+	dumpGpuProfilerStats(_profiler);
+	if (!_tracePath.empty()) {
+		if (writeChromeTrace(_profiler, _tracePath)) {
+			std::cout << "trace:		" << _tracePath << " (" << _profiler.events.size() << " events)\n";
+		}
+		else {
+			std::cout << "trace:		failed to write " << _tracePath << "\n";
+		}
+	}
+	destroyGpuProfiler(_profiler);
+	destroyParticleSystem();
+	dumpGpuSceneStats(_scene);
+	destroyGpuScene(_scene, device);
+	dumpDescriptorAllocatorStats(_descriptors);
+	destroyDescriptorAllocator(_descriptors);
+	dumpUploadStats(_uploads);
+	destroyUploadQueue(_uploads);
+	destroyBuffer(_allocator, _vertexBuffer, _vertexAllocation);
+	if (_streamBuffer != VK_NULL_HANDLE) {
+		destroyBuffer(_allocator, _streamBuffer, _streamAllocation);
+	}
+
+	savePipelineCache(_pipelineCache);
+	dumpPipelineCacheStats(_pipelineCache);
+	destroyPipelineCache(_pipelineCache);
+	vkDestroyPipeline(device, _graphicsPipeline, hostAllocationCallbacks());
+	destroyReflectedShader(device, _triangleVert);
+	destroyReflectedShader(device, _triangleFrag);
+	destroyReflectedShader(device, _objectVert);
+	destroyReflectedShader(device, _cullShader);
+	dumpLayoutCacheStats(_layoutCache);
+	destroyLayoutCache(_layoutCache);
+	_pipelineLayout = ReflectedLayout();
+	dumpRenderGraphStats(_frameGraph);
+	destroyRenderGraph(_frameGraph);
+	if (swapchain != VK_NULL_HANDLE) {
+		for (size_t i = 0; i < _swapchainImageViews.size(); i++) {
+			vkDestroyImageView(device, _swapchainImageViews[i], hostAllocationCallbacks());
+		}
+		vkDestroySwapchainKHR(device, swapchain, hostAllocationCallbacks());
+	}
+	else {
+		destroyOffscreenImages(_allocator, device, _offscreen);
+	}
+	dumpMemoryStats(_allocator);
+	destroyDeviceMemoryAllocator(_allocator);
+	vkDestroyDevice(device, hostAllocationCallbacks());
+	if (surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(instance, surface, hostAllocationCallbacks());
+	}
+	dumpDebugUtilsStats();
+	destroyDebugUtils(instance);
+	vkDestroyInstance(instance, hostAllocationCallbacks());
+	unloadVulkanLibrary();
+	dumpHostAllocatorStats();
 }
 
-int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    window = glfwCreateWindow(300,400, "vukan tutorial",nullptr,nullptr );
+SampleOptions parseOptions(int argc, char* argv[]) {
+	SampleOptions options;
+	bool drawsGiven = false;
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--headless") == 0) {
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--offscreen") == 0) {
+			options.headless = true;
+			options.forceOffscreen = true;
+		}
+		else if (strcmp(arg, "--frames") == 0 && hasValue) {
+			options.frameCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(arg, "--frames-in-flight") == 0 && hasValue) {
+			options.framesInFlight = std::min(3u, std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10))));
+		}
+		else if (strcmp(arg, "--pipeline-cache") == 0 && hasValue) {
+			options.pipelineCachePath = argv[++i];
+		}
+		else if (strcmp(arg, "--no-pipeline-cache") == 0) {
+			options.pipelineCachePath.clear();
+		}
+		else if (strcmp(arg, "--caps-cache") == 0 && hasValue) {
+			options.capsCachePath = argv[++i];
+		}
+		else if (strcmp(arg, "--no-caps-cache") == 0) {
+			options.capsCachePath.clear();
+		}
+		else if (strcmp(arg, "--dump-caps") == 0 && hasValue) {
+			options.dumpCapsPath = argv[++i];
+		}
+		else if (strcmp(arg, "--serial-init") == 0) {
+			options.serialInit = true;
+		}
+		else if (strcmp(arg, "--capture") == 0 && hasValue) {
+			options.capturePath = argv[++i];
+		}
+		else if (strcmp(arg, "--capture-worker") == 0) {
+			options.captureWorker = true;
+		}
+		else if (strcmp(arg, "--host-allocator") == 0) {
+			options.hostAllocator = true;
+		}
+		else if (strcmp(arg, "--draws") == 0 && hasValue) {
+			options.drawCount = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+			drawsGiven = true;
+		}
+		else if (strcmp(arg, "--record-threads") == 0 && hasValue) {
+			options.recordThreads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(arg, "--record-bench") == 0) {
+			options.recordBench = true;
+		}
+		else if (strcmp(arg, "--objects") == 0 && hasValue) {
+			options.objectCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(arg, "--cpu-culling") == 0) {
+			options.cpuCulling = true;
+		}
+		else if (strcmp(arg, "--objects-bench") == 0) {
+			options.objectsBench = 262144;
+			if (hasValue && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+				options.objectsBench = std::max(1024u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+			}
+		}
+		else if (strcmp(arg, "--upload-stress") == 0 && hasValue) {
+			options.uploadStress = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(arg, "--trace") == 0 && hasValue) {
+			options.tracePath = argv[++i];
+		}
+		else if (strcmp(arg, "--bench") == 0 && hasValue) {
+			options.benchFrames = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+		}
+		else if (strcmp(arg, "--bench-warmup") == 0 && hasValue) {
+			options.benchWarmup = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(arg, "--bench-json") == 0 && hasValue) {
+			options.benchJsonPath = argv[++i];
+		}
+		else if (strcmp(arg, "--bench-csv") == 0 && hasValue) {
+			options.benchCsvPath = argv[++i];
+		}
+		else if (strcmp(arg, "--present-profile") == 0 && hasValue && parsePresentProfile(argv[i + 1], options.presentProfile)) {
+			i++;
+		}
+		else if (strcmp(arg, "--fps-limit") == 0 && hasValue) {
+			options.fpsLimit = strtod(argv[++i], nullptr);
+		}
+		else if (strcmp(arg, "--width") == 0 && hasValue) {
+			options.extent.width = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(arg, "--height") == 0 && hasValue) {
+			options.extent.height = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else {
+			std::cout << "usage: clearSample [--headless] [--offscreen] [--frames N] [--frames-in-flight 1-3] [--width W] [--height H]"
+				" [--pipeline-cache PATH | --no-pipeline-cache] [--caps-cache PATH | --no-caps-cache] [--dump-caps PATH]"
+				" [--host-allocator] [--serial-init] [--capture PATH [--capture-worker]]"
+				" [--draws N] [--record-threads N] [--record-bench] [--upload-stress N] [--trace PATH]"
+				" [--objects N [--cpu-culling]] [--objects-bench [N]]"
+				" [--bench N [--bench-warmup N] [--bench-json PATH] [--bench-csv PATH]]"
+				" [--present-profile latency|throughput|power] [--fps-limit N]\n";
+			std::exit(strcmp(arg, "--help") == 0 ? 0 : -1);
+		}
+	}
+	if (options.recordBench && !drawsGiven) {
+		options.drawCount = 50000;
+	}
+	if (options.objectsBench > 0) {
+		options.objectCount = options.objectsBench; // the largest run sizes the scene's first allocation
+		options.cpuCulling = false;
+	}
+	if (options.benchFrames > 0) {
+		options.frameCount = options.benchWarmup + options.benchFrames;
+	}
+	options.presentPolicy = makePresentPolicy(options.presentProfile, options.fpsLimit);
+	if (options.framesInFlight == 0) {
+		options.framesInFlight = options.presentPolicy.framesInFlight;
+	}
+	options.presentPolicy.framesInFlight = options.framesInFlight;
+	if (options.headless && options.frameCount == 0) {
+		options.frameCount = 1000; // headless runs must terminate
+	}
+	return options;
+}
 
-	vulkanInit(window);
-	
-    while (!glfwWindowShouldClose(window));
-    {
-        glfwPollEvents();
-    }
-
-	//vulkanCleanup();
-	glfwDestroyWindow(window);
-}
\ No newline at end of file
+void runFrameLoop(GLFWwindow* window, const SampleOptions& options) {
+	createFrameRing(options.framesInFlight);
+
+	FrameBench bench;
+	if (options.benchFrames > 0) {
+		waitInitGraph(_initGraph); // measure full frames only, not the clears before the pipelines exist
+		// interval: present to present, input latency: input sampling to present (present_policy.h)
+		initFrameBench(bench, options.benchWarmup, options.benchFrames,
+			{ "frame", "acquire", "record", "submit", "present", "interval", "input latency" });
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t firstFrame = _frameNumber;
+	initFramePacer(_pacer, _presentPolicy);
+	while (options.frameCount == 0 || _frameNumber - firstFrame < options.frameCount) {
+		auto frameStart = std::chrono::steady_clock::now();
+		pacerBeforeInput(_pacer); // input is sampled by glfwPollEvents below
+		if (window) {
+			glfwPollEvents();
+			if (glfwWindowShouldClose(window)) {
+				break;
+			}
+			if (isWindowMinimized()) {
+				glfwWaitEvents();
+				continue;
+			}
+		}
+		uint64_t frameNumber = _frameNumber;
+		drawFrame();
+		if (_frameNumber == frameNumber) {
+			continue; // skipped: the swapchain was out of date
+		}
+		noteInitFirstFrame(_initGraph);
+		pacerAfterPresent(_pacer);
+		if (options.benchFrames > 0) {
+			double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+			if (addFrameBenchSample(bench, { frameMs, _frameTimings.acquireMs, _frameTimings.recordMs,
+				_frameTimings.submitMs, _frameTimings.presentMs, _pacer.lastIntervalMs, _pacer.lastInputToPresentMs })) {
+				bench.elapsedMs += frameMs;
+			}
+		}
+	}
+	vkDeviceWaitIdle(_device);
+
+	uint64_t frames = _frameNumber - firstFrame;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << frames << " frames in " << seconds * 1000.0 << " ms ("
+		<< frames / seconds << " fps), " << options.framesInFlight << " frames in flight, "
+		<< _frameRingStalls << " CPU waits on a full ring\n";
+	dumpFramePacer(_pacer, _presentPolicy, _swapchain != VK_NULL_HANDLE ? presentModeName(_presentMode) : "none",
+		static_cast<uint32_t>(_swapchainImages.size()));
+
+	if (options.benchFrames > 0) {
+		if (!isFrameBenchDone(bench)) {
+			std::cout << "benchmark: window closed before the run finished\n";
+		}
+		bench.info.push_back({ "device", _deviceCaps->properties.deviceName });
+		bench.info.push_back({ "present_target", _swapchain != VK_NULL_HANDLE ? (window ? "window" : "headless_surface") : "offscreen" });
+		bench.info.push_back({ "extent", std::to_string(_swapchainExtent.width) + "x" + std::to_string(_swapchainExtent.height) });
+		bench.info.push_back({ "draws", std::to_string(_drawCount) });
+		bench.info.push_back({ "frames_in_flight", std::to_string(options.framesInFlight) });
+		bench.info.push_back({ "present_profile", presentProfileName(_presentPolicy.profile) });
+		bench.info.push_back({ "present_mode", _swapchain != VK_NULL_HANDLE ? presentModeName(_presentMode) : "none" });
+		bench.info.push_back({ "record_threads", std::to_string(options.recordThreads) });
+		bench.info.push_back({ "objects", isGpuSceneActive(_scene) ? std::to_string(_scene.count) + " " + objectDrawPathName(_scene.path) : "none" });
+		printFrameBench(bench);
+		if (!options.benchJsonPath.empty() && !writeFrameBenchJson(bench, options.benchJsonPath)) {
+			std::cout << "benchmark: failed to write " << options.benchJsonPath << "\n";
+		}
+		if (!options.benchCsvPath.empty() && !writeFrameBenchCsv(bench, options.benchCsvPath)) {
+			std::cout << "benchmark: failed to write " << options.benchCsvPath << "\n";
+		}
+	}
+}
+
+// Records the draw list into frame slot 0 without submitting it, inline and then with
+// 1, 2, 4 .. hardware_concurrency worker threads, and reports CPU time per frame.
+void runRecordBenchmark() {
+	const uint32_t iterations = 20;
+	uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<uint32_t> threadCounts = { 0 };
+	for (uint32_t threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	waitInitGraph(_initGraph);
+	_sceneReady = true;
+	setRenderGraphProfiler(_frameGraph, nullptr, 0);  // the frames are recorded, never submitted
+	createFrameRing(1);
+	FrameResources& frame = _frames[0];
+	VkClearColorValue color = { { 0.0f, 0.2f, 1.0f, 1.0f } };
+	std::cout << "record benchmark: " << _drawCount << " draws, " << iterations << " frames per run\n";
+	std::cout << "  threads\tms/frame\tdraws/ms\tspeedup\n";
+
+	double inlineMs = 0.0;
+	for (uint32_t threads : threadCounts) {
+		destroyParallelRecorder(_recorder);
+		initParallelRecorder(_recorder, _device, _graphicsQueueIndex, 1, threads);
+
+		double totalMs = 0.0;
+		for (uint32_t i = 0; i < iterations + 1; i++) {
+			vkResetCommandPool(_device, frame.commandPool, 0);
+			resetParallelRecorderFrame(_recorder, 0);
+
+			auto start = std::chrono::steady_clock::now();
+			VkCommandBufferBeginInfo begin_info = {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			vkBeginCommandBuffer(frame.commandBuffer, &begin_info);
+			recordFrame(frame.commandBuffer, 0, 0, color);
+			vkEndCommandBuffer(frame.commandBuffer);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (i > 0) { // first run allocates the secondary command buffers
+				totalMs += ms;
+			}
+		}
+		double msPerFrame = totalMs / iterations;
+		if (threads == 0) {
+			inlineMs = msPerFrame;
+		}
+		std::cout << "  " << (threads ? std::to_string(threads) : std::string("inline")) << "\t\t" << msPerFrame << "\t\t"
+			<< _drawCount / msPerFrame << "\t\t" << inlineMs / msPerFrame << "x\n";
+	}
+}
+
+// Draws the object scene for 1024, 4096 .. maxCount objects, culled on the GPU and drawn
+// indirectly, then culled on the CPU with one draw each, and reports frame and record time.
+// Both runs of a count follow the same camera path.
+void runObjectsBenchmark(const SampleOptions& options) {
+	const uint32_t warmup = 30;
+	const uint32_t frames = 120;
+	waitInitGraph(_initGraph);
+	createFrameRing(options.framesInFlight);
+	if (!isGpuSceneActive(_scene)) {
+		std::cout << "objects benchmark: the object scene is not available on this device\n";
+		return;
+	}
+	ObjectDrawPath gpuPath = deviceObjectDrawPath();
+	std::cout << "objects benchmark: " << frames << " frames per run after " << warmup << ", gpu path " << objectDrawPathName(gpuPath) << "\n";
+	std::cout << "  objects\tculling\tms/frame\trecord ms\tvisible\tdraws\tdraw calls\n";
+	for (uint32_t count = 1024; count <= options.objectsBench; count *= 4) {
+		vkDeviceWaitIdle(_device);
+		destroyGpuSceneObjects(_scene);
+		initGpuScene(_scene, _allocator, _uploads, _deviceCaps->properties.limits, count, options.framesInFlight, gpuPath, false);
+		for (bool cpuDraws : { false, true }) {
+			setGpuSceneCpuDraws(_scene, cpuDraws);
+			double frameMs = 0.0;
+			double recordMs = 0.0;
+			for (uint32_t i = 0; i < warmup + frames; i++) {
+				if (i == warmup) {
+					resetGpuSceneStats(_scene);
+					frameMs = 0.0;
+					recordMs = 0.0;
+				}
+				auto start = std::chrono::steady_clock::now();
+				drawFrame();
+				frameMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				recordMs += _frameTimings.recordMs;
+			}
+			vkDeviceWaitIdle(_device);
+			for (uint32_t slot = 0; slot < options.framesInFlight; slot++) {
+				collectGpuSceneStats(_scene, slot);
+			}
+			uint64_t measured = std::max<uint64_t>(1, _scene.frames);
+			std::cout << "  " << count << "\t\t" << (cpuDraws ? "cpu" : "gpu") << "\t" << frameMs / frames << "\t\t" << recordMs / frames
+				<< "\t\t" << _scene.visibleObjects / measured << "\t" << _scene.draws / measured << "\t"
+				<< static_cast<double>(_scene.drawCalls) / frames << "\n";
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	SampleOptions options = parseOptions(argc, argv);
+	if (options.hostAllocator) {
+		enableHostAllocator(1024 * 1024);
+	}
+
+	if (!options.headless) {
+		glfwInit();
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		window = glfwCreateWindow(static_cast<int>(options.extent.width), static_cast<int>(options.extent.height),
+			"vukan tutorial", nullptr, nullptr);
+		glfwSetFramebufferSizeCallback(window, [](GLFWwindow*, int, int) { _swapchainDirty = true; });
+	}
+
+	vulkanInit(window, options);
+	_drawCount = options.drawCount;
+	initParallelRecorder(_recorder, _device, _graphicsQueueIndex, options.framesInFlight, options.recordThreads);
+
+	if (options.recordBench) {
+		runRecordBenchmark();
+	}
+	else if (options.objectsBench > 0) {
+		runObjectsBenchmark(options);
+	}
+	else {
+		runFrameLoop(window, options);
+	}
+
+	vulkanCleanup(_instance, _surface, _device, _swapchain);
+	if (window) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+	return 0;
+}
@@ -0,0 +1,828 @@
+#pragma once
+
+// Device memory sub-allocator.
+// vkAllocateMemory is called once per large block and resources are carved out of
+// those blocks, so the sample stays far below maxMemoryAllocationCount.
+//
+//  - default blocks : TLSF (two-level segregated fit), O(1) allocate and free
+//  - linear pools   : bump allocator, released all at once (per-frame transient data)
+//  - ring pools     : FIFO allocator for streaming data (staging uploads, readbacks)
+//
+// Host-visible blocks are mapped once when they are created and stay mapped.
+
+#include "vk_dispatch.h"
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+#include "host_allocator.h"
+
+enum class MemoryUsage {
+	GpuOnly,    // device local, never mapped
+	Upload,     // host visible, written by the CPU and read once by the GPU
+	Readback,   // host visible and cached, written by the GPU and read by the CPU
+};
+
+enum class BlockStrategy {
+	Tlsf,
+	Linear,
+	Ring,
+};
+
+// tiling of the resource bound to a range; linear and optimal resources must not share
+// a bufferImageGranularity page
+enum class ResourceTiling : uint8_t {
+	Free,
+	Linear,     // buffers and VK_IMAGE_TILING_LINEAR images
+	Optimal,    // VK_IMAGE_TILING_OPTIMAL images
+};
+
+static const uint32_t kInvalidRange = UINT32_MAX;
+static const uint32_t kTlsfSlBits = 5;
+static const uint32_t kTlsfSlCount = 1 << kTlsfSlBits;
+static const uint32_t kTlsfFlCount = 64 - kTlsfSlBits + 1;
+
+struct MemoryRange {
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint32_t prevPhys = kInvalidRange;
+	uint32_t nextPhys = kInvalidRange;
+	uint32_t prevFree = kInvalidRange;
+	uint32_t nextFree = kInvalidRange;
+	ResourceTiling tiling = ResourceTiling::Free;
+};
+
+struct RingEntry {
+	VkDeviceSize offset;
+	VkDeviceSize end;
+	bool released;
+};
+
+struct MemoryBlock {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	uint32_t memoryType = 0;
+	BlockStrategy strategy = BlockStrategy::Tlsf;
+	uint8_t* mapped = nullptr;
+	bool dedicated = false;
+	VkDeviceSize usedBytes = 0;
+	uint32_t allocationCount = 0;
+
+	// Tlsf
+	std::vector<MemoryRange> ranges;
+	std::vector<uint32_t> unusedRanges;
+	uint32_t firstRange = kInvalidRange;
+	uint64_t flBitmap = 0;
+	uint32_t slBitmap[kTlsfFlCount] = {};
+	uint32_t freeHeads[kTlsfFlCount][kTlsfSlCount];
+
+	// Linear / Ring
+	ResourceTiling poolTiling = ResourceTiling::Linear;
+	VkDeviceSize head = 0;
+	std::deque<RingEntry> ringEntries;
+};
+
+struct MemoryAllocation {
+	MemoryBlock* block = nullptr;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint32_t range = kInvalidRange;
+	void* mapped = nullptr; // persistently mapped pointer at offset, nullptr for device-only memory
+};
+
+struct DeviceMemoryAllocator {
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	VkDeviceSize bufferImageGranularity = 1;
+	VkDeviceSize nonCoherentAtomSize = 1;
+	uint32_t maxMemoryAllocationCount = 0;
+	VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024;
+	uint32_t deviceMemoryCount = 0;
+	std::vector<std::unique_ptr<MemoryBlock>> blocks[VK_MAX_MEMORY_TYPES]; // Tlsf and dedicated
+	std::vector<std::unique_ptr<MemoryBlock>> pools;                       // Linear and Ring
+	std::mutex mutex;
+};
+
+inline uint32_t highestBit(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, v);
+	return index;
+#else
+	return 63 - __builtin_clzll(v);
+#endif
+}
+
+inline uint32_t lowestBit(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return index;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+inline uint32_t countBits(uint32_t v) {
+	uint32_t count = 0;
+	for (; v; v &= v - 1) {
+		count++;
+	}
+	return count;
+}
+
+inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+inline bool onSamePage(VkDeviceSize lastByteA, VkDeviceSize firstByteB, VkDeviceSize pageSize) {
+	return (lastByteA & ~(pageSize - 1)) == (firstByteB & ~(pageSize - 1));
+}
+
+// ---------------------------------------------------------------------------
+// memory type selection
+
+uint32_t chooseMemoryType(const VkPhysicalDeviceMemoryProperties& props, uint32_t typeBits, MemoryUsage usage) {
+	VkMemoryPropertyFlags required = 0, preferred = 0, avoided = 0;
+	switch (usage) {
+	case MemoryUsage::GpuOnly:
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		break;
+	case MemoryUsage::Upload:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT; // keep the small BAR heap free
+		break;
+	case MemoryUsage::Readback:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		break;
+	}
+	avoided |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT;
+
+	uint32_t best = UINT32_MAX;
+	int bestScore = -1000;
+	for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+		VkMemoryPropertyFlags flags = props.memoryTypes[i].propertyFlags;
+		if (!(typeBits & (1u << i)) || (flags & required) != required) {
+			continue;
+		}
+		int score = 2 * static_cast<int>(countBits(flags & preferred)) - static_cast<int>(countBits(flags & avoided));
+		if (score > bestScore) {
+			bestScore = score;
+			best = i;
+		}
+	}
+	if (best == UINT32_MAX) {
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+	return best;
+}
+
+// ---------------------------------------------------------------------------
+// TLSF block
+
+void tlsfMapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl) {
+	if (size < kTlsfSlCount) {
+		fl = 0;
+		sl = static_cast<uint32_t>(size);
+	}
+	else {
+		uint32_t msb = highestBit(size);
+		fl = msb - kTlsfSlBits + 1;
+		sl = static_cast<uint32_t>(size >> (msb - kTlsfSlBits)) ^ kTlsfSlCount;
+	}
+}
+
+uint32_t tlsfNewRange(MemoryBlock& b) {
+	if (!b.unusedRanges.empty()) {
+		uint32_t index = b.unusedRanges.back();
+		b.unusedRanges.pop_back();
+		b.ranges[index] = MemoryRange();
+		return index;
+	}
+	b.ranges.push_back(MemoryRange());
+	return static_cast<uint32_t>(b.ranges.size() - 1);
+}
+
+void tlsfInsertFree(MemoryBlock& b, uint32_t index) {
+	MemoryRange& r = b.ranges[index];
+	uint32_t fl, sl;
+	tlsfMapping(r.size, fl, sl);
+	r.tiling = ResourceTiling::Free;
+	r.prevFree = kInvalidRange;
+	r.nextFree = b.freeHeads[fl][sl];
+	if (r.nextFree != kInvalidRange) {
+		b.ranges[r.nextFree].prevFree = index;
+	}
+	b.freeHeads[fl][sl] = index;
+	b.flBitmap |= 1ull << fl;
+	b.slBitmap[fl] |= 1u << sl;
+}
+
+void tlsfRemoveFree(MemoryBlock& b, uint32_t index) {
+	MemoryRange& r = b.ranges[index];
+	uint32_t fl, sl;
+	tlsfMapping(r.size, fl, sl);
+	if (r.prevFree != kInvalidRange) {
+		b.ranges[r.prevFree].nextFree = r.nextFree;
+	}
+	else {
+		b.freeHeads[fl][sl] = r.nextFree;
+		if (r.nextFree == kInvalidRange) {
+			b.slBitmap[fl] &= ~(1u << sl);
+			if (!b.slBitmap[fl]) {
+				b.flBitmap &= ~(1ull << fl);
+			}
+		}
+	}
+	if (r.nextFree != kInvalidRange) {
+		b.ranges[r.nextFree].prevFree = r.prevFree;
+	}
+	r.prevFree = r.nextFree = kInvalidRange;
+}
+
+// first free range whose size class is guaranteed to hold `size`
+uint32_t tlsfFindFree(const MemoryBlock& b, VkDeviceSize size) {
+	if (size >= kTlsfSlCount) {
+		size += (VkDeviceSize(1) << (highestBit(size) - kTlsfSlBits)) - 1; // round up to the next class
+	}
+	uint32_t fl, sl;
+	tlsfMapping(size, fl, sl);
+	if (fl >= kTlsfFlCount) {
+		return kInvalidRange;
+	}
+
+	uint32_t slMap = b.slBitmap[fl] & (~0u << sl);
+	if (!slMap) {
+		uint64_t flMap = (fl + 1 < 64) ? (b.flBitmap & (~0ull << (fl + 1))) : 0;
+		if (!flMap) {
+			return kInvalidRange;
+		}
+		fl = lowestBit(flMap);
+		slMap = b.slBitmap[fl];
+	}
+	sl = lowestBit(slMap);
+	return b.freeHeads[fl][sl];
+}
+
+// offset inside free range `index` that satisfies alignment and bufferImageGranularity, or false
+bool tlsfPlace(const MemoryBlock& b, uint32_t index, VkDeviceSize size, VkDeviceSize alignment,
+	ResourceTiling tiling, VkDeviceSize granularity, VkDeviceSize& offset)
+{
+	const MemoryRange& r = b.ranges[index];
+	offset = alignUp(r.offset, alignment);
+	if (granularity > 1 && r.prevPhys != kInvalidRange) {
+		const MemoryRange& prev = b.ranges[r.prevPhys];
+		if (prev.tiling != tiling && onSamePage(prev.offset + prev.size - 1, offset, granularity)) {
+			offset = alignUp(offset, granularity);
+		}
+	}
+	if (offset + size > r.offset + r.size) {
+		return false;
+	}
+	if (granularity > 1 && r.nextPhys != kInvalidRange) {
+		const MemoryRange& next = b.ranges[r.nextPhys];
+		if (next.tiling != tiling && onSamePage(offset + size - 1, next.offset, granularity)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void tlsfInit(MemoryBlock& b) {
+	for (auto& heads : b.freeHeads) {
+		for (auto& head : heads) {
+			head = kInvalidRange;
+		}
+	}
+	b.firstRange = tlsfNewRange(b);
+	b.ranges[b.firstRange].size = b.size;
+	tlsfInsertFree(b, b.firstRange);
+}
+
+bool tlsfAllocate(MemoryBlock& b, VkDeviceSize size, VkDeviceSize alignment, ResourceTiling tiling,
+	VkDeviceSize granularity, VkDeviceSize& outOffset, uint32_t& outRange)
+{
+	// the head of the first fitting class usually works; if alignment or granularity push it
+	// out of the range, search again with enough slack for the worst case
+	VkDeviceSize offset = 0;
+	uint32_t index = tlsfFindFree(b, size + alignment - 1);
+	if (index == kInvalidRange || !tlsfPlace(b, index, size, alignment, tiling, granularity, offset)) {
+		index = tlsfFindFree(b, size + alignment - 1 + 2 * granularity);
+		if (index == kInvalidRange || !tlsfPlace(b, index, size, alignment, tiling, granularity, offset)) {
+			return false;
+		}
+	}
+	tlsfRemoveFree(b, index);
+
+	// front padding becomes its own free range
+	VkDeviceSize front = offset - b.ranges[index].offset;
+	if (front > 0) {
+		uint32_t pad = tlsfNewRange(b);
+		MemoryRange& r = b.ranges[index];
+		MemoryRange& p = b.ranges[pad];
+		p.offset = r.offset;
+		p.size = front;
+		p.prevPhys = r.prevPhys;
+		p.nextPhys = index;
+		if (r.prevPhys != kInvalidRange) {
+			b.ranges[r.prevPhys].nextPhys = pad;
+		}
+		else {
+			b.firstRange = pad;
+		}
+		r.prevPhys = pad;
+		r.offset = offset;
+		r.size -= front;
+		tlsfInsertFree(b, pad);
+	}
+
+	// the tail goes back to the free lists
+	VkDeviceSize back = b.ranges[index].size - size;
+	if (back > 0) {
+		uint32_t rest = tlsfNewRange(b);
+		MemoryRange& r = b.ranges[index];
+		MemoryRange& n = b.ranges[rest];
+		n.offset = offset + size;
+		n.size = back;
+		n.prevPhys = index;
+		n.nextPhys = r.nextPhys;
+		if (r.nextPhys != kInvalidRange) {
+			b.ranges[r.nextPhys].prevPhys = rest;
+		}
+		r.nextPhys = rest;
+		r.size = size;
+		tlsfInsertFree(b, rest);
+	}
+
+	b.ranges[index].tiling = tiling;
+	outOffset = offset;
+	outRange = index;
+	return true;
+}
+
+void tlsfFree(MemoryBlock& b, uint32_t index) {
+	uint32_t prev = b.ranges[index].prevPhys;
+	if (prev != kInvalidRange && b.ranges[prev].tiling == ResourceTiling::Free) {
+		tlsfRemoveFree(b, prev);
+		b.ranges[prev].size += b.ranges[index].size;
+		b.ranges[prev].nextPhys = b.ranges[index].nextPhys;
+		if (b.ranges[index].nextPhys != kInvalidRange) {
+			b.ranges[b.ranges[index].nextPhys].prevPhys = prev;
+		}
+		b.unusedRanges.push_back(index);
+		index = prev;
+	}
+	uint32_t next = b.ranges[index].nextPhys;
+	if (next != kInvalidRange && b.ranges[next].tiling == ResourceTiling::Free) {
+		tlsfRemoveFree(b, next);
+		b.ranges[index].size += b.ranges[next].size;
+		b.ranges[index].nextPhys = b.ranges[next].nextPhys;
+		if (b.ranges[next].nextPhys != kInvalidRange) {
+			b.ranges[b.ranges[next].nextPhys].prevPhys = index;
+		}
+		b.unusedRanges.push_back(next);
+	}
+	tlsfInsertFree(b, index);
+}
+
+// ---------------------------------------------------------------------------
+// linear / ring blocks
+
+bool linearAllocate(MemoryBlock& b, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset) {
+	VkDeviceSize offset = alignUp(b.head, alignment);
+	if (offset + size > b.size) {
+		return false;
+	}
+	b.head = offset + size;
+	outOffset = offset;
+	return true;
+}
+
+bool ringAllocate(MemoryBlock& b, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset) {
+	VkDeviceSize offset;
+	if (b.ringEntries.empty()) {
+		offset = 0;
+		if (size > b.size) {
+			return false;
+		}
+	}
+	else {
+		VkDeviceSize head = b.ringEntries.back().end;
+		VkDeviceSize tail = b.ringEntries.front().offset;
+		bool wrapped = b.ringEntries.back().offset < tail;
+		offset = alignUp(head, alignment);
+		if (wrapped) {
+			if (offset + size > tail) {
+				return false;
+			}
+		}
+		else if (offset + size > b.size) {
+			offset = 0; // wrap around to the start of the block
+			if (size > tail) {
+				return false;
+			}
+		}
+	}
+	b.ringEntries.push_back({ offset, offset + size, false });
+	outOffset = offset;
+	return true;
+}
+
+// ring memory is handed back in allocation order; out-of-order releases wait for their predecessors
+void ringFree(MemoryBlock& b, VkDeviceSize offset) {
+	for (auto& entry : b.ringEntries) {
+		if (entry.offset == offset && !entry.released) {
+			entry.released = true;
+			break;
+		}
+	}
+	while (!b.ringEntries.empty() && b.ringEntries.front().released) {
+		b.ringEntries.pop_front();
+	}
+}
+
+// ---------------------------------------------------------------------------
+// allocator
+
+// properties and memory come from the device capability snapshot
+void initDeviceMemoryAllocator(DeviceMemoryAllocator& allocator, const VkPhysicalDeviceProperties& props,
+	const VkPhysicalDeviceMemoryProperties& memory, VkDevice dev)
+{
+	allocator.device = dev;
+	allocator.memoryProperties = memory;
+	allocator.bufferImageGranularity = props.limits.bufferImageGranularity;
+	allocator.nonCoherentAtomSize = props.limits.nonCoherentAtomSize;
+	allocator.maxMemoryAllocationCount = props.limits.maxMemoryAllocationCount;
+}
+
+VkDeviceSize blockSizeForType(const DeviceMemoryAllocator& allocator, uint32_t memoryType) {
+	uint32_t heap = allocator.memoryProperties.memoryTypes[memoryType].heapIndex;
+	VkDeviceSize heapSize = allocator.memoryProperties.memoryHeaps[heap].size;
+	// small heaps (BAR, integrated carve-outs) get smaller blocks
+	return heapSize <= 1024ull * 1024 * 1024 ? std::min(allocator.preferredBlockSize, heapSize / 8) : allocator.preferredBlockSize;
+}
+
+MemoryBlock* createMemoryBlock(DeviceMemoryAllocator& allocator, uint32_t memoryType, VkDeviceSize size, BlockStrategy strategy) {
+	if (allocator.deviceMemoryCount >= allocator.maxMemoryAllocationCount) {
+		return nullptr;
+	}
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+	if (vkAllocateMemory(allocator.device, &allocInfo, hostAllocationCallbacks(), &block->memory) != VK_SUCCESS) {
+		return nullptr;
+	}
+	allocator.deviceMemoryCount++;
+	block->size = size;
+	block->memoryType = memoryType;
+	block->strategy = strategy;
+	if (allocator.memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		void* mapped = nullptr;
+		vkMapMemory(allocator.device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+		block->mapped = static_cast<uint8_t*>(mapped);
+	}
+	if (strategy == BlockStrategy::Tlsf) {
+		tlsfInit(*block);
+	}
+
+	MemoryBlock* result = block.get();
+	if (strategy == BlockStrategy::Tlsf) {
+		allocator.blocks[memoryType].push_back(std::move(block));
+	}
+	else {
+		allocator.pools.push_back(std::move(block));
+	}
+	return result;
+}
+
+void destroyMemoryBlock(DeviceMemoryAllocator& allocator, MemoryBlock* block) {
+	if (block->mapped) {
+		vkUnmapMemory(allocator.device, block->memory);
+	}
+	vkFreeMemory(allocator.device, block->memory, hostAllocationCallbacks());
+	allocator.deviceMemoryCount--;
+}
+
+MemoryAllocation makeAllocation(MemoryBlock* block, VkDeviceSize offset, VkDeviceSize size, uint32_t range) {
+	MemoryAllocation allocation;
+	allocation.block = block;
+	allocation.memory = block->memory;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.range = range;
+	allocation.mapped = block->mapped ? block->mapped + offset : nullptr;
+	block->usedBytes += size;
+	block->allocationCount++;
+	return allocation;
+}
+
+MemoryAllocation allocateMemory(DeviceMemoryAllocator& allocator, const VkMemoryRequirements& reqs,
+	MemoryUsage usage, ResourceTiling tiling)
+{
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	uint32_t memoryType = chooseMemoryType(allocator.memoryProperties, reqs.memoryTypeBits, usage);
+	VkDeviceSize blockSize = blockSizeForType(allocator, memoryType);
+
+	// big resources get their own vkAllocateMemory instead of fragmenting the shared blocks
+	if (reqs.size > blockSize / 2) {
+		MemoryBlock* block = createMemoryBlock(allocator, memoryType, reqs.size, BlockStrategy::Tlsf);
+		if (!block) {
+			throw std::runtime_error("failed to allocate dedicated device memory!");
+		}
+		block->dedicated = true;
+		VkDeviceSize offset;
+		uint32_t range;
+		tlsfAllocate(*block, reqs.size, 1, tiling, 1, offset, range);
+		return makeAllocation(block, offset, reqs.size, range);
+	}
+
+	for (auto& block : allocator.blocks[memoryType]) {
+		VkDeviceSize offset;
+		uint32_t range;
+		if (!block->dedicated && tlsfAllocate(*block, reqs.size, reqs.alignment, tiling, allocator.bufferImageGranularity, offset, range)) {
+			return makeAllocation(block.get(), offset, reqs.size, range);
+		}
+	}
+
+	// new block; halve the size when the heap is nearly exhausted
+	MemoryBlock* block = nullptr;
+	for (VkDeviceSize size = blockSize; !block && size >= reqs.size; size /= 2) {
+		block = createMemoryBlock(allocator, memoryType, size, BlockStrategy::Tlsf);
+	}
+	VkDeviceSize offset;
+	uint32_t range;
+	if (!block || !tlsfAllocate(*block, reqs.size, reqs.alignment, tiling, allocator.bufferImageGranularity, offset, range)) {
+		throw std::runtime_error("failed to allocate device memory!");
+	}
+	return makeAllocation(block, offset, reqs.size, range);
+}
+
+// a single block of memory handed out with the linear or ring strategy
+MemoryBlock* createMemoryPool(DeviceMemoryAllocator& allocator, VkDeviceSize size, uint32_t memoryTypeBits,
+	MemoryUsage usage, BlockStrategy strategy, ResourceTiling tiling)
+{
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	uint32_t memoryType = chooseMemoryType(allocator.memoryProperties, memoryTypeBits, usage);
+	MemoryBlock* block = createMemoryBlock(allocator, memoryType, size, strategy);
+	if (!block) {
+		throw std::runtime_error("failed to allocate memory pool!");
+	}
+	block->poolTiling = tiling;
+	return block;
+}
+
+// returns an allocation with memory == VK_NULL_HANDLE when the pool is full
+MemoryAllocation allocateFromPool(DeviceMemoryAllocator& allocator, MemoryBlock* pool, const VkMemoryRequirements& reqs) {
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	if (!(reqs.memoryTypeBits & (1u << pool->memoryType))) {
+		throw std::runtime_error("memory pool has an incompatible memory type!");
+	}
+	VkDeviceSize offset;
+	bool ok = pool->strategy == BlockStrategy::Linear ? linearAllocate(*pool, reqs.size, reqs.alignment, offset)
+		: ringAllocate(*pool, reqs.size, reqs.alignment, offset);
+	if (!ok) {
+		return MemoryAllocation();
+	}
+	return makeAllocation(pool, offset, reqs.size, kInvalidRange);
+}
+
+// linear pools are released all at once
+void resetMemoryPool(DeviceMemoryAllocator& allocator, MemoryBlock* pool) {
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	pool->head = 0;
+	pool->ringEntries.clear();
+	pool->usedBytes = 0;
+	pool->allocationCount = 0;
+}
+
+void destroyMemoryPool(DeviceMemoryAllocator& allocator, MemoryBlock* pool) {
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	for (auto it = allocator.pools.begin(); it != allocator.pools.end(); ++it) {
+		if (it->get() == pool) {
+			destroyMemoryBlock(allocator, pool);
+			allocator.pools.erase(it);
+			return;
+		}
+	}
+}
+
+void freeMemory(DeviceMemoryAllocator& allocator, MemoryAllocation& allocation) {
+	if (!allocation.block) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	MemoryBlock* block = allocation.block;
+	block->usedBytes -= allocation.size;
+	block->allocationCount--;
+
+	switch (block->strategy) {
+	case BlockStrategy::Tlsf:
+		tlsfFree(*block, allocation.range);
+		if (block->dedicated) {
+			auto& list = allocator.blocks[block->memoryType];
+			for (auto it = list.begin(); it != list.end(); ++it) {
+				if (it->get() == block) {
+					destroyMemoryBlock(allocator, block);
+					list.erase(it);
+					break;
+				}
+			}
+		}
+		break;
+	case BlockStrategy::Linear:
+		if (block->allocationCount == 0) {
+			block->head = 0;
+		}
+		break;
+	case BlockStrategy::Ring:
+		ringFree(*block, allocation.offset);
+		break;
+	}
+	allocation = MemoryAllocation();
+}
+
+// needed only for memory types without HOST_COHERENT
+void flushAllocation(DeviceMemoryAllocator& allocator, const MemoryAllocation& allocation) {
+	VkMemoryPropertyFlags flags = allocator.memoryProperties.memoryTypes[allocation.block->memoryType].propertyFlags;
+	if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+		return;
+	}
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = allocation.offset / allocator.nonCoherentAtomSize * allocator.nonCoherentAtomSize;
+	range.size = std::min(alignUp(allocation.offset + allocation.size, allocator.nonCoherentAtomSize), allocation.block->size) - range.offset;
+	vkFlushMappedMemoryRanges(allocator.device, 1, &range);
+}
+
+void invalidateAllocation(DeviceMemoryAllocator& allocator, const MemoryAllocation& allocation) {
+	VkMemoryPropertyFlags flags = allocator.memoryProperties.memoryTypes[allocation.block->memoryType].propertyFlags;
+	if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+		return;
+	}
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = allocation.offset / allocator.nonCoherentAtomSize * allocator.nonCoherentAtomSize;
+	range.size = std::min(alignUp(allocation.offset + allocation.size, allocator.nonCoherentAtomSize), allocation.block->size) - range.offset;
+	vkInvalidateMappedMemoryRanges(allocator.device, 1, &range);
+}
+
+// ---------------------------------------------------------------------------
+// resources
+
+// queueFamilies: buffers used by more than one distinct family are created VK_SHARING_MODE_CONCURRENT
+VkBuffer createBuffer(DeviceMemoryAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+	MemoryUsage memoryUsage, MemoryAllocation& allocation, MemoryBlock* pool = nullptr,
+	std::vector<uint32_t> queueFamilies = std::vector<uint32_t>())
+{
+	std::sort(queueFamilies.begin(), queueFamilies.end());
+	queueFamilies.erase(std::unique(queueFamilies.begin(), queueFamilies.end()), queueFamilies.end());
+
+	VkBufferCreateInfo buffer_ci = {};
+	buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_ci.size = size;
+	buffer_ci.usage = usage;
+	buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (queueFamilies.size() > 1) {
+		buffer_ci.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		buffer_ci.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+		buffer_ci.pQueueFamilyIndices = queueFamilies.data();
+	}
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(allocator.device, &buffer_ci, hostAllocationCallbacks(), &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create buffer!");
+	}
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(allocator.device, buffer, &memRequirements);
+	allocation = pool ? allocateFromPool(allocator, pool, memRequirements)
+		: allocateMemory(allocator, memRequirements, memoryUsage, ResourceTiling::Linear);
+	if (allocation.memory == VK_NULL_HANDLE) {
+		vkDestroyBuffer(allocator.device, buffer, hostAllocationCallbacks());
+		throw std::runtime_error("memory pool exhausted!");
+	}
+	vkBindBufferMemory(allocator.device, buffer, allocation.memory, allocation.offset);
+	return buffer;
+}
+
+void destroyBuffer(DeviceMemoryAllocator& allocator, VkBuffer buffer, MemoryAllocation& allocation) {
+	vkDestroyBuffer(allocator.device, buffer, hostAllocationCallbacks());
+	freeMemory(allocator, allocation);
+}
+
+VkImage createImage(DeviceMemoryAllocator& allocator, const VkImageCreateInfo& image_ci,
+	MemoryUsage memoryUsage, MemoryAllocation& allocation)
+{
+	VkImage image;
+	if (vkCreateImage(allocator.device, &image_ci, hostAllocationCallbacks(), &image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image!");
+	}
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(allocator.device, image, &memRequirements);
+	allocation = allocateMemory(allocator, memRequirements, memoryUsage,
+		image_ci.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceTiling::Optimal : ResourceTiling::Linear);
+	vkBindImageMemory(allocator.device, image, allocation.memory, allocation.offset);
+	return image;
+}
+
+void destroyImage(DeviceMemoryAllocator& allocator, VkImage image, MemoryAllocation& allocation) {
+	vkDestroyImage(allocator.device, image, hostAllocationCallbacks());
+	freeMemory(allocator, allocation);
+}
+
+// ---------------------------------------------------------------------------
+// statistics
+
+struct HeapStats {
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	uint32_t freeRangeCount = 0;
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFreeRange = 0;
+};
+
+void addBlockStats(HeapStats& stats, const MemoryBlock& block) {
+	stats.blockCount++;
+	stats.allocationCount += block.allocationCount;
+	stats.blockBytes += block.size;
+	stats.usedBytes += block.usedBytes;
+	if (block.strategy == BlockStrategy::Tlsf) {
+		for (uint32_t i = block.firstRange; i != kInvalidRange; i = block.ranges[i].nextPhys) {
+			const MemoryRange& r = block.ranges[i];
+			if (r.tiling == ResourceTiling::Free) {
+				stats.freeRangeCount++;
+				stats.freeBytes += r.size;
+				stats.largestFreeRange = std::max(stats.largestFreeRange, r.size);
+			}
+		}
+	}
+	else {
+		VkDeviceSize free = block.size - block.usedBytes;
+		stats.freeRangeCount++;
+		stats.freeBytes += free;
+		stats.largestFreeRange = std::max(stats.largestFreeRange, free);
+	}
+}
+
+std::vector<HeapStats> getHeapStats(DeviceMemoryAllocator& allocator) {
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	std::vector<HeapStats> heaps(allocator.memoryProperties.memoryHeapCount);
+	for (uint32_t type = 0; type < allocator.memoryProperties.memoryTypeCount; type++) {
+		for (auto& block : allocator.blocks[type]) {
+			addBlockStats(heaps[allocator.memoryProperties.memoryTypes[type].heapIndex], *block);
+		}
+	}
+	for (auto& pool : allocator.pools) {
+		addBlockStats(heaps[allocator.memoryProperties.memoryTypes[pool->memoryType].heapIndex], *pool);
+	}
+	return heaps;
+}
+
+void dumpMemoryStats(DeviceMemoryAllocator& allocator) {
+	std::vector<HeapStats> heaps = getHeapStats(allocator);
+	std::cout << "device memory:\t" << allocator.deviceMemoryCount << " / " << allocator.maxMemoryAllocationCount << " vkAllocateMemory\n";
+	for (size_t i = 0; i < heaps.size(); i++) {
+		const HeapStats& h = heaps[i];
+		if (h.blockCount == 0) {
+			continue;
+		}
+		// 0 = all free space in one range, 1 = free space scattered in tiny pieces
+		double fragmentation = h.freeBytes ? 1.0 - double(h.largestFreeRange) / double(h.freeBytes) : 0.0;
+		std::cout << "  heap #" << i << ":\t" << h.blockCount << " blocks, " << h.allocationCount << " allocations, "
+			<< h.usedBytes / 1024 << " / " << h.blockBytes / 1024 << " KiB used, "
+			<< h.freeRangeCount << " free ranges, largest " << h.largestFreeRange / 1024 << " KiB, "
+			<< "fragmentation " << fragmentation << "\n";
+	}
+}
+
+void destroyDeviceMemoryAllocator(DeviceMemoryAllocator& allocator) {
+	std::lock_guard<std::mutex> lock(allocator.mutex);
+	for (auto& list : allocator.blocks) {
+		for (auto& block : list) {
+			destroyMemoryBlock(allocator, block.get());
+		}
+		list.clear();
+	}
+	for (auto& pool : allocator.pools) {
+		destroyMemoryBlock(allocator, pool.get());
+	}
+	allocator.pools.clear();
+}
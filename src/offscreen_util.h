@@ -0,0 +1,78 @@
+#pragma once
+
+// Offscreen render targets used when the sample runs without a window
+// and the instance has no VK_EXT_headless_surface to build a swapchain on.
+
+#include "vk_dispatch.h"
+#include <vector>
+#include <stdexcept>
+
+#include "memory_allocator.h"
+
+struct OffscreenTarget {
+	std::vector<VkImage> images;
+	std::vector<VkImageView> imageViews;
+	std::vector<MemoryAllocation> allocations;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent = {};
+	uint32_t nextImage = 0;
+};
+
+OffscreenTarget createOffscreenImages(DeviceMemoryAllocator& allocator, VkDevice dev,
+	VkFormat format, VkExtent2D extent, uint32_t imageCount)
+{
+	OffscreenTarget target;
+	target.format = format;
+	target.extent = extent;
+	target.images.resize(imageCount);
+	target.imageViews.resize(imageCount);
+	target.allocations.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; i++) {
+		VkImageCreateInfo image_ci = {};
+		image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_ci.imageType = VK_IMAGE_TYPE_2D;
+		image_ci.format = format;
+		image_ci.extent.width = extent.width;
+		image_ci.extent.height = extent.height;
+		image_ci.extent.depth = 1;
+		image_ci.mipLevels = 1;
+		image_ci.arrayLayers = 1;
+		image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_ci.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		target.images[i] = createImage(allocator, image_ci, MemoryUsage::GpuOnly, target.allocations[i]);
+
+		VkImageViewCreateInfo color_image_view = {};
+		color_image_view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		color_image_view.image = target.images[i];
+		color_image_view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		color_image_view.format = format;
+		color_image_view.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		color_image_view.subresourceRange.levelCount = 1;
+		color_image_view.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(dev, &color_image_view, hostAllocationCallbacks(), &target.imageViews[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create offscreen image view!");
+		}
+	}
+	return target;
+}
+
+// round-robin replacement for vkAcquireNextImageKHR
+uint32_t acquireOffscreenImage(OffscreenTarget& target) {
+	uint32_t index = target.nextImage;
+	target.nextImage = (target.nextImage + 1) % static_cast<uint32_t>(target.images.size());
+	return index;
+}
+
+void destroyOffscreenImages(DeviceMemoryAllocator& allocator, VkDevice dev, OffscreenTarget& target) {
+	for (size_t i = 0; i < target.images.size(); i++) {
+		vkDestroyImageView(dev, target.imageViews[i], hostAllocationCallbacks());
+		destroyImage(allocator, target.images[i], target.allocations[i]);
+	}
+	target = OffscreenTarget();
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+// Multi-threaded command recording.
+// Every worker thread owns one VkCommandPool per frame in flight and records secondary
+// command buffers for a slice of the draw list; the main thread stitches them into the
+// primary with vkCmdExecuteCommands. Pools are reset once the frame's fence has signaled,
+// and their command buffers are reused instead of being freed and reallocated.
+
+#include "vk_dispatch.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "host_allocator.h"
+#include "job_system.h"
+
+struct WorkerCommandPool {
+	VkCommandPool pool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> buffers;
+	uint32_t used = 0;
+};
+
+struct ParallelRecorder {
+	VkDevice device = VK_NULL_HANDLE;
+	JobSystem jobs;
+	std::vector<std::vector<WorkerCommandPool>> frames; // [frame in flight][worker]
+};
+
+// records commands for draw items [first, first + count) into a secondary command buffer
+typedef std::function<void(VkCommandBuffer cmd, uint32_t first, uint32_t count)> RecordSliceFn;
+
+void initParallelRecorder(ParallelRecorder& recorder, VkDevice dev, uint32_t queueFamilyIndex,
+	uint32_t framesInFlight, uint32_t workerCount)
+{
+	recorder.device = dev;
+	recorder.frames.resize(framesInFlight);
+	for (auto& workers : recorder.frames) {
+		workers.resize(workerCount);
+		for (auto& worker : workers) {
+			VkCommandPoolCreateInfo pool_ci = {};
+			pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			pool_ci.queueFamilyIndex = queueFamilyIndex;
+			if (vkCreateCommandPool(dev, &pool_ci, hostAllocationCallbacks(), &worker.pool) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create worker command pool!");
+			}
+		}
+	}
+	startJobSystem(recorder.jobs, workerCount);
+}
+
+uint32_t parallelRecorderWorkerCount(const ParallelRecorder& recorder) {
+	return jobSystemThreadCount(recorder.jobs);
+}
+
+// call after the frame's fence has signaled
+void resetParallelRecorderFrame(ParallelRecorder& recorder, uint32_t frameIndex) {
+	for (auto& worker : recorder.frames[frameIndex]) {
+		if (worker.used > 0) {
+			vkResetCommandPool(recorder.device, worker.pool, 0);
+			worker.used = 0;
+		}
+	}
+}
+
+VkCommandBuffer acquireSecondaryCommandBuffer(ParallelRecorder& recorder, WorkerCommandPool& worker) {
+	if (worker.used == worker.buffers.size()) {
+		VkCommandBufferAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = worker.pool;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		alloc_info.commandBufferCount = 1;
+		VkCommandBuffer cmd;
+		if (vkAllocateCommandBuffers(recorder.device, &alloc_info, &cmd) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+		}
+		worker.buffers.push_back(cmd);
+	}
+	return worker.buffers[worker.used++];
+}
+
+// Splits itemCount draw items into one slice per worker, records them in parallel and
+// returns the secondary command buffers in draw-list order.
+std::vector<VkCommandBuffer> recordSecondaryParallel(ParallelRecorder& recorder, uint32_t frameIndex,
+	const VkCommandBufferInheritanceInfo& inheritance, uint32_t itemCount, const RecordSliceFn& recordSlice)
+{
+	uint32_t sliceCount = std::max(1u, std::min(parallelRecorderWorkerCount(recorder), itemCount));
+	std::vector<VkCommandBuffer> secondaries(sliceCount, VK_NULL_HANDLE);
+	std::vector<WorkerCommandPool>& workers = recorder.frames[frameIndex];
+
+	for (uint32_t slice = 0; slice < sliceCount; slice++) {
+		uint32_t first = static_cast<uint32_t>(uint64_t(itemCount) * slice / sliceCount);
+		uint32_t last = static_cast<uint32_t>(uint64_t(itemCount) * (slice + 1) / sliceCount);
+		submitJob(recorder.jobs, [&, slice, first, last](uint32_t worker) {
+			VkCommandBuffer cmd = acquireSecondaryCommandBuffer(recorder, workers[worker]);
+
+			VkCommandBufferBeginInfo begin_info = {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			begin_info.pInheritanceInfo = &inheritance;
+			vkBeginCommandBuffer(cmd, &begin_info);
+			recordSlice(cmd, first, last - first);
+			vkEndCommandBuffer(cmd);
+			secondaries[slice] = cmd;
+		});
+	}
+	waitJobs(recorder.jobs);
+	return secondaries;
+}
+
+void destroyParallelRecorder(ParallelRecorder& recorder) {
+	stopJobSystem(recorder.jobs);
+	for (auto& workers : recorder.frames) {
+		for (auto& worker : workers) {
+			vkDestroyCommandPool(recorder.device, worker.pool, hostAllocationCallbacks());
+		}
+	}
+	recorder.frames.clear();
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+// Persistent VkPipelineCache.
+// The blob is stored behind a small file header that records the device it was
+// built on, so a driver update or a different GPU silently starts from an empty cache.
+// Pipelines compile on several init tasks at once, all into the one cache: creating
+// pipelines against a cache is internally synchronized, only merging into it is not.
+
+#include "vk_dispatch.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+
+#include "host_allocator.h"
+
+struct PipelineCacheFileHeader {
+	uint32_t magic;
+	uint32_t fileVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint32_t reserved;
+	uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+static const uint32_t kPipelineCacheMagic = 0x4350564b; // "KVPC"
+static const uint32_t kPipelineCacheFileVersion = 1;
+
+struct PipelineCacheStats {
+	std::atomic<uint32_t> hits{ 0 };       // VK_EXT_pipeline_creation_feedback reported a cache hit
+	std::atomic<uint32_t> misses{ 0 };
+	std::atomic<uint32_t> unknown{ 0 };    // no feedback extension on this device
+	std::atomic<uint64_t> createMicros{ 0 };
+	size_t loadedBytes = 0;
+	size_t savedBytes = 0;
+	const char* loadResult = "not loaded";
+};
+
+struct PipelineCacheStore {
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties = {};
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	bool creationFeedback = false;
+	std::string path;
+	PipelineCacheStats stats;
+};
+
+uint64_t hashPipelineCacheData(const uint8_t* data, size_t size) {
+	uint64_t hash = 14695981039346656037ull; // FNV-1a
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// returns nullptr when the blob may be handed to vkCreatePipelineCache, otherwise the reason it was rejected
+const char* validatePipelineCacheBlob(const std::vector<uint8_t>& file, const VkPhysicalDeviceProperties& props) {
+	if (file.size() < sizeof(PipelineCacheFileHeader)) {
+		return "truncated file";
+	}
+	PipelineCacheFileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != kPipelineCacheMagic || header.fileVersion != kPipelineCacheFileVersion) {
+		return "unknown file format";
+	}
+	if (header.vendorID != props.vendorID || header.deviceID != props.deviceID ||
+		header.driverVersion != props.driverVersion ||
+		memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		return "built for another device or driver";
+	}
+	if (header.dataSize != file.size() - sizeof(header) ||
+		header.dataHash != hashPipelineCacheData(file.data() + sizeof(header), static_cast<size_t>(header.dataSize))) {
+		return "corrupted data";
+	}
+
+	// the driver's own header (VkPipelineCacheHeaderVersionOne) must agree as well
+	const uint8_t* blob = file.data() + sizeof(header);
+	uint32_t blobHeader[4];
+	if (header.dataSize < sizeof(blobHeader) + VK_UUID_SIZE) {
+		return "truncated cache header";
+	}
+	memcpy(blobHeader, blob, sizeof(blobHeader));
+	if (blobHeader[0] < sizeof(blobHeader) + VK_UUID_SIZE || blobHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		blobHeader[2] != props.vendorID || blobHeader[3] != props.deviceID ||
+		memcmp(blob + sizeof(blobHeader), props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		return "cache header mismatch";
+	}
+	return nullptr;
+}
+
+bool readBinaryFile(const std::string& path, std::vector<uint8_t>& data) {
+	FILE* fp = fopen(path.c_str(), "rb");
+	if (!fp) {
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data.resize(size > 0 ? static_cast<size_t>(size) : 0);
+	size_t read = data.empty() ? 0 : fread(data.data(), 1, data.size(), fp);
+	fclose(fp);
+	return read == data.size();
+}
+
+// write to a temporary file and rename it over the old one, so a crash never leaves half a cache behind
+bool writeFileAtomic(const std::string& path, const void* header, size_t headerSize, const void* data, size_t dataSize) {
+	std::string tmpPath = path + ".tmp";
+	FILE* fp = fopen(tmpPath.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	bool ok = fwrite(header, 1, headerSize, fp) == headerSize && fwrite(data, 1, dataSize, fp) == dataSize;
+	ok = (fflush(fp) == 0) && ok;
+	fclose(fp);
+	if (!ok) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	return MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+VkPipelineCache createEmptyPipelineCache(VkDevice dev) {
+	VkPipelineCacheCreateInfo cache_ci = {};
+	cache_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	VkPipelineCache cache;
+	if (vkCreatePipelineCache(dev, &cache_ci, hostAllocationCallbacks(), &cache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+	return cache;
+}
+
+void loadPipelineCache(PipelineCacheStore& store, const VkPhysicalDeviceProperties& properties, VkDevice dev,
+	const std::string& path, bool creationFeedback)
+{
+	store.device = dev;
+	store.path = path;
+	store.creationFeedback = creationFeedback;
+	store.properties = properties;
+
+	std::vector<uint8_t> file;
+	const char* rejected = "no cache file";
+	if (!path.empty() && readBinaryFile(path, file)) {
+		rejected = validatePipelineCacheBlob(file, store.properties);
+	}
+
+	VkPipelineCacheCreateInfo cache_ci = {};
+	cache_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	if (!rejected) {
+		cache_ci.initialDataSize = file.size() - sizeof(PipelineCacheFileHeader);
+		cache_ci.pInitialData = file.data() + sizeof(PipelineCacheFileHeader);
+	}
+	if (vkCreatePipelineCache(dev, &cache_ci, hostAllocationCallbacks(), &store.cache) != VK_SUCCESS) {
+		// the driver can still refuse a blob that passed our checks
+		store.cache = createEmptyPipelineCache(dev);
+		rejected = "rejected by driver";
+	}
+	store.stats.loadedBytes = rejected ? 0 : cache_ci.initialDataSize;
+	store.stats.loadResult = rejected ? rejected : "loaded";
+}
+
+void countPipelineCreationFeedback(PipelineCacheStore& store, const VkPipelineCreationFeedbackEXT& feedback) {
+	if (!store.creationFeedback || !(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+		store.stats.unknown++;
+	}
+	else if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) {
+		store.stats.hits++;
+	}
+	else {
+		store.stats.misses++;
+	}
+}
+
+VkPipeline createGraphicsPipelineCached(PipelineCacheStore& store, const VkGraphicsPipelineCreateInfo& info) {
+	VkGraphicsPipelineCreateInfo pipeline_ci = info;
+	VkPipelineCreationFeedbackEXT pipelineFeedback = {};
+	std::vector<VkPipelineCreationFeedbackEXT> stageFeedback(info.stageCount);
+	VkPipelineCreationFeedbackCreateInfoEXT feedback_ci = {};
+	if (store.creationFeedback) {
+		feedback_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+		feedback_ci.pNext = pipeline_ci.pNext;
+		feedback_ci.pPipelineCreationFeedback = &pipelineFeedback;
+		feedback_ci.pipelineStageCreationFeedbackCount = info.stageCount;
+		feedback_ci.pPipelineStageCreationFeedbacks = stageFeedback.data();
+		pipeline_ci.pNext = &feedback_ci;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(store.device, store.cache, 1, &pipeline_ci, hostAllocationCallbacks(), &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+	store.stats.createMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	countPipelineCreationFeedback(store, pipelineFeedback);
+	return pipeline;
+}
+
+VkPipeline createComputePipelineCached(PipelineCacheStore& store, const VkComputePipelineCreateInfo& info) {
+	VkComputePipelineCreateInfo pipeline_ci = info;
+	VkPipelineCreationFeedbackEXT pipelineFeedback = {};
+	VkPipelineCreationFeedbackEXT stageFeedback = {};
+	VkPipelineCreationFeedbackCreateInfoEXT feedback_ci = {};
+	if (store.creationFeedback) {
+		feedback_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+		feedback_ci.pNext = pipeline_ci.pNext;
+		feedback_ci.pPipelineCreationFeedback = &pipelineFeedback;
+		feedback_ci.pipelineStageCreationFeedbackCount = 1;
+		feedback_ci.pPipelineStageCreationFeedbacks = &stageFeedback;
+		pipeline_ci.pNext = &feedback_ci;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(store.device, store.cache, 1, &pipeline_ci, hostAllocationCallbacks(), &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+	store.stats.createMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	countPipelineCreationFeedback(store, pipelineFeedback);
+	return pipeline;
+}
+
+void savePipelineCache(PipelineCacheStore& store) {
+	if (store.path.empty() || store.cache == VK_NULL_HANDLE) {
+		return;
+	}
+	size_t size = 0;
+	vkGetPipelineCacheData(store.device, store.cache, &size, nullptr);
+	std::vector<uint8_t> data(size);
+	if (size == 0 || vkGetPipelineCacheData(store.device, store.cache, &size, data.data()) != VK_SUCCESS) {
+		return;
+	}
+
+	PipelineCacheFileHeader header = {};
+	header.magic = kPipelineCacheMagic;
+	header.fileVersion = kPipelineCacheFileVersion;
+	header.vendorID = store.properties.vendorID;
+	header.deviceID = store.properties.deviceID;
+	header.driverVersion = store.properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, store.properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = size;
+	header.dataHash = hashPipelineCacheData(data.data(), size);
+
+	if (writeFileAtomic(store.path, &header, sizeof(header), data.data(), size)) {
+		store.stats.savedBytes = size;
+	}
+	else {
+		std::cout << "pipeline cache: failed to write " << store.path << "\n";
+	}
+}
+
+void dumpPipelineCacheStats(const PipelineCacheStore& store) {
+	const PipelineCacheStats& s = store.stats;
+	std::cout << "pipeline cache:\t" << store.path << " (" << s.loadResult << ", " << s.loadedBytes << " bytes)\n";
+	std::cout << "  pipelines:\t" << (s.hits + s.misses + s.unknown) << " (hits " << s.hits << ", misses " << s.misses
+		<< ", unknown " << s.unknown << ")\n";
+	std::cout << "  create time:\t" << s.createMicros / 1000.0 << " ms\n";
+	std::cout << "  saved:\t" << s.savedBytes << " bytes\n";
+}
+
+void destroyPipelineCache(PipelineCacheStore& store) {
+	if (store.cache != VK_NULL_HANDLE) {
+		vkDestroyPipelineCache(store.device, store.cache, hostAllocationCallbacks());
+		store.cache = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+// Presentation policy.
+// A profile decides the present mode, swapchain image count, frames in flight and pacing:
+//  latency    - fewest queued images; the pacer delays input sampling so that the frame is
+//               finished just before the next present slot instead of waiting in a queue
+//  throughput - the default and the sample's original behaviour: MAILBOX where available,
+//               otherwise FIFO, with two frames in flight
+//  power      - FIFO with an optional frame limiter
+// Present intervals are measured on the CPU around vkQueuePresentKHR (no display timing
+// extension is assumed), which is enough to compare profiles against each other.
+
+#include "vk_dispatch.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+
+enum class PresentProfile {
+	Latency,
+	Throughput,
+	Power,
+};
+
+enum class PacerMode {
+	None,
+	Limit,      // start frames no faster than targetFps
+	LowLatency, // sample input as late as the measured frame cost allows
+};
+
+struct PresentPolicy {
+	PresentProfile profile = PresentProfile::Throughput;
+	std::vector<VkPresentModeKHR> presentModes; // in order of preference; FIFO is always appended
+	uint32_t extraImages = 0;                   // on top of minImageCount
+	uint32_t framesInFlight = 2;
+	PacerMode pacer = PacerMode::None;
+	double targetFps = 0.0;                     // 0: follow the measured present interval
+};
+
+const char* presentProfileName(PresentProfile profile) {
+	switch (profile) {
+	case PresentProfile::Latency: return "latency";
+	case PresentProfile::Throughput: return "throughput";
+	case PresentProfile::Power: return "power";
+	}
+	return "unknown";
+}
+
+bool parsePresentProfile(const char* name, PresentProfile& profile) {
+	for (PresentProfile p : { PresentProfile::Latency, PresentProfile::Throughput, PresentProfile::Power }) {
+		if (strcmp(name, presentProfileName(p)) == 0) {
+			profile = p;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* presentModeName(VkPresentModeKHR mode) {
+	switch (mode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+	case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+	default: return "other";
+	}
+}
+
+// targetFps of 0 keeps the profile default
+PresentPolicy makePresentPolicy(PresentProfile profile, double targetFps) {
+	PresentPolicy policy;
+	policy.profile = profile;
+	switch (profile) {
+	case PresentProfile::Latency:
+		// MAILBOX replaces the queued image instead of waiting behind it
+		policy.presentModes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		policy.extraImages = 0;
+		policy.framesInFlight = 1;
+		policy.pacer = PacerMode::LowLatency;
+		break;
+	case PresentProfile::Throughput:
+		// no IMMEDIATE: a plain run must not tear where MAILBOX is missing
+		policy.presentModes = { VK_PRESENT_MODE_MAILBOX_KHR };
+		policy.extraImages = 0;
+		policy.framesInFlight = 2;
+		policy.pacer = PacerMode::None;
+		break;
+	case PresentProfile::Power:
+		policy.presentModes = { VK_PRESENT_MODE_FIFO_KHR };
+		policy.extraImages = 0;
+		policy.framesInFlight = 2;
+		policy.pacer = PacerMode::Limit;
+		policy.targetFps = 30.0;
+		break;
+	}
+	if (targetFps > 0.0) {
+		policy.targetFps = targetFps;
+		if (policy.pacer == PacerMode::None) {
+			policy.pacer = PacerMode::Limit;
+		}
+	}
+	return policy;
+}
+
+VkPresentModeKHR choosePresentMode(const PresentPolicy& policy, const std::vector<VkPresentModeKHR>& availablePresentModes) {
+	for (VkPresentModeKHR mode : policy.presentModes) {
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end()) {
+			return mode;
+		}
+	}
+	return VK_PRESENT_MODE_FIFO_KHR; // always supported
+}
+
+uint32_t chooseImageCount(const PresentPolicy& policy, const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR mode) {
+	uint32_t count = capabilities.minImageCount + policy.extraImages;
+	if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+		count = std::max(count, 3u); // one on screen, one queued, one to render into
+	}
+	if (capabilities.maxImageCount > 0) {
+		count = std::min(count, capabilities.maxImageCount);
+	}
+	return count;
+}
+
+// ---------------------------------------------------------------------------
+// frame pacing
+
+static const size_t kPacerWindow = 1024;    // frames kept for the interval statistics
+
+struct FramePacer {
+	PacerMode mode = PacerMode::None;
+	double targetIntervalUs = 0.0;
+	double intervalEmaUs = 0.0;      // measured present interval
+	double workEmaUs = 0.0;          // input sampling -> present
+	std::chrono::steady_clock::time_point lastInput;
+	std::chrono::steady_clock::time_point lastPresent;
+	bool hasPresent = false;
+	double lastIntervalMs = 0.0;     // of the last frame, 0 before the second present
+	double lastInputToPresentMs = 0.0;
+	std::vector<double> presentIntervalsMs;  // the last kPacerWindow frames
+	std::vector<double> inputToPresentMs;
+	size_t windowNext = 0;
+	double sleptMs = 0.0;
+};
+
+void initFramePacer(FramePacer& pacer, const PresentPolicy& policy) {
+	pacer = FramePacer();
+	pacer.mode = policy.pacer;
+	pacer.targetIntervalUs = policy.targetFps > 0.0 ? 1000000.0 / policy.targetFps : 0.0;
+	pacer.presentIntervalsMs.reserve(kPacerWindow);
+	pacer.inputToPresentMs.reserve(kPacerWindow);
+}
+
+void pacerRecord(std::vector<double>& window, size_t index, double valueMs) {
+	if (window.size() < kPacerWindow) {
+		window.push_back(valueMs);
+	}
+	else {
+		window[index] = valueMs;
+	}
+}
+
+// sleeps for the bulk of the wait and spins the last millisecond; sleep granularity is coarse
+void pacerSleepUntil(FramePacer& pacer, std::chrono::steady_clock::time_point deadline) {
+	auto now = std::chrono::steady_clock::now();
+	if (deadline <= now) {
+		return;
+	}
+	pacer.sleptMs += std::chrono::duration<double, std::milli>(deadline - now).count();
+	auto coarse = deadline - std::chrono::milliseconds(1);
+	if (coarse > now) {
+		std::this_thread::sleep_until(coarse);
+	}
+	while (std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+}
+
+// call right before input is sampled for the next frame
+void pacerBeforeInput(FramePacer& pacer) {
+	using namespace std::chrono;
+	if (pacer.hasPresent) {
+		if (pacer.mode == PacerMode::Limit && pacer.targetIntervalUs > 0.0) {
+			pacerSleepUntil(pacer, pacer.lastInput + duration_cast<steady_clock::duration>(duration<double, std::micro>(pacer.targetIntervalUs)));
+		}
+		else if (pacer.mode == PacerMode::LowLatency) {
+			// start so that the frame reaches present just as the next present slot opens,
+			// keeping 10% of the interval as a safety margin
+			double intervalUs = pacer.targetIntervalUs > 0.0 ? pacer.targetIntervalUs : pacer.intervalEmaUs;
+			double delayUs = intervalUs * 0.9 - pacer.workEmaUs;
+			if (delayUs > 0.0) {
+				pacerSleepUntil(pacer, pacer.lastPresent + duration_cast<steady_clock::duration>(duration<double, std::micro>(delayUs)));
+			}
+		}
+	}
+	pacer.lastInput = steady_clock::now();
+}
+
+// call right after vkQueuePresentKHR (or the submit, without a swapchain)
+void pacerAfterPresent(FramePacer& pacer) {
+	using namespace std::chrono;
+	auto now = steady_clock::now();
+	double workUs = duration<double, std::micro>(now - pacer.lastInput).count();
+	pacer.workEmaUs = pacer.workEmaUs == 0.0 ? workUs : pacer.workEmaUs * 0.9 + workUs * 0.1;
+	pacer.lastInputToPresentMs = workUs / 1000.0;
+	if (pacer.hasPresent) {
+		double intervalUs = duration<double, std::micro>(now - pacer.lastPresent).count();
+		pacer.intervalEmaUs = pacer.intervalEmaUs == 0.0 ? intervalUs : pacer.intervalEmaUs * 0.9 + intervalUs * 0.1;
+		pacer.lastIntervalMs = intervalUs / 1000.0;
+		pacerRecord(pacer.presentIntervalsMs, pacer.windowNext, pacer.lastIntervalMs);
+		pacerRecord(pacer.inputToPresentMs, pacer.windowNext, pacer.lastInputToPresentMs);
+		pacer.windowNext = (pacer.windowNext + 1) % kPacerWindow;
+	}
+	pacer.lastPresent = now;
+	pacer.hasPresent = true;
+}
+
+// modeName is "none" when frames are not presented to a swapchain
+void dumpFramePacer(const FramePacer& pacer, const PresentPolicy& policy, const char* modeName, uint32_t imageCount) {
+	std::cout << "present policy:\t" << presentProfileName(policy.profile) << ", " << modeName << ", "
+		<< imageCount << " images, " << policy.framesInFlight << " frames in flight, pacer "
+		<< (pacer.mode == PacerMode::None ? "off" : (pacer.mode == PacerMode::Limit ? "limit" : "low latency"));
+	if (policy.targetFps > 0.0) {
+		std::cout << " @ " << policy.targetFps << " fps";
+	}
+	std::cout << ", slept " << pacer.sleptMs << " ms\n";
+	if (pacer.presentIntervalsMs.empty()) {
+		return;
+	}
+	BenchStats interval = computeBenchStats(pacer.presentIntervalsMs);
+	BenchStats latency = computeBenchStats(pacer.inputToPresentMs);
+	std::cout << "  last " << pacer.presentIntervalsMs.size() << " frames:\n";
+	char line[200];
+	snprintf(line, sizeof(line), "  present interval  mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f ms\n",
+		interval.meanMs, interval.p50Ms, interval.p95Ms, interval.p99Ms, interval.maxMs);
+	std::cout << line;
+	snprintf(line, sizeof(line), "  input to present  mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f ms\n",
+		latency.meanMs, latency.p50Ms, latency.p95Ms, latency.p99Ms, latency.maxMs);
+	std::cout << line;
+}
@@ -0,0 +1,1124 @@
+#pragma once
+
+// Render graph.
+// Passes declare the resources they read and write; compileRenderGraph derives everything
+// else once, and executeRenderGraph replays it every frame:
+//  - passes whose results never reach an output (or a side effect) are culled
+//  - consecutive graphics passes with the same extent that only hand data to each other
+//    through attachments become subpasses of one VkRenderPass
+//  - the barriers a group of passes needs are merged into one vkCmdPipelineBarrier before
+//    it; attachment transitions are left to the render pass
+//  - attachments not read after their render pass are not stored
+//  - transient images whose lifetimes do not overlap share memory
+// Passes run in declaration order on the graphics queue. Work on other queues is
+// synchronized by the caller with semaphores, outside the graph.
+// With a profiler set, every pass gets a GPU scope of its name; a render pass with secondary
+// contents is timed as a whole, under the name of its first pass.
+
+#include "vk_dispatch.h"
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "debug_utils.h"
+#include "gpu_profiler.h"
+#include "host_allocator.h"
+#include "memory_allocator.h"
+
+enum class RenderGraphUsage : uint8_t {
+	ColorAttachment,
+	DepthAttachment,
+	DepthRead,          // read-only depth attachment
+	InputAttachment,
+	Sampled,
+	StorageRead,
+	StorageWrite,
+	TransferSrc,
+	TransferDst,
+	VertexBuffer,
+	IndexBuffer,
+	IndirectBuffer,
+	UniformBuffer,
+};
+
+struct RenderGraphUsageInfo {
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	VkImageLayout layout;
+	VkImageUsageFlags imageUsage;
+	VkBufferUsageFlags bufferUsage;
+	bool write;
+	bool attachment;
+};
+
+const VkAccessFlags kRenderGraphWriteAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+// shaderStages applies to Sampled, Storage* and UniformBuffer
+RenderGraphUsageInfo renderGraphUsageInfo(RenderGraphUsage usage, VkPipelineStageFlags shaderStages) {
+	switch (usage) {
+	case RenderGraphUsage::ColorAttachment:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0, true, true };
+	case RenderGraphUsage::DepthAttachment:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, true, true };
+	case RenderGraphUsage::DepthRead:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, false, true };
+	case RenderGraphUsage::InputAttachment:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, 0, false, true };
+	case RenderGraphUsage::Sampled:
+		return { shaderStages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, 0, false, false };
+	case RenderGraphUsage::StorageRead:
+		return { shaderStages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false, false };
+	case RenderGraphUsage::StorageWrite:
+		return { shaderStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true, false };
+	case RenderGraphUsage::TransferSrc:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, false, false };
+	case RenderGraphUsage::TransferDst:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, true, false };
+	case RenderGraphUsage::VertexBuffer:
+		return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, false, false };
+	case RenderGraphUsage::IndexBuffer:
+		return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT, false, false };
+	case RenderGraphUsage::IndirectBuffer:
+		return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, false, false };
+	case RenderGraphUsage::UniformBuffer:
+		return { shaderStages, VK_ACCESS_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, false, false };
+	}
+	throw std::runtime_error("unknown render graph usage!");
+}
+
+bool isDepthFormat(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_S8_UINT:
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool hasStencil(VkFormat format) {
+	return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT ||
+		format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+struct RenderGraphResource {
+	std::string name;
+	bool isImage = true;
+	bool imported = false;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent = {};
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	VkClearValue clear = {};
+
+	// imported resources: state at the start of the frame and the layout it has to end in
+	VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkPipelineStageFlags initialStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	VkAccessFlags initialAccess = 0;
+	VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	bool output = false;
+
+	// set per frame for imported resources, by compileRenderGraph for transient ones
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+
+	// compiled
+	VkImageUsageFlags usage = 0;
+	uint32_t firstPass = UINT32_MAX;
+	uint32_t lastPass = 0;
+	VkPipelineStageFlags allStages = 0;
+	VkAccessFlags writeAccess = 0;
+	VkDeviceSize memoryOffset = 0;
+	VkMemoryRequirements memory = {};
+};
+
+struct RenderGraphUse {
+	uint32_t resource;
+	RenderGraphUsage usage;
+	VkPipelineStageFlags shaderStages;
+	VkAttachmentLoadOp loadOp;
+};
+
+struct RenderGraphContext {
+	VkCommandBuffer cmd;
+	uint32_t frameIndex;
+	VkRenderPass renderPass;     // VK_NULL_HANDLE outside of render passes
+	uint32_t subpass;
+	VkFramebuffer framebuffer;
+	VkExtent2D extent;
+	bool secondary;              // the subpass was begun with SECONDARY_COMMAND_BUFFERS contents
+};
+
+typedef std::function<void(const RenderGraphContext&)> RenderGraphRecordFn;
+
+struct RenderGraphPass {
+	std::string name;
+	bool graphics = true;
+	bool sideEffects = false;
+	bool secondary = false;
+	std::vector<RenderGraphUse> uses;
+	RenderGraphRecordFn record;
+	const char* scopeName = nullptr;  // name owned by the profiler, set on first execution
+
+	// compiled
+	bool culled = false;
+	uint32_t group = UINT32_MAX;
+	uint32_t subpass = 0;
+};
+
+struct RenderGraphBarriers {
+	VkPipelineStageFlags srcStages = 0;
+	VkPipelineStageFlags dstStages = 0;
+	std::vector<VkImageMemoryBarrier> images;    // image handles are patched in per frame
+	std::vector<uint32_t> imageResources;
+	std::vector<VkBufferMemoryBarrier> buffers;
+	std::vector<uint32_t> bufferResources;
+};
+
+struct RenderGraphGroup {
+	std::vector<uint32_t> passes;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	std::vector<uint32_t> attachments;
+	VkExtent2D extent = {};
+	RenderGraphBarriers barriers;
+};
+
+struct RenderGraphStats {
+	uint32_t passes = 0;
+	uint32_t culledPasses = 0;
+	uint32_t renderPasses = 0;
+	uint32_t subpasses = 0;
+	uint32_t barrierBatches = 0;
+	uint32_t imageBarriers = 0;
+	uint32_t bufferBarriers = 0;
+	uint32_t transientImages = 0;
+	VkDeviceSize transientBytes = 0;     // memory actually allocated for transient images
+	VkDeviceSize unaliasedBytes = 0;     // what they would take without aliasing
+};
+
+// Vulkan objects owned by a compiled graph; handed to the deletion queue on rebuild
+struct RenderGraphObjects {
+	std::vector<VkRenderPass> renderPasses;
+	std::vector<VkFramebuffer> framebuffers;
+	std::vector<VkImage> images;
+	std::vector<VkImageView> views;
+	std::vector<MemoryAllocation> allocations;
+};
+
+struct RenderGraph {
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceMemoryAllocator* allocator = nullptr;
+	std::vector<RenderGraphResource> resources;
+	std::vector<RenderGraphPass> passes;
+
+	bool compiled = false;
+	std::vector<RenderGraphGroup> groups;
+	RenderGraphBarriers finalBarriers;
+	RenderGraphObjects objects;
+	std::map<std::vector<uint64_t>, VkFramebuffer> framebuffers;
+	RenderGraphStats stats;
+	GpuProfiler* profiler = nullptr;
+	uint32_t profilerQueue = 0;
+
+	// per-frame scratch, kept to avoid allocations
+	std::vector<uint64_t> framebufferKey;
+	std::vector<VkImageView> framebufferViews;
+	std::vector<VkClearValue> clearValues;
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+};
+
+void initRenderGraph(RenderGraph& graph, VkDevice dev, DeviceMemoryAllocator& allocator) {
+	graph.device = dev;
+	graph.allocator = &allocator;
+}
+
+// passes are timed on queueId of profiler from the next executeRenderGraph on
+void setRenderGraphProfiler(RenderGraph& graph, GpuProfiler* profiler, uint32_t queueId) {
+	graph.profiler = profiler;
+	graph.profilerQueue = queueId;
+}
+
+// ---------------------------------------------------------------------------
+// building
+
+// an image owned by the graph; created by compileRenderGraph if a pass that survives culling uses it
+uint32_t createGraphImage(RenderGraph& graph, const char* name, VkFormat format, VkExtent2D extent,
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT)
+{
+	RenderGraphResource res;
+	res.name = name;
+	res.format = format;
+	res.extent = extent;
+	res.samples = samples;
+	graph.resources.push_back(res);
+	return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+// An image owned by the caller and set each frame with setGraphImage. initialStages is where
+// the previous owner's work ends, e.g. the stage the acquire semaphore is waited on; a
+// finalLayout other than UNDEFINED makes the image an output of the graph.
+uint32_t importGraphImage(RenderGraph& graph, const char* name, VkFormat format, VkExtent2D extent,
+	VkImageLayout initialLayout, VkPipelineStageFlags initialStages, VkImageLayout finalLayout)
+{
+	uint32_t id = createGraphImage(graph, name, format, extent);
+	RenderGraphResource& res = graph.resources[id];
+	res.imported = true;
+	res.initialLayout = initialLayout;
+	res.initialStages = initialStages;
+	res.finalLayout = finalLayout;
+	res.output = finalLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+	return id;
+}
+
+uint32_t importGraphBuffer(RenderGraph& graph, const char* name, VkPipelineStageFlags initialStages,
+	VkAccessFlags initialAccess, bool output)
+{
+	RenderGraphResource res;
+	res.name = name;
+	res.isImage = false;
+	res.imported = true;
+	res.initialStages = initialStages;
+	res.initialAccess = initialAccess;
+	res.output = output;
+	graph.resources.push_back(res);
+	return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+uint32_t addGraphPass(RenderGraph& graph, const char* name, bool graphics, RenderGraphRecordFn record) {
+	RenderGraphPass pass;
+	pass.name = name;
+	pass.graphics = graphics;
+	pass.record = std::move(record);
+	graph.passes.push_back(std::move(pass));
+	return static_cast<uint32_t>(graph.passes.size() - 1);
+}
+
+// the pass is kept even if nothing reads what it writes
+void markGraphPassSideEffects(RenderGraph& graph, uint32_t pass) {
+	graph.passes[pass].sideEffects = true;
+}
+
+void useGraphResource(RenderGraph& graph, uint32_t pass, uint32_t resource, RenderGraphUsage usage,
+	VkPipelineStageFlags shaderStages = 0)
+{
+	if (shaderStages == 0) {
+		shaderStages = graph.passes[pass].graphics ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
+	graph.passes[pass].uses.push_back({ resource, usage, shaderStages, VK_ATTACHMENT_LOAD_OP_LOAD });
+}
+
+// color or depth attachment depending on the format; clear is used with LOAD_OP_CLEAR
+void writeGraphAttachment(RenderGraph& graph, uint32_t pass, uint32_t resource, VkAttachmentLoadOp loadOp,
+	VkClearValue clear = VkClearValue())
+{
+	RenderGraphResource& res = graph.resources[resource];
+	RenderGraphUsage usage = isDepthFormat(res.format) ? RenderGraphUsage::DepthAttachment : RenderGraphUsage::ColorAttachment;
+	graph.passes[pass].uses.push_back({ resource, usage, 0, loadOp });
+	res.clear = clear;
+}
+
+void setGraphImage(RenderGraph& graph, uint32_t resource, VkImage image, VkImageView view) {
+	graph.resources[resource].image = image;
+	graph.resources[resource].view = view;
+}
+
+VkImage graphImage(const RenderGraph& graph, uint32_t resource) {
+	return graph.resources[resource].image;
+}
+
+void setGraphBuffer(RenderGraph& graph, uint32_t resource, VkBuffer buffer) {
+	graph.resources[resource].buffer = buffer;
+}
+
+void setGraphClearValue(RenderGraph& graph, uint32_t resource, const VkClearValue& clear) {
+	graph.resources[resource].clear = clear;
+}
+
+// subpass contents of the pass; may change from frame to frame
+void setGraphPassSecondary(RenderGraph& graph, uint32_t pass, bool secondary) {
+	graph.passes[pass].secondary = secondary;
+}
+
+// render pass and subpass a graphics pass runs in, for pipeline creation
+VkRenderPass graphPassRenderPass(const RenderGraph& graph, uint32_t pass, uint32_t& subpass) {
+	const RenderGraphPass& p = graph.passes[pass];
+	if (p.culled || p.group == UINT32_MAX) {
+		throw std::runtime_error("render graph pass " + p.name + " is not part of the compiled graph!");
+	}
+	subpass = p.subpass;
+	return graph.groups[p.group].renderPass;
+}
+
+// ---------------------------------------------------------------------------
+// compilation
+
+// access state of a resource while the frame is simulated
+struct RenderGraphState {
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkPipelineStageFlags writeStages = 0;   // stages of the last write (or transition)
+	VkAccessFlags writeAccess = 0;
+	VkPipelineStageFlags readStages = 0;    // stages that already wait for the last write
+};
+
+// walks passes backwards from outputs and side effects; returns the number of culled passes
+uint32_t cullRenderGraph(RenderGraph& graph) {
+	std::vector<bool> live(graph.resources.size(), false);
+	for (size_t i = 0; i < graph.resources.size(); i++) {
+		live[i] = graph.resources[i].output;
+	}
+	uint32_t culled = 0;
+	for (size_t p = graph.passes.size(); p-- > 0;) {
+		RenderGraphPass& pass = graph.passes[p];
+		bool needed = pass.sideEffects;
+		for (const auto& use : pass.uses) {
+			needed = needed || (renderGraphUsageInfo(use.usage, use.shaderStages).write && live[use.resource]);
+		}
+		pass.culled = !needed;
+		if (!needed) {
+			culled++;
+			continue;
+		}
+		for (const auto& use : pass.uses) {
+			RenderGraphUsageInfo info = renderGraphUsageInfo(use.usage, use.shaderStages);
+			// a cleared attachment does not depend on earlier writers
+			bool overwrites = info.attachment && info.write && use.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+			if (!overwrites) {
+				live[use.resource] = true;
+			}
+			else {
+				live[use.resource] = false;
+			}
+		}
+		// resources read and overwritten by the same pass stay live
+		for (const auto& use : pass.uses) {
+			if (!renderGraphUsageInfo(use.usage, use.shaderStages).write) {
+				live[use.resource] = true;
+			}
+		}
+	}
+	return culled;
+}
+
+bool graphPassUsesAttachmentOf(const RenderGraph& graph, const RenderGraphGroup& group, uint32_t resource, bool& asAttachment) {
+	for (uint32_t p : group.passes) {
+		for (const auto& use : graph.passes[p].uses) {
+			if (use.resource == resource) {
+				asAttachment = asAttachment || renderGraphUsageInfo(use.usage, use.shaderStages).attachment;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// a graphics pass joins the open render pass when everything it shares with the passes already
+// in it is an attachment; anything else would need a barrier inside the render pass
+bool canMergeGraphPass(const RenderGraph& graph, const RenderGraphGroup& group, const RenderGraphPass& pass) {
+	if (group.passes.empty()) {
+		return false;
+	}
+	const RenderGraphPass& first = graph.passes[group.passes.front()];
+	if (!first.graphics || !pass.graphics) {
+		return false;
+	}
+	for (const auto& use : pass.uses) {
+		const RenderGraphResource& res = graph.resources[use.resource];
+		RenderGraphUsageInfo info = renderGraphUsageInfo(use.usage, use.shaderStages);
+		if (info.attachment && (res.extent.width != group.extent.width || res.extent.height != group.extent.height)) {
+			return false;
+		}
+		bool asAttachment = false;
+		bool shared = graphPassUsesAttachmentOf(graph, group, use.resource, asAttachment);
+		if (shared && (!info.attachment || !asAttachment)) {
+			return false;
+		}
+		if (shared && info.attachment && info.write && use.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD) {
+			return false; // clearing mid render pass is not what the declaration order says
+		}
+	}
+	return true;
+}
+
+VkExtent2D graphPassExtent(const RenderGraph& graph, const RenderGraphPass& pass) {
+	for (const auto& use : pass.uses) {
+		if (renderGraphUsageInfo(use.usage, use.shaderStages).attachment) {
+			return graph.resources[use.resource].extent;
+		}
+	}
+	return VkExtent2D();
+}
+
+void addGraphBarrier(RenderGraph& graph, RenderGraphBarriers& batch, uint32_t resource, RenderGraphState& state,
+	const RenderGraphUsageInfo& info)
+{
+	const RenderGraphResource& res = graph.resources[resource];
+	bool layoutChange = res.isImage && state.layout != info.layout;
+	VkPipelineStageFlags src = 0;
+	VkAccessFlags srcAccess = 0;
+	if (info.write || layoutChange) {
+		// write-after-write and write-after-read; a layout transition is a write too
+		src = state.writeStages | state.readStages;
+		srcAccess = state.writeAccess;
+	}
+	else if (state.writeStages && (info.stages & ~state.readStages)) {
+		src = state.writeStages;
+		srcAccess = state.writeAccess;
+	}
+
+	if (src || layoutChange) {
+		batch.srcStages |= src ? src : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		batch.dstStages |= info.stages;
+		if (res.isImage) {
+			auto it = std::find(batch.imageResources.begin(), batch.imageResources.end(), resource);
+			if (it != batch.imageResources.end()) {
+				VkImageMemoryBarrier& barrier = batch.images[it - batch.imageResources.begin()];
+				if (barrier.newLayout != info.layout) {
+					throw std::runtime_error("render graph: " + res.name + " needs two layouts at once!");
+				}
+				barrier.dstAccessMask |= info.access;
+			}
+			else {
+				VkImageMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstAccessMask = info.access;
+				barrier.oldLayout = state.layout;
+				barrier.newLayout = info.layout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.subresourceRange.aspectMask = isDepthFormat(res.format)
+					? (VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil(res.format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0)) : VK_IMAGE_ASPECT_COLOR_BIT;
+				barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+				barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+				batch.images.push_back(barrier);
+				batch.imageResources.push_back(resource);
+			}
+		}
+		else {
+			auto it = std::find(batch.bufferResources.begin(), batch.bufferResources.end(), resource);
+			if (it != batch.bufferResources.end()) {
+				batch.buffers[it - batch.bufferResources.begin()].dstAccessMask |= info.access;
+			}
+			else {
+				VkBufferMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstAccessMask = info.access;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.size = VK_WHOLE_SIZE;
+				batch.buffers.push_back(barrier);
+				batch.bufferResources.push_back(resource);
+			}
+		}
+	}
+
+	if (info.write) {
+		state.writeStages = info.stages;
+		state.writeAccess = info.access & kRenderGraphWriteAccess;
+		state.readStages = 0;
+	}
+	else if (layoutChange) {
+		state.writeStages = info.stages;
+		state.readStages = info.stages;
+	}
+	else {
+		state.readStages |= info.stages;
+	}
+	if (res.isImage) {
+		state.layout = info.layout;
+	}
+}
+
+// Places transient images in one allocation: biggest first, each at the lowest offset that does
+// not collide with an already placed image whose lifetime overlaps its own.
+void allocateGraphImages(RenderGraph& graph, const std::vector<uint32_t>& transient) {
+	std::vector<uint32_t> order = transient;
+	std::sort(order.begin(), order.end(), [&graph](uint32_t a, uint32_t b) {
+		return graph.resources[a].memory.size > graph.resources[b].memory.size;
+	});
+	uint32_t typeBits = UINT32_MAX;
+	VkDeviceSize alignment = 1;
+	for (uint32_t r : order) {
+		typeBits &= graph.resources[r].memory.memoryTypeBits;
+		alignment = std::max(alignment, graph.resources[r].memory.alignment);
+	}
+
+	std::vector<uint32_t> placed;
+	VkDeviceSize total = 0;
+	for (uint32_t r : order) {
+		RenderGraphResource& res = graph.resources[r];
+		graph.stats.unaliasedBytes += res.memory.size;
+		std::vector<uint32_t> overlapping;
+		for (uint32_t o : placed) {
+			const RenderGraphResource& other = graph.resources[o];
+			if (other.firstPass <= res.lastPass && res.firstPass <= other.lastPass) {
+				overlapping.push_back(o);
+			}
+		}
+		std::sort(overlapping.begin(), overlapping.end(), [&graph](uint32_t a, uint32_t b) {
+			return graph.resources[a].memoryOffset < graph.resources[b].memoryOffset;
+		});
+		VkDeviceSize offset = 0;
+		for (uint32_t o : overlapping) {
+			const RenderGraphResource& other = graph.resources[o];
+			offset = alignUp(offset, res.memory.alignment);
+			if (offset + res.memory.size <= other.memoryOffset) {
+				break;
+			}
+			offset = std::max(offset, other.memoryOffset + other.memory.size);
+		}
+		res.memoryOffset = alignUp(offset, res.memory.alignment);
+		total = std::max(total, res.memoryOffset + res.memory.size);
+		placed.push_back(r);
+	}
+
+	if (typeBits == 0) {
+		// no memory type fits all of them; give up on aliasing
+		for (uint32_t r : order) {
+			RenderGraphResource& res = graph.resources[r];
+			MemoryAllocation allocation = allocateMemory(*graph.allocator, res.memory, MemoryUsage::GpuOnly, ResourceTiling::Optimal);
+			vkBindImageMemory(graph.device, res.image, allocation.memory, allocation.offset);
+			graph.objects.allocations.push_back(allocation);
+			graph.stats.transientBytes += res.memory.size;
+		}
+		return;
+	}
+	VkMemoryRequirements heap = {};
+	heap.size = total;
+	heap.alignment = alignment;
+	heap.memoryTypeBits = typeBits;
+	MemoryAllocation allocation = allocateMemory(*graph.allocator, heap, MemoryUsage::GpuOnly, ResourceTiling::Optimal);
+	for (uint32_t r : order) {
+		vkBindImageMemory(graph.device, graph.resources[r].image, allocation.memory, allocation.offset + graph.resources[r].memoryOffset);
+	}
+	graph.objects.allocations.push_back(allocation);
+	graph.stats.transientBytes += total;
+}
+
+void createGraphImages(RenderGraph& graph) {
+	std::vector<uint32_t> transient;
+	for (uint32_t r = 0; r < graph.resources.size(); r++) {
+		RenderGraphResource& res = graph.resources[r];
+		if (res.imported || !res.isImage || res.firstPass == UINT32_MAX) {
+			continue;
+		}
+		// only ever an attachment: the contents never have to leave tile memory
+		const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		VkImageUsageFlags usage = res.usage;
+		if ((usage & ~attachmentUsage) == 0) {
+			usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+
+		VkImageCreateInfo image_ci = {};
+		image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_ci.imageType = VK_IMAGE_TYPE_2D;
+		image_ci.format = res.format;
+		image_ci.extent = { res.extent.width, res.extent.height, 1 };
+		image_ci.mipLevels = 1;
+		image_ci.arrayLayers = 1;
+		image_ci.samples = res.samples;
+		image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_ci.usage = usage;
+		image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		if (vkCreateImage(graph.device, &image_ci, hostAllocationCallbacks(), &res.image) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create render graph image " + res.name + "!");
+		}
+		vkGetImageMemoryRequirements(graph.device, res.image, &res.memory);
+		setObjectName(graph.device, VK_OBJECT_TYPE_IMAGE, res.image, res.name.c_str());
+		graph.objects.images.push_back(res.image);
+		transient.push_back(r);
+	}
+	graph.stats.transientImages = static_cast<uint32_t>(transient.size());
+	if (transient.empty()) {
+		return;
+	}
+	allocateGraphImages(graph, transient);
+
+	for (uint32_t r : transient) {
+		RenderGraphResource& res = graph.resources[r];
+		VkImageViewCreateInfo view_ci = {};
+		view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_ci.image = res.image;
+		view_ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_ci.format = res.format;
+		view_ci.subresourceRange.aspectMask = isDepthFormat(res.format)
+			? (VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil(res.format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0)) : VK_IMAGE_ASPECT_COLOR_BIT;
+		view_ci.subresourceRange.levelCount = 1;
+		view_ci.subresourceRange.layerCount = 1;
+		if (vkCreateImageView(graph.device, &view_ci, hostAllocationCallbacks(), &res.view) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create render graph image view!");
+		}
+		graph.objects.views.push_back(res.view);
+	}
+}
+
+// A transient image starts the frame undefined, after everything that touched its memory in the
+// previous frame (itself and the images aliasing it) on the same queue.
+RenderGraphState initialGraphState(const RenderGraph& graph, uint32_t resource) {
+	const RenderGraphResource& res = graph.resources[resource];
+	RenderGraphState state;
+	if (res.imported) {
+		state.layout = res.initialLayout;
+		state.writeStages = res.initialStages;
+		state.writeAccess = res.initialAccess;
+		return state;
+	}
+	for (const RenderGraphResource& other : graph.resources) {
+		if (other.imported || other.image == VK_NULL_HANDLE) {
+			continue;
+		}
+		bool overlaps = other.memoryOffset < res.memoryOffset + res.memory.size &&
+			res.memoryOffset < other.memoryOffset + other.memory.size;
+		if (overlaps) {
+			state.writeStages |= other.allStages;
+			state.writeAccess |= other.writeAccess;
+		}
+	}
+	return state;
+}
+
+bool isGraphResourceUsedAfter(const RenderGraph& graph, uint32_t resource, uint32_t groupIndex) {
+	return graph.resources[resource].imported || graph.resources[resource].lastPass > graph.groups[groupIndex].passes.back();
+}
+
+void createGraphRenderPass(RenderGraph& graph, uint32_t groupIndex, std::vector<RenderGraphState>& states) {
+	RenderGraphGroup& group = graph.groups[groupIndex];
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<std::vector<VkAttachmentReference>> colorRefs(group.passes.size()), inputRefs(group.passes.size());
+	std::vector<VkAttachmentReference> depthRefs(group.passes.size(), { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+	std::vector<std::vector<uint32_t>> preserveRefs(group.passes.size());
+	std::vector<VkSubpassDependency> dependencies;
+	auto dependency = [&dependencies](uint32_t src, uint32_t dst) -> VkSubpassDependency& {
+		for (auto& d : dependencies) {
+			if (d.srcSubpass == src && d.dstSubpass == dst) {
+				return d;
+			}
+		}
+		VkSubpassDependency d = {};
+		d.srcSubpass = src;
+		d.dstSubpass = dst;
+		dependencies.push_back(d);
+		return dependencies.back();
+	};
+	VkPipelineStageFlags endStages = 0;
+	VkAccessFlags endAccess = 0;
+
+	for (uint32_t a = 0; a < group.attachments.size(); a++) {
+		uint32_t r = group.attachments[a];
+		const RenderGraphResource& res = graph.resources[r];
+		RenderGraphState& state = states[r];
+		VkAttachmentDescription desc = {};
+		desc.format = res.format;
+		desc.samples = res.samples;
+
+		uint32_t previous = UINT32_MAX;     // subpass that last used the attachment
+		RenderGraphUsageInfo previousInfo = {};
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		bool written = false;
+		for (uint32_t s = 0; s < group.passes.size(); s++) {
+			const RenderGraphPass& pass = graph.passes[group.passes[s]];
+			bool usedHere = false;
+			for (const auto& use : pass.uses) {
+				if (use.resource != r) {
+					continue;
+				}
+				RenderGraphUsageInfo info = renderGraphUsageInfo(use.usage, use.shaderStages);
+				usedHere = true;
+				if (previous == UINT32_MAX) {
+					bool load = !info.write || use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+					desc.loadOp = info.write ? use.loadOp : VK_ATTACHMENT_LOAD_OP_LOAD;
+					desc.initialLayout = load ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+					VkSubpassDependency& d = dependency(VK_SUBPASS_EXTERNAL, s);
+					d.srcStageMask |= state.writeStages | state.readStages | VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					d.srcAccessMask |= state.writeAccess;
+					d.dstStageMask |= info.stages;
+					d.dstAccessMask |= info.access;
+				}
+				else if (previous != s) {
+					VkSubpassDependency& d = dependency(previous, s);
+					d.srcStageMask |= previousInfo.stages;
+					d.srcAccessMask |= previousInfo.access & kRenderGraphWriteAccess;
+					d.dstStageMask |= info.stages;
+					d.dstAccessMask |= info.access;
+					d.dependencyFlags |= VK_DEPENDENCY_BY_REGION_BIT;
+				}
+				VkAttachmentReference ref = { a, info.layout };
+				if (use.usage == RenderGraphUsage::InputAttachment) {
+					inputRefs[s].push_back(ref);
+				}
+				else if (use.usage == RenderGraphUsage::ColorAttachment) {
+					colorRefs[s].push_back(ref);
+				}
+				else {
+					depthRefs[s] = ref;
+				}
+				previousInfo = info;
+				layout = info.layout;
+				written = written || info.write;
+				endStages |= info.stages;
+				endAccess |= info.access & kRenderGraphWriteAccess;
+			}
+			if (usedHere) {
+				previous = s;
+			}
+		}
+		// keep the contents across subpasses that do not touch the attachment
+		uint32_t first = UINT32_MAX;
+		for (uint32_t s = 0; s < group.passes.size(); s++) {
+			bool usedHere = false;
+			for (const auto& use : graph.passes[group.passes[s]].uses) {
+				usedHere = usedHere || use.resource == r;
+			}
+			if (usedHere) {
+				first = std::min(first, s);
+			}
+			else if (first != UINT32_MAX && s < previous) {
+				preserveRefs[s].push_back(a);
+			}
+		}
+
+		bool usedAfter = isGraphResourceUsedAfter(graph, r, groupIndex);
+		desc.storeOp = usedAfter ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		desc.stencilLoadOp = hasStencil(res.format) ? desc.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		desc.stencilStoreOp = hasStencil(res.format) ? desc.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		bool last = res.lastPass == group.passes.back();
+		desc.finalLayout = (last && res.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED) ? res.finalLayout : layout;
+		attachments.push_back(desc);
+
+		state.layout = desc.finalLayout;
+		if (written || desc.finalLayout != layout) {
+			state.writeStages = previousInfo.stages;
+			state.writeAccess = previousInfo.access & kRenderGraphWriteAccess;
+			state.readStages = 0;
+		}
+		else {
+			state.readStages |= previousInfo.stages;
+		}
+	}
+	// later barriers chain on these stages, which also orders the final layout transitions
+	VkSubpassDependency& out = dependency(static_cast<uint32_t>(group.passes.size() - 1), VK_SUBPASS_EXTERNAL);
+	out.srcStageMask |= endStages;
+	out.srcAccessMask |= endAccess;
+	out.dstStageMask |= endStages;
+
+	std::vector<VkSubpassDescription> subpasses(group.passes.size());
+	for (uint32_t s = 0; s < group.passes.size(); s++) {
+		VkSubpassDescription& sub = subpasses[s];
+		sub = {};
+		sub.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		sub.colorAttachmentCount = static_cast<uint32_t>(colorRefs[s].size());
+		sub.pColorAttachments = colorRefs[s].data();
+		sub.inputAttachmentCount = static_cast<uint32_t>(inputRefs[s].size());
+		sub.pInputAttachments = inputRefs[s].data();
+		sub.pDepthStencilAttachment = depthRefs[s].attachment != VK_ATTACHMENT_UNUSED ? &depthRefs[s] : nullptr;
+		sub.preserveAttachmentCount = static_cast<uint32_t>(preserveRefs[s].size());
+		sub.pPreserveAttachments = preserveRefs[s].data();
+		graph.passes[group.passes[s]].subpass = s;
+	}
+
+	VkRenderPassCreateInfo renderPass_ci = {};
+	renderPass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPass_ci.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPass_ci.pAttachments = attachments.data();
+	renderPass_ci.subpassCount = static_cast<uint32_t>(subpasses.size());
+	renderPass_ci.pSubpasses = subpasses.data();
+	renderPass_ci.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPass_ci.pDependencies = dependencies.data();
+	if (vkCreateRenderPass(graph.device, &renderPass_ci, hostAllocationCallbacks(), &group.renderPass) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create render pass!");
+	}
+	setObjectName(graph.device, VK_OBJECT_TYPE_RENDER_PASS, group.renderPass, graph.passes[group.passes[0]].name.c_str());
+	graph.objects.renderPasses.push_back(group.renderPass);
+	graph.stats.renderPasses++;
+	graph.stats.subpasses += static_cast<uint32_t>(subpasses.size());
+}
+
+void countGraphBarriers(RenderGraph& graph, const RenderGraphBarriers& batch) {
+	if (!batch.images.empty() || !batch.buffers.empty()) {
+		graph.stats.barrierBatches++;
+		graph.stats.imageBarriers += static_cast<uint32_t>(batch.images.size());
+		graph.stats.bufferBarriers += static_cast<uint32_t>(batch.buffers.size());
+	}
+}
+
+void compileRenderGraph(RenderGraph& graph) {
+	graph.stats = RenderGraphStats();
+	graph.stats.passes = static_cast<uint32_t>(graph.passes.size());
+	graph.stats.culledPasses = cullRenderGraph(graph);
+
+	// group passes into render passes
+	for (uint32_t p = 0; p < graph.passes.size(); p++) {
+		RenderGraphPass& pass = graph.passes[p];
+		if (pass.culled) {
+			continue;
+		}
+		if (graph.groups.empty() || !canMergeGraphPass(graph, graph.groups.back(), pass)) {
+			graph.groups.push_back(RenderGraphGroup());
+			graph.groups.back().extent = graphPassExtent(graph, pass);
+		}
+		RenderGraphGroup& group = graph.groups.back();
+		pass.group = static_cast<uint32_t>(graph.groups.size() - 1);
+		group.passes.push_back(p);
+		for (const auto& use : pass.uses) {
+			RenderGraphResource& res = graph.resources[use.resource];
+			RenderGraphUsageInfo info = renderGraphUsageInfo(use.usage, use.shaderStages);
+			if (info.attachment && pass.graphics &&
+				std::find(group.attachments.begin(), group.attachments.end(), use.resource) == group.attachments.end()) {
+				group.attachments.push_back(use.resource);
+			}
+			res.usage |= info.imageUsage;
+			res.firstPass = std::min(res.firstPass, p);
+			res.lastPass = std::max(res.lastPass, p);
+			res.allStages |= info.stages;
+			res.writeAccess |= info.write ? (info.access & kRenderGraphWriteAccess) : 0;
+		}
+	}
+	createGraphImages(graph);
+
+	// simulate one frame to place barriers and build the render passes
+	std::vector<RenderGraphState> states(graph.resources.size());
+	for (uint32_t r = 0; r < graph.resources.size(); r++) {
+		states[r] = initialGraphState(graph, r);
+	}
+	for (uint32_t g = 0; g < graph.groups.size(); g++) {
+		RenderGraphGroup& group = graph.groups[g];
+		for (uint32_t p : group.passes) {
+			for (const auto& use : graph.passes[p].uses) {
+				RenderGraphUsageInfo info = renderGraphUsageInfo(use.usage, use.shaderStages);
+				if (!(info.attachment && graph.passes[p].graphics)) {
+					addGraphBarrier(graph, group.barriers, use.resource, states[use.resource], info);
+				}
+			}
+		}
+		if (!group.attachments.empty()) {
+			createGraphRenderPass(graph, g, states);
+		}
+		countGraphBarriers(graph, group.barriers);
+	}
+
+	// outputs end in the layout the caller asked for
+	for (uint32_t r = 0; r < graph.resources.size(); r++) {
+		const RenderGraphResource& res = graph.resources[r];
+		if (res.isImage && res.imported && res.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED && states[r].layout != res.finalLayout) {
+			RenderGraphUsageInfo info = {};
+			info.stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			info.layout = res.finalLayout;
+			addGraphBarrier(graph, graph.finalBarriers, r, states[r], info);
+		}
+	}
+	countGraphBarriers(graph, graph.finalBarriers);
+	graph.compiled = true;
+}
+
+// ---------------------------------------------------------------------------
+// execution
+
+void emitGraphBarriers(RenderGraph& graph, VkCommandBuffer cmd, const RenderGraphBarriers& batch) {
+	if (batch.images.empty() && batch.buffers.empty()) {
+		return;
+	}
+	graph.imageBarriers.assign(batch.images.begin(), batch.images.end());
+	for (size_t i = 0; i < batch.images.size(); i++) {
+		graph.imageBarriers[i].image = graph.resources[batch.imageResources[i]].image;
+	}
+	graph.bufferBarriers.assign(batch.buffers.begin(), batch.buffers.end());
+	for (size_t i = 0; i < batch.buffers.size(); i++) {
+		graph.bufferBarriers[i].buffer = graph.resources[batch.bufferResources[i]].buffer;
+	}
+	vkCmdPipelineBarrier(cmd, batch.srcStages, batch.dstStages, 0, 0, nullptr,
+		static_cast<uint32_t>(graph.bufferBarriers.size()), graph.bufferBarriers.data(),
+		static_cast<uint32_t>(graph.imageBarriers.size()), graph.imageBarriers.data());
+}
+
+// imported images change from frame to frame, so framebuffers are cached by their views
+VkFramebuffer getGraphFramebuffer(RenderGraph& graph, const RenderGraphGroup& group) {
+	graph.framebufferKey.clear();
+	graph.framebufferViews.clear();
+	graph.framebufferKey.push_back((uint64_t)group.renderPass);
+	for (uint32_t r : group.attachments) {
+		graph.framebufferKey.push_back((uint64_t)graph.resources[r].view);
+		graph.framebufferViews.push_back(graph.resources[r].view);
+	}
+	auto it = graph.framebuffers.find(graph.framebufferKey);
+	if (it != graph.framebuffers.end()) {
+		return it->second;
+	}
+	VkFramebufferCreateInfo framebuffer_ci = {};
+	framebuffer_ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebuffer_ci.renderPass = group.renderPass;
+	framebuffer_ci.attachmentCount = static_cast<uint32_t>(graph.framebufferViews.size());
+	framebuffer_ci.pAttachments = graph.framebufferViews.data();
+	framebuffer_ci.width = group.extent.width;
+	framebuffer_ci.height = group.extent.height;
+	framebuffer_ci.layers = 1;
+	VkFramebuffer framebuffer;
+	if (vkCreateFramebuffer(graph.device, &framebuffer_ci, hostAllocationCallbacks(), &framebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create framebuffer!");
+	}
+	graph.framebuffers[graph.framebufferKey] = framebuffer;
+	graph.objects.framebuffers.push_back(framebuffer);
+	return framebuffer;
+}
+
+uint32_t beginGraphPassScope(RenderGraph& graph, VkCommandBuffer cmd, RenderGraphPass& pass) {
+	if (!graph.profiler) {
+		return kProfilerNoScope;
+	}
+	if (!pass.scopeName) {
+		pass.scopeName = profilerScopeName(*graph.profiler, pass.name);
+	}
+	return beginGpuScope(*graph.profiler, cmd, graph.profilerQueue, pass.scopeName);
+}
+
+void endGraphPassScope(RenderGraph& graph, VkCommandBuffer cmd, uint32_t scope) {
+	if (graph.profiler) {
+		endGpuScope(*graph.profiler, cmd, scope);
+	}
+}
+
+void executeRenderGraph(RenderGraph& graph, VkCommandBuffer cmd, uint32_t frameIndex) {
+	if (!graph.compiled) {
+		throw std::runtime_error("render graph is not compiled!");
+	}
+	for (const RenderGraphGroup& group : graph.groups) {
+		emitGraphBarriers(graph, cmd, group.barriers);
+		RenderGraphContext ctx = {};
+		ctx.cmd = cmd;
+		ctx.frameIndex = frameIndex;
+		ctx.extent = group.extent;
+		if (group.renderPass == VK_NULL_HANDLE) {
+			for (uint32_t p : group.passes) {
+				beginDebugLabel(cmd, graph.passes[p].name.c_str());
+				uint32_t scope = beginGraphPassScope(graph, cmd, graph.passes[p]);
+				graph.passes[p].record(ctx);
+				endGraphPassScope(graph, cmd, scope);
+				endDebugLabel(cmd);
+			}
+			continue;
+		}
+
+		graph.clearValues.clear();
+		for (uint32_t r : group.attachments) {
+			graph.clearValues.push_back(graph.resources[r].clear);
+		}
+		ctx.renderPass = group.renderPass;
+		ctx.framebuffer = getGraphFramebuffer(graph, group);
+		VkRenderPassBeginInfo renderPass_bi = {};
+		renderPass_bi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPass_bi.renderPass = group.renderPass;
+		renderPass_bi.framebuffer = ctx.framebuffer;
+		renderPass_bi.renderArea.extent = group.extent;
+		renderPass_bi.clearValueCount = static_cast<uint32_t>(graph.clearValues.size());
+		renderPass_bi.pClearValues = graph.clearValues.data();
+		beginDebugLabel(cmd, graph.passes[group.passes[0]].name.c_str());
+		// timestamps cannot be written in a subpass with secondary contents
+		bool secondary = false;
+		for (uint32_t p : group.passes) {
+			secondary |= graph.passes[p].secondary;
+		}
+		uint32_t groupScope = secondary ? beginGraphPassScope(graph, cmd, graph.passes[group.passes[0]]) : kProfilerNoScope;
+		for (uint32_t s = 0; s < group.passes.size(); s++) {
+			RenderGraphPass& pass = graph.passes[group.passes[s]];
+			VkSubpassContents contents = pass.secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+			if (s == 0) {
+				vkCmdBeginRenderPass(cmd, &renderPass_bi, contents);
+			}
+			else {
+				vkCmdNextSubpass(cmd, contents);
+			}
+			ctx.subpass = s;
+			ctx.secondary = pass.secondary;
+			// a subpass with secondary contents only accepts vkCmdExecuteCommands; the render pass label covers it
+			if (!pass.secondary) {
+				beginDebugLabel(cmd, pass.name.c_str());
+			}
+			uint32_t scope = secondary ? kProfilerNoScope : beginGraphPassScope(graph, cmd, pass);
+			pass.record(ctx);
+			endGraphPassScope(graph, cmd, scope);
+			if (!pass.secondary) {
+				endDebugLabel(cmd);
+			}
+		}
+		vkCmdEndRenderPass(cmd);
+		endGraphPassScope(graph, cmd, groupScope);
+		endDebugLabel(cmd);
+	}
+	emitGraphBarriers(graph, cmd, graph.finalBarriers);
+}
+
+void dumpRenderGraphStats(const RenderGraph& graph) {
+	const RenderGraphStats& s = graph.stats;
+	std::cout << "render graph:\t" << s.passes << " passes (" << s.culledPasses << " culled), " << s.renderPasses
+		<< " render passes / " << s.subpasses << " subpasses, " << s.barrierBatches << " barrier batches ("
+		<< s.imageBarriers << " image, " << s.bufferBarriers << " buffer), " << s.transientImages << " transient images in "
+		<< s.transientBytes / 1024 << " KB (" << s.unaliasedBytes / 1024 << " KB without aliasing)\n";
+}
+
+// Detaches the compiled objects so they can be destroyed once frames in flight are done with
+// them, and empties the graph for a rebuild.
+RenderGraphObjects releaseRenderGraph(RenderGraph& graph) {
+	RenderGraphObjects objects = std::move(graph.objects);
+	RenderGraph empty;
+	empty.device = graph.device;
+	empty.allocator = graph.allocator;
+	empty.profiler = graph.profiler;
+	empty.profilerQueue = graph.profilerQueue;
+	graph = std::move(empty);
+	return objects;
+}
+
+void destroyRenderGraphObjects(VkDevice dev, DeviceMemoryAllocator& allocator, RenderGraphObjects& objects) {
+	for (VkFramebuffer framebuffer : objects.framebuffers) {
+		vkDestroyFramebuffer(dev, framebuffer, hostAllocationCallbacks());
+	}
+	for (VkRenderPass renderPass : objects.renderPasses) {
+		vkDestroyRenderPass(dev, renderPass, hostAllocationCallbacks());
+	}
+	for (VkImageView view : objects.views) {
+		vkDestroyImageView(dev, view, hostAllocationCallbacks());
+	}
+	for (VkImage image : objects.images) {
+		vkDestroyImage(dev, image, hostAllocationCallbacks());
+	}
+	for (MemoryAllocation& allocation : objects.allocations) {
+		freeMemory(allocator, allocation);
+	}
+	objects = RenderGraphObjects();
+}
+
+void destroyRenderGraph(RenderGraph& graph) {
+	DeviceMemoryAllocator* allocator = graph.allocator;
+	VkDevice dev = graph.device;
+	RenderGraphObjects objects = releaseRenderGraph(graph);
+	if (allocator) {
+		destroyRenderGraphObjects(dev, *allocator, objects);
+	}
+}
@@ -0,0 +1,34 @@
+#version 450
+
+// objects of the GPU-driven scene: the instance index points into the visible list that
+// cull.comp wrote, or straight at the object when the CPU issued one draw per object
+layout(push_constant) uniform View {
+	vec2 center;
+	float zoom;
+	float aspect;
+	uint direct;
+} view;
+
+layout(set = 0, binding = 0) readonly buffer Objects {
+	vec4 objects[];
+};
+
+layout(set = 0, binding = 1) readonly buffer Visible {
+	uint visible[];
+};
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+	uint index = view.direct != 0u ? uint(gl_InstanceIndex) : visible[gl_InstanceIndex];
+	vec4 object = objects[index];
+	float c = cos(object.w);
+	float s = sin(object.w);
+	vec2 position = object.xy + mat2(c, s, -s, c) * inPosition * object.z;
+	position = (position - view.center) * view.zoom;
+	gl_Position = vec4(position.x * view.aspect, position.y, 0.0, 1.0);
+	fragColor = inColor;
+}
@@ -0,0 +1,20 @@
+#version 450
+
+// draws are laid out on a columns x columns grid by instance index
+layout(push_constant) uniform DrawGrid {
+	uint columns;
+} grid;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec4 inParticle; // per instance, written by particles.comp
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+	float cell = 2.0 / float(grid.columns);
+	uint index = uint(gl_InstanceIndex) % (grid.columns * grid.columns);
+	vec2 origin = vec2(-1.0) + cell * (vec2(index % grid.columns, index / grid.columns) + 0.5);
+	gl_Position = vec4(origin + (inPosition * 0.5 + inParticle.xy) * cell, 0.0, 1.0);
+	fragColor = inColor;
+}
@@ -0,0 +1,753 @@
+#pragma once
+
+// SPIR-V loading and reflection.
+// Shader binaries are memory-mapped and parsed once for their descriptor bindings, push
+// constant block, specialization constants, vertex inputs and workgroup size. Descriptor set
+// and pipeline layouts are built from the merged reflection of a pipeline's stages through a
+// cache keyed by a hash of the layout description, so shaders with the same interface share
+// one VkDescriptorSetLayout / VkPipelineLayout and sets stay compatible between pipelines.
+
+#include "vk_dispatch.h"
+#include <vulkan/spirv.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "host_allocator.h"
+
+// ---------------------------------------------------------------------------
+// memory-mapped files
+
+struct MappedFile {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+bool mapFile(const std::string& path, MappedFile& mapped) {
+	mapped = MappedFile();
+#ifdef _WIN32
+	mapped.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mapped.file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mapped.file, &size) || size.QuadPart == 0) {
+		CloseHandle(mapped.file);
+		mapped.file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	mapped.mapping = CreateFileMappingA(mapped.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* view = mapped.mapping ? MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view) {
+		if (mapped.mapping) {
+			CloseHandle(mapped.mapping);
+		}
+		CloseHandle(mapped.file);
+		mapped = MappedFile();
+		return false;
+	}
+	mapped.data = static_cast<const uint8_t*>(view);
+	mapped.size = static_cast<size_t>(size.QuadPart);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file referenced
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	mapped.data = static_cast<const uint8_t*>(view);
+	mapped.size = static_cast<size_t>(st.st_size);
+#endif
+	return true;
+}
+
+void unmapFile(MappedFile& mapped) {
+	if (!mapped.data) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(mapped.data);
+	CloseHandle(mapped.mapping);
+	CloseHandle(mapped.file);
+#else
+	munmap(const_cast<uint8_t*>(mapped.data), mapped.size);
+#endif
+	mapped = MappedFile();
+}
+
+// ---------------------------------------------------------------------------
+// reflection
+
+struct ShaderBinding {
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	VkDescriptorType descriptorType = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	uint32_t descriptorCount = 1;   // 0: runtime-sized array
+	std::string name;
+};
+
+struct ShaderSpecConstant {
+	uint32_t constantId = 0;
+	uint32_t size = 0;
+	uint32_t defaultValue = 0;      // low word of the default
+	std::string name;
+};
+
+struct ShaderVertexInput {
+	uint32_t location = 0;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	std::string name;
+};
+
+struct ShaderReflection {
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+	std::string entryPoint;
+	std::vector<ShaderBinding> bindings;
+	uint32_t pushConstantOffset = 0;
+	uint32_t pushConstantSize = 0;  // 0: no push constant block
+	std::vector<ShaderSpecConstant> specConstants;
+	std::vector<ShaderVertexInput> vertexInputs;  // vertex stage only, built-ins excluded
+	uint32_t localSize[3] = { 0, 0, 0 };          // compute stage only
+};
+
+// everything the parser needs to know about one result id
+struct SpirvId {
+	uint32_t opcode = 0;
+	uint32_t typeId = 0;          // result type; pointee/element/component type for type ids
+	uint32_t storageClass = 0;
+	uint32_t count = 0;           // vector components, matrix columns, array length id
+	uint32_t width = 0;
+	uint32_t signedness = 0;
+	uint32_t imageDim = 0;
+	uint32_t imageSampled = 0;
+	uint32_t value = 0;           // OpConstant / OpSpecConstant low word
+	uint32_t set = UINT32_MAX;
+	uint32_t binding = UINT32_MAX;
+	uint32_t location = UINT32_MAX;
+	uint32_t specId = UINT32_MAX;
+	uint32_t arrayStride = 0;
+	bool builtIn = false;
+	bool block = false;
+	bool bufferBlock = false;
+	std::vector<uint32_t> members;
+	std::vector<uint32_t> memberOffsets;
+	std::vector<uint32_t> memberMatrixStrides;
+	bool memberBuiltIn = false;
+	std::string name;
+};
+
+std::string spirvString(const uint32_t* words, uint32_t wordCount) {
+	const char* str = reinterpret_cast<const char*>(words);
+	return std::string(str, strnlen(str, wordCount * 4));
+}
+
+uint32_t spirvTypeSize(const std::vector<SpirvId>& ids, uint32_t typeId, uint32_t matrixStride) {
+	const SpirvId& type = ids[typeId];
+	switch (type.opcode) {
+	case SpvOpTypeBool:
+		return 4;
+	case SpvOpTypeInt:
+	case SpvOpTypeFloat:
+		return type.width / 8;
+	case SpvOpTypeVector:
+		return type.count * spirvTypeSize(ids, type.typeId, 0);
+	case SpvOpTypeMatrix:
+		return type.count * (matrixStride ? matrixStride : spirvTypeSize(ids, type.typeId, 0));
+	case SpvOpTypeArray: {
+		uint32_t length = ids[type.count].value;
+		return length * (type.arrayStride ? type.arrayStride : spirvTypeSize(ids, type.typeId, matrixStride));
+	}
+	case SpvOpTypeStruct: {
+		uint32_t size = 0;
+		for (size_t i = 0; i < type.members.size(); i++) {
+			uint32_t offset = i < type.memberOffsets.size() ? type.memberOffsets[i] : 0;
+			uint32_t stride = i < type.memberMatrixStrides.size() ? type.memberMatrixStrides[i] : 0;
+			size = std::max(size, offset + spirvTypeSize(ids, type.members[i], stride));
+		}
+		return size;
+	}
+	default:
+		return 0; // runtime arrays and opaque types
+	}
+}
+
+VkFormat spirvVertexFormat(const std::vector<SpirvId>& ids, uint32_t typeId) {
+	const SpirvId* type = &ids[typeId];
+	uint32_t components = 1;
+	if (type->opcode == SpvOpTypeVector) {
+		components = type->count;
+		type = &ids[type->typeId];
+	}
+	if (type->width != 32 || components < 1 || components > 4) {
+		return VK_FORMAT_UNDEFINED;
+	}
+	static const VkFormat floats[4] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	static const VkFormat sints[4] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+	static const VkFormat uints[4] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+	if (type->opcode == SpvOpTypeFloat) {
+		return floats[components - 1];
+	}
+	if (type->opcode == SpvOpTypeInt) {
+		return type->signedness ? sints[components - 1] : uints[components - 1];
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+VkShaderStageFlagBits spirvStage(uint32_t executionModel) {
+	switch (executionModel) {
+	case SpvExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+	case SpvExecutionModelTessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+	case SpvExecutionModelTessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+	case SpvExecutionModelGeometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+	case SpvExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+	case SpvExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+	default: return VK_SHADER_STAGE_ALL;
+	}
+}
+
+// descriptor type of a UniformConstant/Uniform/StorageBuffer variable's (array-stripped) type
+VkDescriptorType spirvDescriptorType(const std::vector<SpirvId>& ids, uint32_t storageClass, uint32_t typeId) {
+	const SpirvId& type = ids[typeId];
+	if (storageClass == SpvStorageClassStorageBuffer) {
+		return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+	if (storageClass == SpvStorageClassUniform) {
+		return type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	}
+	switch (type.opcode) {
+	case SpvOpTypeSampler:
+		return VK_DESCRIPTOR_TYPE_SAMPLER;
+	case SpvOpTypeSampledImage:
+		return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	case SpvOpTypeImage:
+		if (type.imageDim == SpvDimSubpassData) {
+			return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		}
+		if (type.imageDim == SpvDimBuffer) {
+			return type.imageSampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		}
+		return type.imageSampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	default:
+		return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	}
+}
+
+// Parses a SPIR-V module; only the first entry point is reflected.
+// Returns nullptr on success or a description of what is wrong with the module.
+const char* reflectSpirv(const uint32_t* code, size_t wordCount, ShaderReflection& reflection) {
+	reflection = ShaderReflection();
+	if (wordCount < 5 || code[0] != SpvMagicNumber) {
+		return "not a SPIR-V module";
+	}
+	uint32_t bound = code[3];
+	if (bound > (1u << 22)) {
+		return "id bound out of range";
+	}
+	std::vector<SpirvId> ids(bound);
+	uint32_t entryPointId = UINT32_MAX;
+	std::vector<uint32_t> variables;
+	std::vector<uint32_t> specConstants;
+
+	for (size_t pos = 5; pos < wordCount;) {
+		const uint32_t* insn = code + pos;
+		uint32_t opcode = insn[0] & SpvOpCodeMask;
+		uint32_t length = insn[0] >> SpvWordCountShift;
+		if (length == 0 || pos + length > wordCount) {
+			return "truncated instruction";
+		}
+		pos += length;
+
+		// every opcode handled below with a result id has it at word 1 (types) or word 2
+		auto result = [&](uint32_t word) -> SpirvId* {
+			if (word >= length || insn[word] >= bound) {
+				return nullptr;
+			}
+			ids[insn[word]].opcode = opcode;
+			return &ids[insn[word]];
+		};
+		SpirvId* id = nullptr;
+		switch (opcode) {
+		case SpvOpEntryPoint:
+			if (entryPointId == UINT32_MAX && length >= 4) {
+				reflection.stage = spirvStage(insn[1]);
+				entryPointId = insn[2];
+				reflection.entryPoint = spirvString(insn + 3, length - 3);
+			}
+			break;
+		case SpvOpExecutionMode:
+			if (length >= 6 && insn[1] == entryPointId && insn[2] == SpvExecutionModeLocalSize) {
+				reflection.localSize[0] = insn[3];
+				reflection.localSize[1] = insn[4];
+				reflection.localSize[2] = insn[5];
+			}
+			break;
+		case SpvOpName:
+			if (length >= 3 && insn[1] < bound) {
+				ids[insn[1]].name = spirvString(insn + 2, length - 2);
+			}
+			break;
+		case SpvOpDecorate:
+			if (length >= 3 && insn[1] < bound) {
+				SpirvId& target = ids[insn[1]];
+				uint32_t operand = length >= 4 ? insn[3] : 0;
+				switch (insn[2]) {
+				case SpvDecorationDescriptorSet: target.set = operand; break;
+				case SpvDecorationBinding: target.binding = operand; break;
+				case SpvDecorationLocation: target.location = operand; break;
+				case SpvDecorationSpecId: target.specId = operand; break;
+				case SpvDecorationArrayStride: target.arrayStride = operand; break;
+				case SpvDecorationBuiltIn: target.builtIn = true; break;
+				case SpvDecorationBlock: target.block = true; break;
+				case SpvDecorationBufferBlock: target.bufferBlock = true; break;
+				default: break;
+				}
+			}
+			break;
+		case SpvOpMemberDecorate:
+			if (length >= 4 && insn[1] < bound) {
+				SpirvId& target = ids[insn[1]];
+				uint32_t member = insn[2];
+				uint32_t operand = length >= 5 ? insn[4] : 0;
+				if (member >= target.memberOffsets.size()) {
+					target.memberOffsets.resize(member + 1, 0);
+					target.memberMatrixStrides.resize(member + 1, 0);
+				}
+				if (insn[3] == SpvDecorationOffset) {
+					target.memberOffsets[member] = operand;
+				}
+				else if (insn[3] == SpvDecorationMatrixStride) {
+					target.memberMatrixStrides[member] = operand;
+				}
+				else if (insn[3] == SpvDecorationBuiltIn) {
+					target.memberBuiltIn = true;
+				}
+			}
+			break;
+		case SpvOpTypeBool:
+		case SpvOpTypeSampler:
+			result(1);
+			break;
+		case SpvOpTypeInt:
+			if ((id = result(1)) && length >= 4) {
+				id->width = insn[2];
+				id->signedness = insn[3];
+			}
+			break;
+		case SpvOpTypeFloat:
+			if ((id = result(1)) && length >= 3) {
+				id->width = insn[2];
+			}
+			break;
+		case SpvOpTypeVector:
+		case SpvOpTypeMatrix:
+		case SpvOpTypeArray:
+			if (opcode == SpvOpTypeArray && length >= 4 && insn[3] >= bound) {
+				return "array length out of range";
+			}
+			if ((id = result(1)) && length >= 4) {
+				id->typeId = insn[2];
+				id->count = insn[3];
+			}
+			break;
+		case SpvOpTypeRuntimeArray:
+		case SpvOpTypeSampledImage:
+			if ((id = result(1)) && length >= 3) {
+				id->typeId = insn[2];
+			}
+			break;
+		case SpvOpTypeImage:
+			if ((id = result(1)) && length >= 8) {
+				id->typeId = insn[2];
+				id->imageDim = insn[3];
+				id->imageSampled = insn[7];
+			}
+			break;
+		case SpvOpTypeStruct:
+			if ((id = result(1))) {
+				id->members.assign(insn + 2, insn + length);
+			}
+			break;
+		case SpvOpTypePointer:
+			if ((id = result(1)) && length >= 4) {
+				id->storageClass = insn[2];
+				id->typeId = insn[3];
+			}
+			break;
+		case SpvOpConstant:
+		case SpvOpSpecConstant:
+			if ((id = result(2)) && length >= 4) {
+				id->typeId = insn[1];
+				id->value = insn[3];
+				if (opcode == SpvOpSpecConstant) {
+					specConstants.push_back(insn[2]);
+				}
+			}
+			break;
+		case SpvOpSpecConstantTrue:
+		case SpvOpSpecConstantFalse:
+			if ((id = result(2))) {
+				id->typeId = insn[1];
+				id->value = opcode == SpvOpSpecConstantTrue ? 1 : 0;
+				specConstants.push_back(insn[2]);
+			}
+			break;
+		case SpvOpVariable:
+			if ((id = result(2)) && length >= 4) {
+				id->typeId = insn[1];
+				id->storageClass = insn[3];
+				variables.push_back(insn[2]);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	if (entryPointId == UINT32_MAX) {
+		return "no entry point";
+	}
+
+	for (uint32_t varId : variables) {
+		const SpirvId& var = ids[varId];
+		if (var.typeId >= bound || ids[var.typeId].opcode != SpvOpTypePointer || ids[var.typeId].typeId >= bound) {
+			return "variable without a pointer type";
+		}
+		uint32_t typeId = ids[var.typeId].typeId;
+		switch (var.storageClass) {
+		case SpvStorageClassUniformConstant:
+		case SpvStorageClassUniform:
+		case SpvStorageClassStorageBuffer: {
+			if (var.set == UINT32_MAX || var.binding == UINT32_MAX) {
+				break;
+			}
+			ShaderBinding b;
+			b.set = var.set;
+			b.binding = var.binding;
+			b.name = var.name.empty() ? ids[typeId].name : var.name;
+			// arrays of resources become descriptorCount
+			while (ids[typeId].opcode == SpvOpTypeArray || ids[typeId].opcode == SpvOpTypeRuntimeArray) {
+				b.descriptorCount = ids[typeId].opcode == SpvOpTypeArray ? b.descriptorCount * ids[ids[typeId].count].value : 0;
+				typeId = ids[typeId].typeId;
+			}
+			b.descriptorType = spirvDescriptorType(ids, var.storageClass, typeId);
+			if (b.descriptorType == VK_DESCRIPTOR_TYPE_MAX_ENUM) {
+				return "unsupported descriptor type";
+			}
+			reflection.bindings.push_back(b);
+			break;
+		}
+		case SpvStorageClassPushConstant: {
+			const SpirvId& block = ids[typeId];
+			uint32_t begin = block.memberOffsets.empty() ? 0 : *std::min_element(block.memberOffsets.begin(), block.memberOffsets.end());
+			reflection.pushConstantOffset = begin;
+			reflection.pushConstantSize = spirvTypeSize(ids, typeId, 0) - begin;
+			break;
+		}
+		case SpvStorageClassInput:
+			if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT && !var.builtIn && !ids[typeId].memberBuiltIn && var.location != UINT32_MAX) {
+				reflection.vertexInputs.push_back({ var.location, spirvVertexFormat(ids, typeId), var.name });
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	for (uint32_t constId : specConstants) {
+		const SpirvId& c = ids[constId];
+		if (c.specId != UINT32_MAX) {
+			uint32_t size = ids[c.typeId].opcode == SpvOpTypeBool ? 4 : ids[c.typeId].width / 8;
+			reflection.specConstants.push_back({ c.specId, size, c.value, c.name });
+		}
+	}
+
+	std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const ShaderBinding& a, const ShaderBinding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+	std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(), [](const ShaderVertexInput& a, const ShaderVertexInput& b) {
+		return a.location < b.location;
+	});
+	return nullptr;
+}
+
+// nullptr when the shader has no specialization constant of that name
+const ShaderSpecConstant* findSpecConstant(const ShaderReflection& reflection, const char* name) {
+	for (const auto& c : reflection.specConstants) {
+		if (c.name == name) {
+			return &c;
+		}
+	}
+	return nullptr;
+}
+
+// throws if the pipeline's vertex attributes do not feed every input of the vertex shader
+void validateVertexInputs(const ShaderReflection& reflection, const VkVertexInputAttributeDescription* attributes, uint32_t attributeCount) {
+	for (const auto& input : reflection.vertexInputs) {
+		const VkVertexInputAttributeDescription* found = nullptr;
+		for (uint32_t i = 0; i < attributeCount; i++) {
+			if (attributes[i].location == input.location) {
+				found = &attributes[i];
+			}
+		}
+		if (!found) {
+			throw std::runtime_error("failed to find vertex attribute for location " + std::to_string(input.location) + " (" + input.name + ")!");
+		}
+		if (input.format != VK_FORMAT_UNDEFINED && found->format != input.format) {
+			throw std::runtime_error("vertex attribute format mismatch at location " + std::to_string(input.location) + " (" + input.name + ")!");
+		}
+	}
+}
+
+struct ReflectedShader {
+	VkShaderModule module = VK_NULL_HANDLE;
+	ShaderReflection reflection;
+};
+
+ReflectedShader loadReflectedShader(VkDevice dev, const std::string& path) {
+	MappedFile file;
+	if (!mapFile(path, file) || file.size % 4 != 0) {
+		unmapFile(file);
+		throw std::runtime_error("failed to read shader " + path);
+	}
+	ReflectedShader shader;
+	const uint32_t* code = reinterpret_cast<const uint32_t*>(file.data);
+	const char* error = reflectSpirv(code, file.size / 4, shader.reflection);
+	if (error) {
+		unmapFile(file);
+		throw std::runtime_error("failed to reflect shader " + path + ": " + error);
+	}
+
+	VkShaderModuleCreateInfo module_ci = {};
+	module_ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	module_ci.codeSize = file.size;
+	module_ci.pCode = code;
+	VkResult res = vkCreateShaderModule(dev, &module_ci, hostAllocationCallbacks(), &shader.module);
+	unmapFile(file);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create shader module!");
+	}
+	return shader;
+}
+
+void destroyReflectedShader(VkDevice dev, ReflectedShader& shader) {
+	vkDestroyShaderModule(dev, shader.module, hostAllocationCallbacks());
+	shader = ReflectedShader();
+}
+
+// ---------------------------------------------------------------------------
+// layout cache
+
+struct ReflectedLayout {
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSetLayout> setLayouts;   // indexed by set number
+	std::vector<std::vector<VkDescriptorSetLayoutBinding>> setBindings;
+	VkShaderStageFlags pushConstantStages = 0;       // pass these to vkCmdPushConstants
+	uint32_t pushConstantSize = 0;                   // end of the merged push constant range
+};
+
+struct CachedSetLayout {
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	VkDescriptorSetLayout layout;
+};
+
+struct CachedPipelineLayout {
+	std::vector<VkDescriptorSetLayout> setLayouts;
+	VkPushConstantRange pushConstants;
+	VkPipelineLayout layout;
+};
+
+struct LayoutCache {
+	VkDevice device = VK_NULL_HANDLE;
+	std::mutex mutex;
+	std::unordered_multimap<uint64_t, CachedSetLayout> setLayouts;
+	std::unordered_multimap<uint64_t, CachedPipelineLayout> pipelineLayouts;
+	uint32_t setLayoutHits = 0;
+	uint32_t pipelineLayoutHits = 0;
+};
+
+void initLayoutCache(LayoutCache& cache, VkDevice dev) {
+	cache.device = dev;
+}
+
+uint64_t hashLayoutWords(uint64_t hash, const uint32_t* words, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		hash ^= words[i];
+		hash *= 1099511628211ull; // FNV-1a over 32-bit words
+	}
+	return hash;
+}
+
+VkDescriptorSetLayout getDescriptorSetLayout(LayoutCache& cache, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+	uint64_t hash = 14695981039346656037ull;
+	for (const auto& b : bindings) {
+		uint32_t words[4] = { b.binding, static_cast<uint32_t>(b.descriptorType), b.descriptorCount, b.stageFlags };
+		hash = hashLayoutWords(hash, words, 4);
+	}
+	auto same = [&bindings](const CachedSetLayout& entry) {
+		if (entry.bindings.size() != bindings.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < bindings.size(); i++) {
+			const auto& a = entry.bindings[i];
+			const auto& b = bindings[i];
+			if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	auto range = cache.setLayouts.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (same(it->second)) {
+			cache.setLayoutHits++;
+			return it->second.layout;
+		}
+	}
+
+	VkDescriptorSetLayoutCreateInfo set_ci = {};
+	set_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_ci.bindingCount = static_cast<uint32_t>(bindings.size());
+	set_ci.pBindings = bindings.data();
+	VkDescriptorSetLayout layout;
+	if (vkCreateDescriptorSetLayout(cache.device, &set_ci, hostAllocationCallbacks(), &layout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+	cache.setLayouts.insert({ hash, { bindings, layout } });
+	return layout;
+}
+
+VkPipelineLayout getPipelineLayout(LayoutCache& cache, const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstants) {
+	uint64_t hash = 14695981039346656037ull;
+	for (VkDescriptorSetLayout setLayout : setLayouts) {
+		uint64_t handle = (uint64_t)setLayout;
+		uint32_t words[2] = { static_cast<uint32_t>(handle), static_cast<uint32_t>(handle >> 32) };
+		hash = hashLayoutWords(hash, words, 2);
+	}
+	uint32_t words[3] = { pushConstants.stageFlags, pushConstants.offset, pushConstants.size };
+	hash = hashLayoutWords(hash, words, 3);
+
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	auto range = cache.pipelineLayouts.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		const CachedPipelineLayout& entry = it->second;
+		if (entry.setLayouts == setLayouts && entry.pushConstants.stageFlags == pushConstants.stageFlags &&
+			entry.pushConstants.offset == pushConstants.offset && entry.pushConstants.size == pushConstants.size) {
+			cache.pipelineLayoutHits++;
+			return entry.layout;
+		}
+	}
+
+	VkPipelineLayoutCreateInfo layout_ci = {};
+	layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_ci.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	layout_ci.pSetLayouts = setLayouts.data();
+	layout_ci.pushConstantRangeCount = pushConstants.size ? 1 : 0;
+	layout_ci.pPushConstantRanges = &pushConstants;
+	VkPipelineLayout layout;
+	if (vkCreatePipelineLayout(cache.device, &layout_ci, hostAllocationCallbacks(), &layout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+	cache.pipelineLayouts.insert({ hash, { setLayouts, pushConstants, layout } });
+	return layout;
+}
+
+// Merges the reflection of all stages of one pipeline: bindings used by several stages get
+// the union of their stage flags, and the push constant blocks become a single range visible
+// to every stage that declares one.
+ReflectedLayout getReflectedLayout(LayoutCache& cache, const std::vector<const ShaderReflection*>& shaders) {
+	ReflectedLayout result;
+	uint32_t pushBegin = UINT32_MAX;
+	for (const ShaderReflection* shader : shaders) {
+		for (const ShaderBinding& b : shader->bindings) {
+			if (b.descriptorCount == 0) {
+				throw std::runtime_error("failed to build layout: runtime-sized descriptor array " + b.name + "!");
+			}
+			if (b.set >= result.setBindings.size()) {
+				result.setBindings.resize(b.set + 1);
+			}
+			auto& set = result.setBindings[b.set];
+			auto it = std::find_if(set.begin(), set.end(), [&b](const VkDescriptorSetLayoutBinding& e) { return e.binding == b.binding; });
+			if (it == set.end()) {
+				VkDescriptorSetLayoutBinding binding = {};
+				binding.binding = b.binding;
+				binding.descriptorType = b.descriptorType;
+				binding.descriptorCount = b.descriptorCount;
+				binding.stageFlags = shader->stage;
+				set.push_back(binding);
+			}
+			else if (it->descriptorType != b.descriptorType || it->descriptorCount != b.descriptorCount) {
+				throw std::runtime_error("failed to build layout: stages disagree on set " + std::to_string(b.set) +
+					" binding " + std::to_string(b.binding) + "!");
+			}
+			else {
+				it->stageFlags |= shader->stage;
+			}
+		}
+		if (shader->pushConstantSize) {
+			result.pushConstantStages |= shader->stage;
+			pushBegin = std::min(pushBegin, shader->pushConstantOffset);
+			result.pushConstantSize = std::max(result.pushConstantSize, shader->pushConstantOffset + shader->pushConstantSize);
+		}
+	}
+
+	// sets without bindings below the highest used set get an empty layout
+	for (auto& set : result.setBindings) {
+		std::sort(set.begin(), set.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+			return a.binding < b.binding;
+		});
+		result.setLayouts.push_back(getDescriptorSetLayout(cache, set));
+	}
+	VkPushConstantRange pushConstants = {};
+	if (result.pushConstantSize) {
+		pushConstants.stageFlags = result.pushConstantStages;
+		pushConstants.offset = pushBegin;
+		pushConstants.size = result.pushConstantSize - pushBegin;
+	}
+	result.layout = getPipelineLayout(cache, result.setLayouts, pushConstants);
+	return result;
+}
+
+void dumpLayoutCacheStats(const LayoutCache& cache) {
+	std::cout << "layout cache:\t" << cache.setLayouts.size() << " set layouts (" << cache.setLayoutHits << " reused), "
+		<< cache.pipelineLayouts.size() << " pipeline layouts (" << cache.pipelineLayoutHits << " reused)\n";
+}
+
+// the layouts must no longer be referenced by any pipeline or command buffer
+void destroyLayoutCache(LayoutCache& cache) {
+	for (auto& entry : cache.pipelineLayouts) {
+		vkDestroyPipelineLayout(cache.device, entry.second.layout, hostAllocationCallbacks());
+	}
+	for (auto& entry : cache.setLayouts) {
+		vkDestroyDescriptorSetLayout(cache.device, entry.second.layout, hostAllocationCallbacks());
+	}
+	cache.pipelineLayouts.clear();
+	cache.setLayouts.clear();
+	cache.setLayoutHits = 0;
+	cache.pipelineLayoutHits = 0;
+}
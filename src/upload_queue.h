@@ -0,0 +1,335 @@
+#pragma once
+
+// Asynchronous uploads on a dedicated transfer queue.
+// Data is copied into a persistently mapped staging ring, many small copies are batched
+// into one submit, and buffers are handed over to the graphics family with queue family
+// ownership transfer barriers. Every batch gets a monotonically increasing ticket; a batch
+// is complete once its fence has signaled, so callers poll tickets instead of waiting.
+// (The bundled headers predate VK_KHR_timeline_semaphore, so the timeline is emulated
+// with one fence and one binary semaphore per batch.)
+// A batch whose semaphore has not been waited on by a graphics submit yet cannot be reused,
+// so bursts that fill the ring several times before the next frame grow the batch list.
+
+#include "vk_dispatch.h"
+#include <string.h>
+#include <stdexcept>
+#include <vector>
+
+#include "host_allocator.h"
+#include "memory_allocator.h"
+
+static const uint32_t kUploadBatchCount = 4;  // initial, grows under upload bursts
+
+struct UploadBatch {
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	VkSemaphore transferDone = VK_NULL_HANDLE;  // waited on by the graphics submit that acquires the buffers
+	std::vector<MemoryAllocation> staging;
+	std::vector<VkBufferMemoryBarrier> ownership; // release on transfer, acquire on graphics
+	uint64_t ticket = 0;
+	bool recording = false;
+	bool submitted = false;
+	bool acquired = false;
+	uint64_t acquireFrame = 0;
+	VkFence acquireFence = VK_NULL_HANDLE;      // of the graphics submit of acquireFrame
+};
+
+struct UploadQueue {
+	DeviceMemoryAllocator* allocator = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t familyIndex = 0;
+	uint32_t graphicsFamilyIndex = 0;
+	MemoryBlock* stagingPool = nullptr;
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	VkDeviceSize stagingAlignment = 16;
+	std::vector<UploadBatch> batches;           // in submit order from current on
+	uint32_t current = 0;
+	uint64_t nextTicket = 1;
+	uint64_t completedTicket = 0;
+	uint64_t completedFrames = 0;               // graphics frames known to be done
+
+	// statistics
+	uint64_t copies = 0;
+	uint64_t bytes = 0;
+	uint64_t submits = 0;
+	uint64_t stalls = 0;
+};
+
+// prefers a transfer-only family (DMA engine), then any family without graphics
+uint32_t findTransferQueueIndex(const std::vector<VkQueueFamilyProperties>& queueFamilies, uint32_t graphics_index) {
+	uint32_t queueFamilyCount = static_cast<uint32_t>(queueFamilies.size());
+	uint32_t fallback = graphics_index;
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
+		VkQueueFlags flags = queueFamilies[i].queueFlags;
+		if (queueFamilies[i].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+			continue;
+		}
+		if (!(flags & VK_QUEUE_COMPUTE_BIT)) {
+			return i;
+		}
+		if (fallback == graphics_index) {
+			fallback = i;
+		}
+	}
+	return fallback;
+}
+
+void createUploadBatch(UploadQueue& uq, UploadBatch& batch) {
+	VkCommandPoolCreateInfo pool_ci = {};
+	pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	pool_ci.queueFamilyIndex = uq.familyIndex;
+	if (vkCreateCommandPool(uq.device, &pool_ci, hostAllocationCallbacks(), &batch.commandPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+	VkCommandBufferAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = batch.commandPool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+	VkFenceCreateInfo fence_ci = {};
+	fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkSemaphoreCreateInfo semaphore_ci = {};
+	semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	if (vkAllocateCommandBuffers(uq.device, &alloc_info, &batch.commandBuffer) != VK_SUCCESS ||
+		vkCreateFence(uq.device, &fence_ci, hostAllocationCallbacks(), &batch.fence) != VK_SUCCESS ||
+		vkCreateSemaphore(uq.device, &semaphore_ci, hostAllocationCallbacks(), &batch.transferDone) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload batch!");
+	}
+}
+
+void initUploadQueue(UploadQueue& uq, DeviceMemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits,
+	VkQueue queue, uint32_t familyIndex, uint32_t graphicsFamilyIndex, VkDeviceSize stagingSize)
+{
+	uq.allocator = &allocator;
+	uq.device = allocator.device;
+	uq.queue = queue;
+	uq.familyIndex = familyIndex;
+	uq.graphicsFamilyIndex = graphicsFamilyIndex;
+
+	uq.stagingAlignment = std::max<VkDeviceSize>(limits.optimalBufferCopyOffsetAlignment, 16);
+
+	// one buffer spans the whole ring, so ring offsets are buffer offsets
+	VkBufferCreateInfo buffer_ci = {};
+	buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_ci.size = stagingSize;
+	buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(uq.device, &buffer_ci, hostAllocationCallbacks(), &uq.stagingBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+	VkMemoryRequirements reqs;
+	vkGetBufferMemoryRequirements(uq.device, uq.stagingBuffer, &reqs);
+	uq.stagingPool = createMemoryPool(allocator, reqs.size, reqs.memoryTypeBits, MemoryUsage::Upload,
+		BlockStrategy::Ring, ResourceTiling::Linear);
+	vkBindBufferMemory(uq.device, uq.stagingBuffer, uq.stagingPool->memory, 0);
+
+	uq.batches.resize(kUploadBatchCount);
+	for (auto& batch : uq.batches) {
+		createUploadBatch(uq, batch);
+	}
+}
+
+// Non-blocking: retires batches whose fence has signaled and returns their staging memory.
+// Graphics frames [0, completedFrames) are known to have finished on the GPU; a batch's
+// semaphore may only be signaled again after the frame that waited on it is done.
+void collectUploads(UploadQueue& uq, uint64_t completedFrames) {
+	uq.completedFrames = std::max(uq.completedFrames, completedFrames);
+	for (auto& batch : uq.batches) {
+		if (!batch.submitted || vkGetFenceStatus(uq.device, batch.fence) != VK_SUCCESS) {
+			continue;
+		}
+		for (auto& staging : batch.staging) {
+			freeMemory(*uq.allocator, staging);
+		}
+		batch.staging.clear();
+		uq.completedTicket = std::max(uq.completedTicket, batch.ticket);
+		if (batch.acquired && batch.acquireFrame < uq.completedFrames) {
+			vkResetFences(uq.device, 1, &batch.fence);
+			batch.submitted = false;
+			batch.acquired = false;
+		}
+	}
+}
+
+bool isUploadComplete(const UploadQueue& uq, uint64_t ticket) {
+	return ticket <= uq.completedTicket;
+}
+
+UploadBatch& beginUploadBatch(UploadQueue& uq) {
+	if (uq.batches[uq.current].recording) {
+		return uq.batches[uq.current];
+	}
+	if (uq.batches[uq.current].submitted && !uq.batches[uq.current].acquired) {
+		// the ring filled up once per batch since the last frame: its semaphore has no waiter
+		// yet and cannot be signaled again, so add a batch in front of it instead
+		uq.batches.insert(uq.batches.begin() + uq.current, UploadBatch());
+		createUploadBatch(uq, uq.batches[uq.current]);
+	}
+	UploadBatch& batch = uq.batches[uq.current];
+	if (batch.submitted) {
+		// every batch is still in flight; only happens when uploads outpace the GPU
+		uq.stalls++;
+		vkWaitForFences(uq.device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+		if (batch.acquireFrame >= uq.completedFrames) {
+			// transferDone may only be signaled again once the frame that waited on it is done
+			vkWaitForFences(uq.device, 1, &batch.acquireFence, VK_TRUE, UINT64_MAX);
+			uq.completedFrames = batch.acquireFrame + 1;
+		}
+		collectUploads(uq, uq.completedFrames);
+	}
+	vkResetCommandPool(uq.device, batch.commandPool, 0);
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(batch.commandBuffer, &begin_info);
+	batch.recording = true;
+	batch.ticket = uq.nextTicket;
+	return batch;
+}
+
+// submits the batch being recorded; returns its ticket (0 when nothing was recorded)
+uint64_t flushUploads(UploadQueue& uq) {
+	UploadBatch& batch = uq.batches[uq.current];
+	if (!batch.recording) {
+		return 0;
+	}
+	if (uq.familyIndex != uq.graphicsFamilyIndex && !batch.ownership.empty()) {
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, static_cast<uint32_t>(batch.ownership.size()), batch.ownership.data(), 0, nullptr);
+	}
+	vkEndCommandBuffer(batch.commandBuffer);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &batch.commandBuffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &batch.transferDone;
+	if (vkQueueSubmit(uq.queue, 1, &submit_info, batch.fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit upload batch!");
+	}
+	batch.recording = false;
+	batch.submitted = true;
+	uq.submits++;
+	uq.nextTicket++;
+	uq.current = (uq.current + 1) % static_cast<uint32_t>(uq.batches.size());
+	return batch.ticket;
+}
+
+// Queues a copy of size bytes into dst at dstOffset and returns the ticket of the batch that
+// carries it. dst must be VK_SHARING_MODE_EXCLUSIVE and is owned by the graphics family again
+// once acquireUploads() has been recorded and submitted.
+uint64_t uploadBuffer(UploadQueue& uq, VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+	VkAccessFlags dstAccess)
+{
+	VkMemoryRequirements reqs = {};
+	reqs.size = size;
+	reqs.alignment = uq.stagingAlignment;
+	reqs.memoryTypeBits = 1u << uq.stagingPool->memoryType;
+	MemoryAllocation staging = allocateFromPool(*uq.allocator, uq.stagingPool, reqs);
+	if (staging.memory == VK_NULL_HANDLE) {
+		// ring is full: push what we have and reclaim finished batches
+		flushUploads(uq);
+		collectUploads(uq, 0);
+		staging = allocateFromPool(*uq.allocator, uq.stagingPool, reqs);
+		uint32_t batchCount = static_cast<uint32_t>(uq.batches.size());
+		for (uint32_t i = 0; staging.memory == VK_NULL_HANDLE && i < batchCount; i++) {
+			UploadBatch& oldest = uq.batches[(uq.current + i) % batchCount];
+			if (oldest.submitted) {
+				uq.stalls++;
+				vkWaitForFences(uq.device, 1, &oldest.fence, VK_TRUE, UINT64_MAX);
+				collectUploads(uq, 0);
+				staging = allocateFromPool(*uq.allocator, uq.stagingPool, reqs);
+			}
+		}
+		if (staging.memory == VK_NULL_HANDLE) {
+			throw std::runtime_error("upload is larger than the staging ring!");
+		}
+	}
+	memcpy(staging.mapped, data, static_cast<size_t>(size));
+	flushAllocation(*uq.allocator, staging);
+
+	UploadBatch& batch = beginUploadBatch(uq);
+	VkBufferCopy region = {};
+	region.srcOffset = staging.offset;
+	region.dstOffset = dstOffset;
+	region.size = size;
+	vkCmdCopyBuffer(batch.commandBuffer, uq.stagingBuffer, dst, 1, &region);
+	batch.staging.push_back(staging);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = uq.familyIndex;
+	barrier.dstQueueFamilyIndex = uq.graphicsFamilyIndex;
+	barrier.buffer = dst;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+	batch.ownership.push_back(barrier);
+
+	uq.copies++;
+	uq.bytes += size;
+	return batch.ticket;
+}
+
+// Records the acquire half of the ownership transfer for every submitted batch into the
+// graphics command buffer, and returns the semaphores that graphics submit has to wait on.
+// frameFence is the fence of that submit; it is only waited on while frameNumber has not been
+// reported complete through collectUploads, so it may be reused after that.
+void acquireUploads(UploadQueue& uq, VkCommandBuffer graphicsCmd, uint64_t frameNumber, VkFence frameFence,
+	std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages)
+{
+	std::vector<VkBufferMemoryBarrier> barriers;
+	for (auto& batch : uq.batches) {
+		if (!batch.submitted || batch.acquired) {
+			continue;
+		}
+		for (auto barrier : batch.ownership) {
+			if (uq.familyIndex == uq.graphicsFamilyIndex) {
+				// same family: a plain memory barrier, no ownership transfer
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			}
+			else {
+				barrier.srcAccessMask = 0;
+			}
+			barriers.push_back(barrier);
+		}
+		batch.ownership.clear();
+		batch.acquired = true;
+		batch.acquireFrame = frameNumber;
+		batch.acquireFence = frameFence;
+		waitSemaphores.push_back(batch.transferDone);
+		waitStages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+	if (!barriers.empty()) {
+		vkCmdPipelineBarrier(graphicsCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+			| VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+	}
+}
+
+void dumpUploadStats(const UploadQueue& uq) {
+	std::cout << "uploads:\t" << uq.copies << " copies, " << uq.bytes / 1024 << " KiB in " << uq.submits
+		<< " submits on queue family " << uq.familyIndex
+		<< (uq.familyIndex != uq.graphicsFamilyIndex ? " (dedicated transfer)" : " (graphics)")
+		<< ", " << uq.stalls << " CPU stalls\n";
+}
+
+void destroyUploadQueue(UploadQueue& uq) {
+	for (auto& batch : uq.batches) {
+		for (auto& staging : batch.staging) {
+			freeMemory(*uq.allocator, staging);
+		}
+		vkDestroySemaphore(uq.device, batch.transferDone, hostAllocationCallbacks());
+		vkDestroyFence(uq.device, batch.fence, hostAllocationCallbacks());
+		vkDestroyCommandPool(uq.device, batch.commandPool, hostAllocationCallbacks());
+	}
+	uq.batches.clear();
+	uq.current = 0;
+	vkDestroyBuffer(uq.device, uq.stagingBuffer, hostAllocationCallbacks());
+	destroyMemoryPool(*uq.allocator, uq.stagingPool);
+}
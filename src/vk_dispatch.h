@@ -0,0 +1,226 @@
+#pragma once
+
+// Vulkan function dispatch.
+// The Vulkan library is opened at run time instead of being linked, so the sample starts
+// without a Vulkan SDK on the build machine and reports a missing driver instead of failing
+// to load. Entry points are resolved in three steps:
+//  loadVulkanLibrary   - vkGetInstanceProcAddr from the library, then the global functions
+//  loadVulkanInstance  - instance functions through vkGetInstanceProcAddr
+//  loadVulkanDevice    - device functions through vkGetDeviceProcAddr
+// Device functions obtained from vkGetDeviceProcAddr point straight into the driver; the
+// loader's trampolines, which look up the dispatch table of every handle on every call, stay
+// out of command recording. The pointers carry the names of the prototypes that
+// VK_NO_PROTOTYPES removes, so call sites do not change.
+// Every header includes this one instead of <vulkan/vulkan.h>.
+
+#ifndef VK_NO_PROTOTYPES
+	#define VK_NO_PROTOTYPES
+#endif
+#include <vulkan/vulkan.h>
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+
+#define VK_GLOBAL_FUNCTIONS(X) \
+	X(vkCreateInstance) \
+	X(vkEnumerateInstanceExtensionProperties) \
+	X(vkEnumerateInstanceLayerProperties)
+
+#define VK_INSTANCE_FUNCTIONS(X) \
+	X(vkDestroyInstance) \
+	X(vkEnumeratePhysicalDevices) \
+	X(vkGetPhysicalDeviceFeatures) \
+	X(vkGetPhysicalDeviceProperties) \
+	X(vkGetPhysicalDeviceMemoryProperties) \
+	X(vkGetPhysicalDeviceQueueFamilyProperties) \
+	X(vkEnumerateDeviceExtensionProperties) \
+	X(vkCreateDevice) \
+	X(vkGetDeviceProcAddr) \
+	X(vkDestroySurfaceKHR) \
+	X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+	X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+	X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+	X(vkGetPhysicalDeviceSurfacePresentModesKHR)
+
+#define VK_DEVICE_FUNCTIONS(X) \
+	X(vkDestroyDevice) \
+	X(vkDeviceWaitIdle) \
+	X(vkGetDeviceQueue) \
+	X(vkQueueSubmit) \
+	X(vkQueueWaitIdle) \
+	X(vkAllocateMemory) \
+	X(vkFreeMemory) \
+	X(vkMapMemory) \
+	X(vkUnmapMemory) \
+	X(vkFlushMappedMemoryRanges) \
+	X(vkInvalidateMappedMemoryRanges) \
+	X(vkCreateBuffer) \
+	X(vkDestroyBuffer) \
+	X(vkGetBufferMemoryRequirements) \
+	X(vkBindBufferMemory) \
+	X(vkCreateImage) \
+	X(vkDestroyImage) \
+	X(vkGetImageMemoryRequirements) \
+	X(vkBindImageMemory) \
+	X(vkCreateImageView) \
+	X(vkDestroyImageView) \
+	X(vkCreateFence) \
+	X(vkDestroyFence) \
+	X(vkResetFences) \
+	X(vkGetFenceStatus) \
+	X(vkWaitForFences) \
+	X(vkCreateSemaphore) \
+	X(vkDestroySemaphore) \
+	X(vkCreateQueryPool) \
+	X(vkDestroyQueryPool) \
+	X(vkGetQueryPoolResults) \
+	X(vkCreateShaderModule) \
+	X(vkDestroyShaderModule) \
+	X(vkCreatePipelineCache) \
+	X(vkDestroyPipelineCache) \
+	X(vkGetPipelineCacheData) \
+	X(vkMergePipelineCaches) \
+	X(vkCreateGraphicsPipelines) \
+	X(vkCreateComputePipelines) \
+	X(vkDestroyPipeline) \
+	X(vkCreatePipelineLayout) \
+	X(vkDestroyPipelineLayout) \
+	X(vkCreateDescriptorSetLayout) \
+	X(vkDestroyDescriptorSetLayout) \
+	X(vkCreateDescriptorPool) \
+	X(vkDestroyDescriptorPool) \
+	X(vkResetDescriptorPool) \
+	X(vkAllocateDescriptorSets) \
+	X(vkUpdateDescriptorSets) \
+	X(vkCreateFramebuffer) \
+	X(vkDestroyFramebuffer) \
+	X(vkCreateRenderPass) \
+	X(vkDestroyRenderPass) \
+	X(vkCreateCommandPool) \
+	X(vkDestroyCommandPool) \
+	X(vkResetCommandPool) \
+	X(vkAllocateCommandBuffers) \
+	X(vkFreeCommandBuffers) \
+	X(vkBeginCommandBuffer) \
+	X(vkEndCommandBuffer) \
+	X(vkCmdBindPipeline) \
+	X(vkCmdSetViewport) \
+	X(vkCmdSetScissor) \
+	X(vkCmdBindDescriptorSets) \
+	X(vkCmdBindVertexBuffers) \
+	X(vkCmdBindIndexBuffer) \
+	X(vkCmdDraw) \
+	X(vkCmdDrawIndexed) \
+	X(vkCmdDrawIndexedIndirect) \
+	X(vkCmdDrawIndexedIndirectCountKHR) \
+	X(vkCmdDispatch) \
+	X(vkCmdCopyBuffer) \
+	X(vkCmdFillBuffer) \
+	X(vkCmdCopyImageToBuffer) \
+	X(vkCmdPipelineBarrier) \
+	X(vkCmdResetQueryPool) \
+	X(vkCmdWriteTimestamp) \
+	X(vkCmdPushConstants) \
+	X(vkCmdBeginRenderPass) \
+	X(vkCmdNextSubpass) \
+	X(vkCmdEndRenderPass) \
+	X(vkCmdExecuteCommands) \
+	X(vkCreateSwapchainKHR) \
+	X(vkDestroySwapchainKHR) \
+	X(vkGetSwapchainImagesKHR) \
+	X(vkAcquireNextImageKHR) \
+	X(vkQueuePresentKHR)
+
+#define VK_DECLARE_FUNCTION(name) PFN_##name name = nullptr;
+PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VK_GLOBAL_FUNCTIONS(VK_DECLARE_FUNCTION)
+VK_INSTANCE_FUNCTIONS(VK_DECLARE_FUNCTION)
+VK_DEVICE_FUNCTIONS(VK_DECLARE_FUNCTION)
+#undef VK_DECLARE_FUNCTION
+
+// device functions of one VkDevice, for code that drives more than one device
+struct VulkanDeviceTable {
+#define VK_DECLARE_MEMBER(name) PFN_##name name = nullptr;
+	VK_DEVICE_FUNCTIONS(VK_DECLARE_MEMBER)
+#undef VK_DECLARE_MEMBER
+};
+
+#ifdef _WIN32
+HMODULE _vulkanLibrary = nullptr;
+#else
+void* _vulkanLibrary = nullptr;
+#endif
+
+// returns false when no Vulkan driver is installed
+bool loadVulkanLibrary() {
+	if (_vulkanLibrary) {
+		return true;
+	}
+#if defined(_WIN32)
+	_vulkanLibrary = LoadLibraryA("vulkan-1.dll");
+	if (!_vulkanLibrary) {
+		return false;
+	}
+	vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(GetProcAddress(_vulkanLibrary, "vkGetInstanceProcAddr"));
+#else
+	#if defined(__APPLE__)
+	const char* names[] = { "libvulkan.dylib", "libvulkan.1.dylib", "libMoltenVK.dylib" };
+	#else
+	const char* names[] = { "libvulkan.so.1", "libvulkan.so" };
+	#endif
+	for (const char* name : names) {
+		_vulkanLibrary = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+		if (_vulkanLibrary) {
+			break;
+		}
+	}
+	if (!_vulkanLibrary) {
+		return false;
+	}
+	vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(dlsym(_vulkanLibrary, "vkGetInstanceProcAddr"));
+#endif
+	if (!vkGetInstanceProcAddr) {
+		return false;
+	}
+#define VK_LOAD_GLOBAL(name) name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(VK_NULL_HANDLE, #name));
+	VK_GLOBAL_FUNCTIONS(VK_LOAD_GLOBAL)
+#undef VK_LOAD_GLOBAL
+	return vkCreateInstance != nullptr;
+}
+
+void loadVulkanInstance(VkInstance instance) {
+#define VK_LOAD_INSTANCE(name) name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name));
+	VK_INSTANCE_FUNCTIONS(VK_LOAD_INSTANCE)
+#undef VK_LOAD_INSTANCE
+}
+
+// functions of extensions the device was not created with stay null
+void loadVulkanDeviceTable(VkDevice device, VulkanDeviceTable& table) {
+#define VK_LOAD_DEVICE(name) table.name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+	VK_DEVICE_FUNCTIONS(VK_LOAD_DEVICE)
+#undef VK_LOAD_DEVICE
+}
+
+// points the global device functions at the driver entry points of device
+void loadVulkanDevice(VkDevice device) {
+	VulkanDeviceTable table;
+	loadVulkanDeviceTable(device, table);
+#define VK_USE_DEVICE(name) name = table.name;
+	VK_DEVICE_FUNCTIONS(VK_USE_DEVICE)
+#undef VK_USE_DEVICE
+}
+
+void unloadVulkanLibrary() {
+	if (!_vulkanLibrary) {
+		return;
+	}
+#ifdef _WIN32
+	FreeLibrary(_vulkanLibrary);
+#else
+	dlclose(_vulkanLibrary);
+#endif
+	_vulkanLibrary = nullptr;
+	vkGetInstanceProcAddr = nullptr;
+}